@@ -405,6 +405,8 @@ void Application::Start() {
     protocol_->OnIncomingAudio([this](std::unique_ptr<AudioStreamPacket> packet) {
         if (device_state_ == kDeviceStateSpeaking) {
             audio_service_.PushPacketToDecodeQueue(std::move(packet));
+        } else {
+            audio_service_.ReleasePacket(std::move(packet));
         }
     });
     protocol_->OnAudioChannelOpened([this, codec, &board]() {
@@ -413,6 +415,11 @@ void Application::Start() {
             ESP_LOGW(TAG, "Server sample rate %d does not match device output sample rate %d, resampling may cause distortion",
                 protocol_->server_sample_rate(), codec->output_sample_rate());
         }
+        if (protocol_->server_frame_duration() != OPUS_FRAME_DURATION_MS) {
+            ESP_LOGI(TAG, "Server chose frame duration %d ms instead of %d ms",
+                protocol_->server_frame_duration(), OPUS_FRAME_DURATION_MS);
+        }
+        audio_service_.SetFrameDuration(protocol_->server_frame_duration());
     });
     protocol_->OnAudioChannelClosed([this, &board]() {
         board.SetPowerSaveMode(true);
@@ -562,6 +569,8 @@ void Application::OnClockTimer() {
         // SystemInfo::PrintTaskCpuUsage(pdMS_TO_TICKS(1000));
         // SystemInfo::PrintTaskList();
         SystemInfo::PrintHeapStats();
+        audio_service_.PrintPoolStats();
+        audio_service_.PrintTimingStats();
     }
 }
 
@@ -594,7 +603,10 @@ void Application::MainEventLoop() {
 
         if (bits & MAIN_EVENT_SEND_AUDIO) {
             while (auto packet = audio_service_.PopPacketFromSendQueue()) {
-                if (!protocol_->SendAudio(std::move(packet))) {
+                bool sent = protocol_->SendAudio(*packet);
+                audio_service_.ReleasePacket(std::move(packet));
+                if (!sent) {
+                    audio_service_.ReportSendFailure();
                     break;
                 }
             }
@@ -643,7 +655,7 @@ void Application::OnWakeWordDetected() {
 #if CONFIG_USE_AFE_WAKE_WORD || CONFIG_USE_CUSTOM_WAKE_WORD
         // Encode and send the wake word data to the server
         while (auto packet = audio_service_.PopWakeWordPacket()) {
-            protocol_->SendAudio(std::move(packet));
+            protocol_->SendAudio(*packet);
         }
         // Set the chat state to wake word detected
         protocol_->SendWakeWordDetected(wake_word);
@@ -689,8 +701,9 @@ void Application::SetDeviceState(DeviceState state) {
     auto led = board.GetLed();
     led->OnStateChanged();
     
-    // 当从idle状态变成其他任何状态时，停止音乐播放
-    if (previous_state == kDeviceStateIdle && state != kDeviceStateIdle) {
+    // 对话时音乐继续播放，由 AudioService 混音并压低音量；进入无法播放音乐的状态时才停止
+    audio_service_.EnableMusicDucking(state != kDeviceStateIdle);
+    if (Music::CanPlayInState(previous_state) && !Music::CanPlayInState(state)) {
         auto music = board.GetMusic();
         if (music) {
             ESP_LOGI(TAG, "Stopping music streaming due to state change: %s -> %s", 
@@ -823,84 +836,12 @@ void Application::SetAecMode(AecMode mode) {
 }
 
 // 新增：接收外部音频数据（如音乐播放）
-void Application::AddAudioData(AudioStreamPacket&& packet) {
-    auto codec = Board::GetInstance().GetAudioCodec();
-    if (device_state_ == kDeviceStateIdle && codec->output_enabled()) {
-        // packet.payload包含的是原始PCM数据（int16_t）
-        if (packet.payload.size() >= 2) {
-            size_t num_samples = packet.payload.size() / sizeof(int16_t);
-            std::vector<int16_t> pcm_data(num_samples);
-            memcpy(pcm_data.data(), packet.payload.data(), packet.payload.size());
-            
-            // 检查采样率是否匹配，如果不匹配则进行简单重采样
-            if (packet.sample_rate != codec->output_sample_rate()) {
-                // ESP_LOGI(TAG, "Resampling music audio from %d to %d Hz", 
-                //         packet.sample_rate, codec->output_sample_rate());
-                
-                // 验证采样率参数
-                if (packet.sample_rate <= 0 || codec->output_sample_rate() <= 0) {
-                    ESP_LOGE(TAG, "Invalid sample rates: %d -> %d", 
-                            packet.sample_rate, codec->output_sample_rate());
-                    return;
-                }
-                
-                std::vector<int16_t> resampled;
-                
-                if (packet.sample_rate > codec->output_sample_rate()) {
-                    ESP_LOGI(TAG, "音乐播放：将采样率从 %d Hz 切换到 %d Hz", 
-                        codec->output_sample_rate(), packet.sample_rate);
-
-                    // 尝试动态切换采样率
-                    if (codec->SetOutputSampleRate(packet.sample_rate)) {
-                        ESP_LOGI(TAG, "成功切换到音乐播放采样率: %d Hz", packet.sample_rate);
-                    } else {
-                        ESP_LOGW(TAG, "无法切换采样率，继续使用当前采样率: %d Hz", codec->output_sample_rate());
-                    }
-                } else {
-                    // 上采样：线性插值
-                    float upsample_ratio = codec->output_sample_rate() / static_cast<float>(packet.sample_rate);
-                    size_t expected_size = static_cast<size_t>(pcm_data.size() * upsample_ratio + 0.5f);
-                    resampled.reserve(expected_size);
-                    
-                    for (size_t i = 0; i < pcm_data.size(); ++i) {
-                        // 添加原始样本
-                        resampled.push_back(pcm_data[i]);
-                        
-                        // 计算需要插值的样本数
-                        int interpolation_count = static_cast<int>(upsample_ratio) - 1;
-                        if (interpolation_count > 0 && i + 1 < pcm_data.size()) {
-                            int16_t current = pcm_data[i];
-                            int16_t next = pcm_data[i + 1];
-                            for (int j = 1; j <= interpolation_count; ++j) {
-                                float t = static_cast<float>(j) / (interpolation_count + 1);
-                                int16_t interpolated = static_cast<int16_t>(current + (next - current) * t);
-                                resampled.push_back(interpolated);
-                            }
-                        } else if (interpolation_count > 0) {
-                            // 最后一个样本，直接重复
-                            for (int j = 1; j <= interpolation_count; ++j) {
-                                resampled.push_back(pcm_data[i]);
-                            }
-                        }
-                    }
-                    
-                    ESP_LOGI(TAG, "Upsampled %d -> %d samples (ratio: %.2f)", 
-                            pcm_data.size(), resampled.size(), upsample_ratio);
-                }
-                
-                pcm_data = std::move(resampled);
-            }
-            
-            // 确保音频输出已启用
-            if (!codec->output_enabled()) {
-                codec->EnableOutput(true);
-            }
-            
-            // 发送PCM数据到音频编解码器
-            codec->OutputData(pcm_data);
-            
-            audio_service_.UpdateOutputTimestamp();
-        }
+// pcm 为单声道数据，采样率已由调用者转换为 codec 当前的输出采样率。
+// 数据交给 AudioService 的音乐队列，由输出任务与语音混音后写入 codec；队列满时在这里等待。
+// pcm 会被换成一块回收的缓冲区，调用者可以继续复用这个 vector
+void Application::AddAudioData(std::vector<int16_t>& pcm) {
+    if (!pcm.empty()) {
+        audio_service_.PushMusicData(pcm);
     }
 }
 
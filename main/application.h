@@ -64,8 +64,8 @@ public:
     void SetAecMode(AecMode mode);
     AecMode GetAecMode() const { return aec_mode_; }
     
-    // 新增：接收外部音频数据（如音乐播放）
-    void AddAudioData(AudioStreamPacket&& packet);
+    // 新增：接收外部音频数据（如音乐播放），单声道且采样率与 codec 输出一致
+    void AddAudioData(std::vector<int16_t>& pcm);
     void PlaySound(const std::string_view& sound);
     AudioService& GetAudioService() { return audio_service_; }
 
@@ -0,0 +1,95 @@
+#ifndef AUDIO_OBJECT_POOL_H
+#define AUDIO_OBJECT_POOL_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+struct AudioObjectPoolStatistics {
+    uint32_t capacity = 0;
+    uint32_t in_use = 0;        // Acquired and not released yet
+    uint32_t high_water = 0;    // Most objects in use at once
+    uint32_t misses = 0;        // Acquire found the pool empty and fell back to the heap
+};
+
+/*
+ * Fixed-capacity pool for objects that carry an audio payload (AudioTask, AudioStreamPacket).
+ *
+ * `preallocated` objects are allocated when the pool is created, the rest of the capacity is filled
+ * by released objects that were allocated on a miss. A released object keeps the capacity of its
+ * payload vector, so after the first few frames every frame reuses memory grown by an earlier one.
+ * The caller sets every field of an acquired object, nothing is reset on release.
+ *
+ * If more objects are in flight than the pool holds, Acquire falls back to the heap and counts a
+ * miss, and Release frees whatever does not fit back in, so the footprint stays bounded.
+ * An object that is dropped instead of released stays counted in in_use.
+ */
+template <typename T>
+class AudioObjectPool {
+public:
+    explicit AudioObjectPool(size_t capacity) : AudioObjectPool(capacity, capacity) {}
+
+    AudioObjectPool(size_t capacity, size_t preallocated) : capacity_(capacity) {
+        free_.reserve(capacity);
+        for (size_t i = 0; i < preallocated && i < capacity; i++) {
+            free_.push_back(std::make_unique<T>());
+        }
+    }
+
+    std::unique_ptr<T> Acquire() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::unique_ptr<T> object;
+        if (!free_.empty()) {
+            object = std::move(free_.back());
+            free_.pop_back();
+        } else {
+            object = std::make_unique<T>();
+            misses_++;
+        }
+        in_use_++;
+        if (in_use_ > high_water_) {
+            high_water_ = in_use_;
+        }
+        return object;
+    }
+
+    void Release(std::unique_ptr<T>&& object) {
+        if (object == nullptr) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (in_use_ > 0) {
+                in_use_--;
+            }
+            if (free_.size() < capacity_) {
+                free_.push_back(std::move(object));
+                return;
+            }
+        }
+        /* Beyond the capacity, freed outside the lock */
+        object.reset();
+    }
+
+    AudioObjectPoolStatistics GetStatistics() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        AudioObjectPoolStatistics statistics;
+        statistics.capacity = capacity_;
+        statistics.in_use = in_use_;
+        statistics.high_water = high_water_;
+        statistics.misses = misses_;
+        return statistics;
+    }
+
+private:
+    std::mutex mutex_;
+    const size_t capacity_;
+    std::vector<std::unique_ptr<T>> free_;
+    uint32_t in_use_ = 0;
+    uint32_t high_water_ = 0;
+    uint32_t misses_ = 0;
+};
+
+#endif // AUDIO_OBJECT_POOL_H
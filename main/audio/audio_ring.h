@@ -0,0 +1,164 @@
+#ifndef AUDIO_RING_H
+#define AUDIO_RING_H
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+/*
+ * Bounded single-producer / single-consumer ring for one edge of the audio pipeline.
+ *
+ * Push and Pop take no lock. head_ and tail_ count up forever and wrap at 2^32, the storage is
+ * rounded up to a power of two so the wrap keeps the slot mapping intact.
+ *
+ * Wakeups use FreeRTOS task notifications instead of a shared condition variable:
+ * - Push notifies the consumer task only when the ring was empty, which is the only time it may sleep
+ * - Pop notifies the producer task only when the ring was full
+ * The notified task must check its rings again before it sleeps, because a notification can also
+ * belong to another ring it waits on. Indexes use sequentially consistent ordering, so either the
+ * other side sees the new index or the notification is sent; a wakeup is never lost.
+ *
+ * Discard may be called from any task. It marks everything pushed so far as stale, the consumer
+ * hands stale entries to the recycle function on its next Pop or Recycle, and entries pushed after
+ * the call are kept.
+ *
+ * The storage is sized once for the largest bound. SetLimit lowers the bound at runtime, e.g. to keep
+ * a queue at the same number of milliseconds when the frame duration changes.
+ */
+template <typename T>
+class AudioRing {
+public:
+    explicit AudioRing(size_t capacity) : capacity_(capacity), limit_(capacity) {
+        size_t slots = 1;
+        while (slots < capacity) {
+            slots <<= 1;
+        }
+        mask_ = slots - 1;
+        slots_.reset(new T[slots]());
+    }
+
+    AudioRing(const AudioRing&) = delete;
+    AudioRing& operator=(const AudioRing&) = delete;
+
+    /* The tasks to notify, nullptr if that side never sleeps on this ring */
+    void SetConsumer(TaskHandle_t task) { consumer_.store(task); }
+    void SetProducer(TaskHandle_t task) { producer_.store(task); }
+    void WakeConsumer() { Notify(consumer_.load()); }
+    void WakeProducer() { Notify(producer_.load()); }
+
+    /* Producer only. Returns false if the ring is full, `item` is left untouched then */
+    bool Push(T&& item) {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load() >= limit_.load()) {
+            return false;
+        }
+        slots_[head & mask_] = std::move(item);
+        head_.store(head + 1);
+        if (tail_.load() == head) {
+            WakeConsumer();
+        }
+        return true;
+    }
+
+    /* Consumer only. Returns false if the ring has no live entry */
+    template <typename Recycler>
+    bool Pop(T& item, Recycler&& recycle) {
+        return Take(&item, recycle);
+    }
+
+    bool Pop(T& item) {
+        auto drop = [](T&&) {};
+        return Take(&item, drop);
+    }
+
+    /* Consumer only. Recycles the stale entries without taking a live one */
+    template <typename Recycler>
+    void Recycle(Recycler&& recycle) {
+        Take(nullptr, recycle);
+    }
+
+    /* Any task. The caller should wake the consumer, so the stale entries are recycled promptly */
+    void Discard() {
+        uint32_t head = head_.load();
+        uint32_t discard = discard_.load();
+        while ((int32_t)(head - discard) > 0 && !discard_.compare_exchange_weak(discard, head)) {
+        }
+    }
+
+    /* Live entries. Exact for the producer and the consumer, a snapshot for any other task */
+    size_t Size() const {
+        uint32_t tail = tail_.load();
+        uint32_t head = head_.load();
+        uint32_t discard = discard_.load();
+        uint32_t start = (int32_t)(discard - tail) > 0 ? discard : tail;
+        return (int32_t)(head - start) > 0 ? head - start : 0;
+    }
+
+    bool Empty() const { return Size() == 0; }
+
+    /* Stale entries still take their slots until the consumer recycles them */
+    bool Full() const { return head_.load() - tail_.load() >= limit_.load(); }
+
+    size_t Capacity() const { return capacity_; }
+
+    /* Any task. Entries above a lowered limit stay queued, a raised limit wakes the producer */
+    void SetLimit(size_t limit) {
+        uint32_t new_limit = limit < capacity_ ? limit : capacity_;
+        if (new_limit > limit_.exchange(new_limit)) {
+            WakeProducer();
+        }
+    }
+
+    size_t Limit() const { return limit_.load(); }
+
+private:
+    template <typename Recycler>
+    bool Take(T* item, Recycler& recycle) {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        uint32_t head = head_.load();
+        uint32_t discard = discard_.load();
+        uint32_t first = tail;
+        while (tail != head && (int32_t)(discard - tail) > 0) {
+            recycle(std::move(slots_[tail & mask_]));
+            tail++;
+        }
+        bool taken = item != nullptr && tail != head;
+        if (taken) {
+            *item = std::move(slots_[tail & mask_]);
+            tail++;
+        }
+        if ((int32_t)(tail - discard) > (1 << 30)) {
+            /* Keep the mark close to tail_, so the signed distance above cannot wrap */
+            discard_.compare_exchange_strong(discard, tail);
+        }
+        if (tail != first) {
+            tail_.store(tail);
+            if (head_.load() - first >= limit_.load()) {
+                WakeProducer();
+            }
+        }
+        return taken;
+    }
+
+    static void Notify(TaskHandle_t task) {
+        if (task != nullptr) {
+            xTaskNotifyGive(task);
+        }
+    }
+
+    const uint32_t capacity_;
+    std::atomic<uint32_t> limit_;
+    uint32_t mask_;
+    std::unique_ptr<T[]> slots_;
+    std::atomic<uint32_t> head_ = 0;
+    std::atomic<uint32_t> tail_ = 0;
+    std::atomic<uint32_t> discard_ = 0;
+    std::atomic<TaskHandle_t> consumer_ = nullptr;
+    std::atomic<TaskHandle_t> producer_ = nullptr;
+};
+
+#endif // AUDIO_RING_H
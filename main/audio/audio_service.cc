@@ -1,5 +1,11 @@
 #include "audio_service.h"
 #include <esp_log.h>
+#include <algorithm>
+
+#if CONFIG_HEAP_USE_HOOKS
+#include <esp_attr.h>
+#include <esp_heap_caps.h>
+#endif
 
 #if CONFIG_USE_AUDIO_PROCESSOR
 #include "processors/afe_audio_processor.h"
@@ -17,6 +23,28 @@
 
 #define TAG "AudioService"
 
+#if CONFIG_HEAP_USE_HOOKS
+/*
+ * Counts heap calls made by the audio input task. The hooks run in the context of the
+ * allocating task, so the counter has a single writer and needs no atomics.
+ */
+#define AUDIO_INPUT_HEAP_REPORT_FRAMES 256
+
+static TaskHandle_t heap_watched_task = nullptr;
+static uint32_t heap_watched_calls = 0;
+
+extern "C" void IRAM_ATTR esp_heap_trace_alloc_hook(void* ptr, size_t size, uint32_t caps) {
+    if (heap_watched_task != nullptr && xTaskGetCurrentTaskHandle() == heap_watched_task) {
+        heap_watched_calls++;
+    }
+}
+
+extern "C" void IRAM_ATTR esp_heap_trace_free_hook(void* ptr) {
+    if (heap_watched_task != nullptr && xTaskGetCurrentTaskHandle() == heap_watched_task) {
+        heap_watched_calls++;
+    }
+}
+#endif
 
 AudioService::AudioService() {
     event_group_ = xEventGroupCreate();
@@ -34,9 +62,9 @@ void AudioService::Initialize(AudioCodec* codec) {
     codec_->Start();
 
     /* Setup the audio codec */
+    SetFrameDuration(OPUS_FRAME_DURATION_MS);
     opus_decoder_ = std::make_unique<OpusDecoderWrapper>(codec->output_sample_rate(), 1, OPUS_FRAME_DURATION_MS);
-    opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
-    opus_encoder_->SetComplexity(0);
+    CreateOpusEncoder(OPUS_FRAME_DURATION_MS);
 
     if (codec->input_sample_rate() != 16000) {
         input_resampler_.Configure(codec->input_sample_rate(), 16000);
@@ -60,7 +88,7 @@ void AudioService::Initialize(AudioCodec* codec) {
 #endif
 
     audio_processor_->OnOutput([this](std::vector<int16_t>&& data) {
-        PushTaskToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, std::move(data));
+        PushTaskToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, data);
     });
 
     audio_processor_->OnVadStateChange([this](bool speaking) {
@@ -127,12 +155,18 @@ void AudioService::Start() {
     }, "audio_output", 2048, this, 3, &audio_output_task_handle_);
 #endif
 
-    /* Start the opus codec task */
-    xTaskCreate([](void* arg) {
+    /* Start the opus encoder and decoder tasks */
+    xTaskCreatePinnedToCore([](void* arg) {
         AudioService* audio_service = (AudioService*)arg;
-        audio_service->OpusCodecTask();
+        audio_service->OpusEncodeTask();
         vTaskDelete(NULL);
-    }, "opus_codec", 2048 * 13, this, 2, &opus_codec_task_handle_);
+    }, "opus_encode", OPUS_ENCODE_TASK_STACK_SIZE, this, CONFIG_OPUS_ENCODE_TASK_PRIORITY, &opus_encode_task_handle_, OPUS_ENCODE_TASK_CORE);
+
+    xTaskCreatePinnedToCore([](void* arg) {
+        AudioService* audio_service = (AudioService*)arg;
+        audio_service->OpusDecodeTask();
+        vTaskDelete(NULL);
+    }, "opus_decode", OPUS_DECODE_TASK_STACK_SIZE, this, CONFIG_OPUS_DECODE_TASK_PRIORITY, &opus_decode_task_handle_, OPUS_DECODE_TASK_CORE);
 }
 
 void AudioService::Stop() {
@@ -142,12 +176,19 @@ void AudioService::Stop() {
         AS_EVENT_WAKE_WORD_RUNNING |
         AS_EVENT_AUDIO_PROCESSOR_RUNNING);
 
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    audio_encode_queue_.clear();
-    audio_decode_queue_.clear();
-    audio_playback_queue_.clear();
-    audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
+    /* The tasks exit without draining their queues, what is left is freed with the rings */
+    audio_encode_queue_.Discard();
+    audio_decode_queue_.Discard();
+    audio_playback_queue_.Discard();
+    music_playback_queue_.Discard();
+
+    /* Wake every task that may sleep on a queue, they see service_stopped_ and return */
+    audio_encode_queue_.WakeConsumer();
+    audio_decode_queue_.WakeConsumer();
+    audio_playback_queue_.WakeConsumer();
+    audio_encode_queue_.WakeProducer();
+    audio_decode_queue_.WakeProducer();
+    music_playback_queue_.WakeProducer();
 }
 
 bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples) {
@@ -157,30 +198,36 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
     }
 
     if (codec_->input_sample_rate() != sample_rate) {
-        data.resize(samples * codec_->input_sample_rate() / sample_rate);
-        if (!codec_->InputData(data)) {
+        input_buffer_.resize(samples * codec_->input_sample_rate() / sample_rate);
+        if (!codec_->InputData(input_buffer_)) {
             return false;
         }
         if (codec_->input_channels() == 2) {
-            auto mic_channel = std::vector<int16_t>(data.size() / 2);
-            auto reference_channel = std::vector<int16_t>(data.size() / 2);
-            for (size_t i = 0, j = 0; i < mic_channel.size(); ++i, j += 2) {
-                mic_channel[i] = data[j];
-                reference_channel[i] = data[j + 1];
+            size_t frames = input_buffer_.size() / 2;
+            input_planar_buffer_.resize(frames * 2);
+            int16_t* mic = input_planar_buffer_.data();
+            int16_t* reference = mic + frames;
+            for (size_t i = 0, j = 0; i < frames; ++i, j += 2) {
+                mic[i] = input_buffer_[j];
+                reference[i] = input_buffer_[j + 1];
             }
-            auto resampled_mic = std::vector<int16_t>(input_resampler_.GetOutputSamples(mic_channel.size()));
-            auto resampled_reference = std::vector<int16_t>(reference_resampler_.GetOutputSamples(reference_channel.size()));
-            input_resampler_.Process(mic_channel.data(), mic_channel.size(), resampled_mic.data());
-            reference_resampler_.Process(reference_channel.data(), reference_channel.size(), resampled_reference.data());
-            data.resize(resampled_mic.size() + resampled_reference.size());
-            for (size_t i = 0, j = 0; i < resampled_mic.size(); ++i, j += 2) {
+
+            /* The raw samples are no longer needed, the resampled channels go back into input_buffer_ */
+            size_t resampled_frames = input_resampler_.GetOutputSamples(frames);
+            input_buffer_.resize(resampled_frames * 2);
+            int16_t* resampled_mic = input_buffer_.data();
+            int16_t* resampled_reference = resampled_mic + resampled_frames;
+            input_resampler_.Process(mic, frames, resampled_mic);
+            reference_resampler_.Process(reference, frames, resampled_reference);
+
+            data.resize(resampled_frames * 2);
+            for (size_t i = 0, j = 0; i < resampled_frames; ++i, j += 2) {
                 data[j] = resampled_mic[i];
                 data[j + 1] = resampled_reference[i];
             }
         } else {
-            auto resampled = std::vector<int16_t>(input_resampler_.GetOutputSamples(data.size()));
-            input_resampler_.Process(data.data(), data.size(), resampled.data());
-            data = std::move(resampled);
+            data.resize(input_resampler_.GetOutputSamples(input_buffer_.size()));
+            input_resampler_.Process(input_buffer_.data(), input_buffer_.size(), data.data());
         }
     } else {
         data.resize(samples);
@@ -205,7 +252,23 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
 }
 
 void AudioService::AudioInputTask() {
+    /* One frame for the life of the task, encode frames handed off are swapped for recycled ones */
+    std::vector<int16_t> data;
+#if CONFIG_HEAP_USE_HOOKS
+    heap_watched_task = xTaskGetCurrentTaskHandle();
+    uint32_t heap_calls_reported = 0;
+    uint32_t frames = 0;
+#endif
+
     while (true) {
+#if CONFIG_HEAP_USE_HOOKS
+        /* Buffers grow during the first frames, after that the count should stay flat */
+        if (++frames % AUDIO_INPUT_HEAP_REPORT_FRAMES == 0 && heap_watched_calls != heap_calls_reported) {
+            ESP_LOGW(TAG, "Audio input task made %lu heap calls", heap_watched_calls - heap_calls_reported);
+            heap_calls_reported = heap_watched_calls;
+        }
+#endif
+
         EventBits_t bits = xEventGroupWaitBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING |
             AS_EVENT_WAKE_WORD_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING,
             pdFALSE, pdFALSE, portMAX_DELAY);
@@ -221,30 +284,28 @@ void AudioService::AudioInputTask() {
 
         /* Used for audio testing in NetworkConfiguring mode by clicking the BOOT button */
         if (bits & AS_EVENT_AUDIO_TESTING_RUNNING) {
-            if (audio_testing_queue_.size() >= AUDIO_TESTING_MAX_DURATION_MS / OPUS_FRAME_DURATION_MS) {
+            int frame_duration = frame_duration_ms_;
+            if (audio_testing_queue_.Size() >= AUDIO_TESTING_MAX_DURATION_MS / frame_duration) {
                 ESP_LOGW(TAG, "Audio testing queue is full, stopping audio testing");
                 EnableAudioTesting(false);
                 continue;
             }
-            std::vector<int16_t> data;
-            int samples = OPUS_FRAME_DURATION_MS * 16000 / 1000;
+            int samples = frame_duration * 16000 / 1000;
             if (ReadAudioData(data, 16000, samples)) {
                 // If input channels is 2, we need to fetch the left channel data
                 if (codec_->input_channels() == 2) {
-                    auto mono_data = std::vector<int16_t>(data.size() / 2);
-                    for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-                        mono_data[i] = data[j];
+                    for (size_t i = 0, j = 0; j < data.size(); ++i, j += 2) {
+                        data[i] = data[j];
                     }
-                    data = std::move(mono_data);
+                    data.resize(data.size() / 2);
                 }
-                PushTaskToEncodeQueue(kAudioTaskTypeEncodeToTestingQueue, std::move(data));
+                PushTaskToEncodeQueue(kAudioTaskTypeEncodeToTestingQueue, data);
                 continue;
             }
         }
 
         /* Feed the wake word */
         if (bits & AS_EVENT_WAKE_WORD_RUNNING) {
-            std::vector<int16_t> data;
             int samples = wake_word_->GetFeedSize();
             if (samples > 0) {
                 if (ReadAudioData(data, 16000, samples)) {
@@ -256,7 +317,6 @@ void AudioService::AudioInputTask() {
 
         /* Feed the audio processor */
         if (bits & AS_EVENT_AUDIO_PROCESSOR_RUNNING) {
-            std::vector<int16_t> data;
             int samples = audio_processor_->GetFeedSize();
             if (samples > 0) {
                 if (ReadAudioData(data, 16000, samples)) {
@@ -270,27 +330,77 @@ void AudioService::AudioInputTask() {
         break;
     }
 
+#if CONFIG_HEAP_USE_HOOKS
+    heap_watched_task = nullptr;
+#endif
     ESP_LOGW(TAG, "Audio input task stopped");
 }
 
 void AudioService::AudioOutputTask() {
+    auto recycle_task = [this](std::unique_ptr<AudioTask>&& task) {
+        task_pool_.Release(std::move(task));
+    };
+    /* Set before the first look at the queues, so no push can miss this task */
+    audio_playback_queue_.SetConsumer(xTaskGetCurrentTaskHandle());
+    music_playback_queue_.SetConsumer(xTaskGetCurrentTaskHandle());
+
+    bool voice_playing = false;
     while (true) {
-        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() { return !audio_playback_queue_.empty() || service_stopped_; });
         if (service_stopped_) {
             break;
         }
+        if (music_flush_.exchange(false)) {
+            ReleaseMusicFrame(false);
+            /* Free the slots now, the music decoder may be waiting for room while music is paused */
+            music_playback_queue_.Recycle([this](std::unique_ptr<AudioTask>&& task) {
+                music_task_pool_.Release(std::move(task));
+            });
+        }
 
-        auto task = std::move(audio_playback_queue_.front());
-        audio_playback_queue_.pop_front();
-        audio_queue_cv_.notify_all();
-        lock.unlock();
+        /* Voice frames set the output size and music is mixed in underneath, otherwise music plays alone */
+        std::unique_ptr<AudioTask> task;
+        audio_playback_queue_.Pop(task, recycle_task);
+        if (task != nullptr) {
+            voice_playing = true;
+        } else if (voice_playing) {
+            /* The stream ended or the next frame is late, either way the jitter buffer refills */
+            voice_playing = false;
+            playback_ran_dry_ = true;
+        }
+        bool play_music = !music_paused_;
+        if (play_music && music_frame_ == nullptr) {
+            PopMusicFrame();
+        }
+        if (task == nullptr && (!play_music || music_frame_ == nullptr)) {
+            /* Woken by a frame pushed into an empty queue, PauseMusic, ClearMusicQueue, ResetDecoder or Stop */
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        int32_t music_target_gain = (task != nullptr || music_ducking_) ? MUSIC_DUCKING_GAIN : MUSIC_UNITY_GAIN;
 
         if (!codec_->output_enabled()) {
             codec_->EnableOutput(true);
             esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
         }
-        codec_->OutputData(task->pcm);
+
+        if (task != nullptr) {
+            if (play_music) {
+                MixMusic(task->pcm.data(), task->pcm.size(), music_target_gain, true);
+            }
+            codec_->OutputData(task->pcm);
+        } else {
+            /* The frame may be partly consumed by earlier mixing, play what is left of it */
+            auto& pcm = music_frame_->pcm;
+            if (music_frame_offset_ > 0) {
+                pcm.erase(pcm.begin(), pcm.begin() + music_frame_offset_);
+                music_frame_offset_ = 0;
+            }
+            if (music_gain_ != MUSIC_UNITY_GAIN || music_target_gain != MUSIC_UNITY_GAIN) {
+                MixMusic(pcm.data(), pcm.size(), music_target_gain, false);
+            }
+            codec_->OutputData(pcm);
+            ReleaseMusicFrame(true);
+        }
 
         /* Update the last output time */
         last_output_time_ = std::chrono::steady_clock::now();
@@ -298,161 +408,496 @@ void AudioService::AudioOutputTask() {
 
 #if CONFIG_USE_SERVER_AEC
         /* Record the timestamp for server AEC */
-        if (task->timestamp > 0) {
-            lock.lock();
-            timestamp_queue_.push_back(task->timestamp);
+        if (task != nullptr && task->timestamp > 0) {
+            timestamp_queue_.Push((uint32_t)task->timestamp);
         }
 #endif
+        task_pool_.Release(std::move(task));
     }
 
     ESP_LOGW(TAG, "Audio output task stopped");
 }
 
-void AudioService::OpusCodecTask() {
+/*
+ * Applies the music gain to `samples` samples of music. With `mix` set, the music is taken from the
+ * music frames (as many as needed) and added onto `output`, otherwise `output` is the current music
+ * frame and is scaled in place. The gain ramps towards `target_gain` to avoid clicks.
+ * Called from the output task only.
+ */
+void AudioService::MixMusic(int16_t* output, size_t samples, int32_t target_gain, bool mix) {
+    int32_t gain = music_gain_;
+    int32_t step = (MUSIC_UNITY_GAIN - MUSIC_DUCKING_GAIN) * 1000 / (codec_->output_sample_rate() * MUSIC_DUCKING_RAMP_MS);
+    if (step < 1) {
+        step = 1;
+    }
+
+    size_t pos = 0;
+    while (pos < samples) {
+        const int16_t* music;
+        size_t count;
+        if (mix) {
+            if (music_frame_ == nullptr && (music_flush_ || music_paused_ || !PopMusicFrame())) {
+                break;
+            }
+            music = music_frame_->pcm.data() + music_frame_offset_;
+            count = std::min(samples - pos, music_frame_->pcm.size() - music_frame_offset_);
+        } else {
+            music = output;
+            count = samples;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            if (gain != target_gain) {
+                gain = gain < target_gain ? std::min(gain + step, target_gain) : std::max(gain - step, target_gain);
+            }
+            int32_t sample = (music[i] * gain) >> 15;
+            if (mix) {
+                sample += output[pos + i];
+                sample = std::max<int32_t>(INT16_MIN, std::min<int32_t>(INT16_MAX, sample));
+            }
+            output[pos + i] = (int16_t)sample;
+        }
+
+        if (mix) {
+            music_frame_offset_ += count;
+            if (music_frame_offset_ >= music_frame_->pcm.size()) {
+                ReleaseMusicFrame(true);
+            }
+        }
+        pos += count;
+    }
+    music_gain_ = gain;
+}
+
+/* Takes the next music frame into music_frame_, called from the output task only */
+bool AudioService::PopMusicFrame() {
+    if (!music_playback_queue_.Pop(music_frame_, [this](std::unique_ptr<AudioTask>&& task) {
+            music_task_pool_.Release(std::move(task));
+        })) {
+        return false;
+    }
+    music_frame_in_flight_ = true;
+    return true;
+}
+
+/* Recycles the current music frame, called from the output task only */
+void AudioService::ReleaseMusicFrame(bool played) {
+    if (music_frame_ == nullptr) {
+        return;
+    }
+    if (played) {
+        music_frames_played_++;
+        /* Count once per gap, re-armed when the queue fills up again */
+        if (music_playback_queue_.Empty() && music_underrun_armed_.exchange(false)) {
+            music_underruns_++;
+        }
+    }
+    music_task_pool_.Release(std::move(music_frame_));
+    music_frame_.reset();
+    music_frame_offset_ = 0;
+    music_frame_in_flight_ = false;
+}
+
+void AudioService::OpusEncodeTask() {
+    auto recycle_task = [this](std::unique_ptr<AudioTask>&& task) {
+        task_pool_.Release(std::move(task));
+    };
+    /* Set before the first look at the queues, so no push or pop can miss this task */
+    audio_encode_queue_.SetConsumer(xTaskGetCurrentTaskHandle());
+    audio_send_queue_.SetProducer(xTaskGetCurrentTaskHandle());
+
     while (true) {
-        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() {
-            return service_stopped_ ||
-                (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) ||
-                (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE);
-        });
         if (service_stopped_) {
             break;
         }
 
-        /* Decode the audio from decode queue */
-        if (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE) {
-            auto packet = std::move(audio_decode_queue_.front());
-            audio_decode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock();
+        /* Encode the audio to send queue */
+        std::unique_ptr<AudioTask> task;
+        if (audio_send_queue_.Full() || !audio_encode_queue_.Pop(task, recycle_task)) {
+            /* Woken by a push into an empty encode queue, a pop from a full send queue or Stop */
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
 
-            auto task = std::make_unique<AudioTask>();
-            task->type = kAudioTaskTypeDecodeToPlaybackQueue;
-            task->timestamp = packet->timestamp;
+        /* Follow the frame size of the PCM, frames queued before SetFrameDuration keep the old one */
+        int frame_duration = task->pcm.size() * 1000 / 16000;
+        if (frame_duration != opus_encoder_->duration_ms()) {
+            ESP_LOGI(TAG, "Opus encoder frame duration: %d ms", frame_duration);
+            CreateOpusEncoder(frame_duration);
+        }
 
-            SetDecodeSampleRate(packet->sample_rate, packet->frame_duration);
-            if (opus_decoder_->Decode(std::move(packet->payload), task->pcm)) {
-                // Resample if the sample rate is different
-                if (opus_decoder_->sample_rate() != codec_->output_sample_rate()) {
-                    int target_size = output_resampler_.GetOutputSamples(task->pcm.size());
-                    std::vector<int16_t> resampled(target_size);
-                    output_resampler_.Process(task->pcm.data(), task->pcm.size(), resampled.data());
-                    task->pcm = std::move(resampled);
-                }
+        int64_t start_time = esp_timer_get_time();
+        auto packet = packet_pool_.Acquire();
+        packet->frame_duration = frame_duration;
+        packet->sample_rate = 16000;
+        packet->timestamp = task->timestamp;
+        packet->lost_before = 0;
+        bool encoded = opus_encoder_->Encode(std::move(task->pcm), packet->payload);
+        AudioTaskType type = task->type;
+        int64_t queued_time = task->queued_time;
+        task_pool_.Release(std::move(task));
+
+        if (!encoded) {
+            ESP_LOGE(TAG, "Failed to encode audio");
+            packet_pool_.Release(std::move(packet));
+            continue;
+        }
 
-                lock.lock();
-                audio_playback_queue_.push_back(std::move(task));
-                audio_queue_cv_.notify_all();
-            } else {
-                ESP_LOGE(TAG, "Failed to decode audio");
-                lock.lock();
+        int64_t end_time = esp_timer_get_time();
+        encode_timing_.Add(end_time - start_time);
+        if (type == kAudioTaskTypeEncodeToSendQueue) {
+            uplink_timing_.Add(end_time - queued_time);
+            audio_send_queue_.Push(std::move(packet));
+            if (callbacks_.on_send_queue_available) {
+                callbacks_.on_send_queue_available();
             }
-            debug_statistics_.decode_count++;
+            AdaptUplinkEncoder(frame_duration, end_time - start_time);
+        } else if (type == kAudioTaskTypeEncodeToTestingQueue) {
+            audio_testing_queue_.Push(std::move(packet));
         }
-        
-        /* Encode the audio to send queue */
-        if (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) {
-            auto task = std::move(audio_encode_queue_.front());
-            audio_encode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock();
-
-            auto packet = std::make_unique<AudioStreamPacket>();
-            packet->frame_duration = OPUS_FRAME_DURATION_MS;
-            packet->sample_rate = 16000;
-            packet->timestamp = task->timestamp;
-            if (!opus_encoder_->Encode(std::move(task->pcm), packet->payload)) {
-                ESP_LOGE(TAG, "Failed to encode audio");
-                continue;
-            }
+        /* Still set if the packet was not queued (testing queue full) */
+        packet_pool_.Release(std::move(packet));
+        debug_statistics_.encode_count++;
+    }
 
-            if (task->type == kAudioTaskTypeEncodeToSendQueue) {
-                {
-                    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-                    audio_send_queue_.push_back(std::move(packet));
-                }
-                if (callbacks_.on_send_queue_available) {
-                    callbacks_.on_send_queue_available();
-                }
-            } else if (task->type == kAudioTaskTypeEncodeToTestingQueue) {
-                std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-                audio_testing_queue_.push_back(std::move(packet));
+    ESP_LOGW(TAG, "Opus encode task stopped");
+}
+
+void AudioService::CreateOpusEncoder(int frame_duration) {
+    opus_encoder_.reset();
+    opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, frame_duration);
+    opus_encoder_->SetComplexity(encoder_complexity_);
+    opus_encoder_->SetDtx(encoder_dtx_);
+}
+
+/*
+ * Runs in the encode task after each frame for the send queue.
+ * - A congested link (a send failure, or a send queue deeper than UPLINK_CONGESTED_QUEUE_MS) turns
+ *   DTX on at once, silence then goes out as tiny packets.
+ * - Encoding above UPLINK_CPU_HIGH_PERCENT of the frame duration lowers the complexity at once.
+ * - After UPLINK_CLEAR_WINDOWS clean windows in a row the controller takes one step back up: DTX off
+ *   first, then one complexity level while encoding stays below UPLINK_CPU_LOW_PERCENT.
+ * The opus wrapper does not expose the bitrate, the encoder keeps choosing it from the frame size.
+ */
+void AudioService::AdaptUplinkEncoder(int frame_duration, int64_t encode_us) {
+    uplink_window_ms_ += frame_duration;
+    uplink_window_encode_us_ += (uint32_t)encode_us;
+    uint32_t queue_ms = audio_send_queue_.Size() * frame_duration;
+    if (queue_ms > uplink_window_max_queue_ms_) {
+        uplink_window_max_queue_ms_ = queue_ms;
+    }
+    if (uplink_window_ms_ < UPLINK_CONTROL_WINDOW_MS) {
+        return;
+    }
+
+    uint32_t send_failures = uplink_send_failures_;
+    bool congested = send_failures != uplink_window_send_failures_ ||
+        uplink_window_max_queue_ms_ >= UPLINK_CONGESTED_QUEUE_MS;
+    /* us per ms is 1/1000, so divide by ms * 10 for percent */
+    uint32_t cpu_percent = uplink_window_encode_us_ / (uplink_window_ms_ * 10);
+    uplink_cpu_percent_ = cpu_percent;
+    uplink_window_ms_ = 0;
+    uplink_window_encode_us_ = 0;
+    uplink_window_max_queue_ms_ = 0;
+    uplink_window_send_failures_ = send_failures;
+
+    int complexity = encoder_complexity_;
+    bool dtx = encoder_dtx_;
+    if (congested) {
+        uplink_congested_windows_++;
+        uplink_clear_windows_ = 0;
+        dtx = true;
+    } else if (++uplink_clear_windows_ >= UPLINK_CLEAR_WINDOWS) {
+        if (dtx) {
+            dtx = false;
+            uplink_clear_windows_ = 0;
+        } else if (cpu_percent < UPLINK_CPU_LOW_PERCENT && complexity < UPLINK_MAX_COMPLEXITY) {
+            complexity++;
+            uplink_clear_windows_ = 0;
+        }
+    }
+    if (cpu_percent >= UPLINK_CPU_HIGH_PERCENT && encoder_complexity_ > 0) {
+        complexity = encoder_complexity_ - 1;
+        uplink_clear_windows_ = 0;
+    }
+
+    if (complexity != encoder_complexity_) {
+        ESP_LOGI(TAG, "Uplink encoder complexity %d -> %d, encode %lu%% of the frame time",
+            encoder_complexity_.load(), complexity, cpu_percent);
+        encoder_complexity_ = complexity;
+        encoder_complexity_changes_++;
+        opus_encoder_->SetComplexity(complexity);
+    }
+    if (dtx != encoder_dtx_) {
+        ESP_LOGI(TAG, "Uplink encoder DTX %s, %s", dtx ? "on" : "off", congested ? "link congested" : "link clear");
+        encoder_dtx_ = dtx;
+        encoder_dtx_changes_++;
+        opus_encoder_->SetDtx(dtx);
+    }
+}
+
+void AudioService::OpusDecodeTask() {
+    auto recycle_packet = [this](std::unique_ptr<AudioStreamPacket>&& packet) {
+        packet_pool_.Release(std::move(packet));
+    };
+    /* Set before the first look at the queues, so no push or pop can miss this task */
+    audio_decode_queue_.SetConsumer(xTaskGetCurrentTaskHandle());
+    audio_playback_queue_.SetProducer(xTaskGetCurrentTaskHandle());
+
+    /* Kept across iterations while the frames lost before it are concealed, one per playback slot */
+    std::unique_ptr<AudioStreamPacket> packet;
+    while (true) {
+        if (service_stopped_) {
+            break;
+        }
+        if (decoder_reset_.exchange(false)) {
+            opus_decoder_->ResetState();
+            packet_pool_.Release(std::move(packet));
+            packet.reset();
+            playout_buffering_ = true;
+            playout_buffering_since_ = 0;
+            playback_ran_dry_ = false;
+        }
+        if (audio_testing_clear_.exchange(false)) {
+            audio_testing_playback_ = false;
+            audio_testing_queue_.Recycle(recycle_packet);
+        }
+
+        /* Decode the audio from decode queue, the recorded audio first when audio testing has finished */
+        TickType_t wait_ticks = portMAX_DELAY;
+        if (packet == nullptr && !audio_playback_queue_.Full()) {
+            if (audio_testing_playback_ && !audio_testing_queue_.Pop(packet, recycle_packet)) {
+                audio_testing_playback_ = false;
             }
-            debug_statistics_.encode_count++;
-            lock.lock();
+            if (packet == nullptr && ReadyToPlayout(wait_ticks) && audio_decode_queue_.Pop(packet, recycle_packet) &&
+                packet->lost_before > 0) {
+                downlink_lost_packets_ += packet->lost_before;
+                /* Concealment fades out after a few frames, a longer gap is skipped */
+                uint32_t max_frames = MAX_CONCEALMENT_DURATION_MS / std::max(packet->frame_duration, 1);
+                packet->lost_before = std::min(packet->lost_before, max_frames);
+            }
+        }
+        if (packet == nullptr || audio_playback_queue_.Full()) {
+            /*
+             * Woken by a push into an empty decode queue, a pop from a full playback queue, a reset or Stop,
+             * or after a timeout when the jitter buffer waits for its target delay
+             */
+            ulTaskNotifyTake(pdTRUE, wait_ticks);
+            continue;
+        }
+
+        int64_t start_time = esp_timer_get_time();
+        auto task = task_pool_.Acquire();
+        task->type = kAudioTaskTypeDecodeToPlaybackQueue;
+
+        SetDecodeSampleRate(packet->sample_rate, packet->frame_duration);
+        // Resample if the sample rate is different, the decoder then writes to a scratch buffer
+        bool resample = opus_decoder_->sample_rate() != codec_->output_sample_rate();
+        auto& decoded = resample ? decode_buffer_ : task->pcm;
+        bool ok;
+        if (packet->lost_before > 0) {
+            /* An empty payload makes Opus run its packet loss concealment for one frame */
+            std::vector<uint8_t> lost;
+            packet->lost_before--;
+            task->timestamp = 0;
+            ok = opus_decoder_->Decode(std::move(lost), decoded);
+            downlink_concealed_frames_++;
+        } else {
+            task->timestamp = packet->timestamp;
+            ok = opus_decoder_->Decode(std::move(packet->payload), decoded);
+            packet_pool_.Release(std::move(packet));
+            packet.reset();
+        }
+        if (ok && resample) {
+            task->pcm.resize(output_resampler_.GetOutputSamples(decoded.size()));
+            output_resampler_.Process(decoded.data(), decoded.size(), task->pcm.data());
+        }
+
+        if (ok) {
+            decode_timing_.Add(esp_timer_get_time() - start_time);
+            audio_playback_queue_.Push(std::move(task));
+        } else {
+            ESP_LOGE(TAG, "Failed to decode audio");
+        }
+        /* Still set if the task was not queued */
+        task_pool_.Release(std::move(task));
+        debug_statistics_.decode_count++;
+    }
+
+    packet_pool_.Release(std::move(packet));
+    ESP_LOGW(TAG, "Opus decode task stopped");
+}
+
+/*
+ * Network task, under decode_push_mutex_. The transit time of a packet is its arrival time minus the
+ * media time of the stream so far. Its delay is the distance to the smallest transit time of the
+ * stream, so a server that sends faster than real time measures no delay at all.
+ */
+void AudioService::TrackArrival(const AudioStreamPacket& packet) {
+    int64_t now = esp_timer_get_time();
+    int64_t frame_us = packet.frame_duration * 1000LL;
+    if (jitter_last_arrival_us_ == 0 || now - jitter_last_arrival_us_ > JITTER_STREAM_GAP_MS * 1000LL) {
+        jitter_media_us_ = 0;
+        jitter_base_transit_us_ = now;
+    } else {
+        jitter_media_us_ += frame_us * (packet.lost_before + 1);
+    }
+    jitter_last_arrival_us_ = now;
+
+    int64_t transit_us = now - jitter_media_us_;
+    if (transit_us < jitter_base_transit_us_) {
+        jitter_base_transit_us_ = transit_us;
+    }
+    int64_t delay_us = transit_us - jitter_base_transit_us_;
+    if (delay_us > jitter_target_ms_ * 1000LL) {
+        jitter_late_frames_++;
+    }
+
+    jitter_peak_us_ -= jitter_peak_us_ * frame_us / (JITTER_PEAK_DECAY_MS * 1000LL);
+    if (delay_us > jitter_peak_us_) {
+        jitter_peak_us_ = delay_us;
+    }
+    int64_t target_ms = jitter_peak_us_ / 1000 + JITTER_DELAY_MARGIN_MS;
+    jitter_target_ms_ = (uint32_t)std::min<int64_t>(std::max<int64_t>(target_ms, JITTER_MIN_DELAY_MS), JITTER_MAX_DELAY_MS);
+}
+
+/*
+ * Decode task. At the start of a stream, and after the output task ran out of voice frames, holds the
+ * decode queue back until the target delay is queued behind the first frame, or has passed since it
+ * arrived. Once playing, packets go through as they arrive and the delay built up absorbs the jitter.
+ */
+bool AudioService::ReadyToPlayout(TickType_t& wait_ticks) {
+    size_t depth = audio_decode_queue_.Size();
+    if (!playout_buffering_) {
+        if (!playback_ran_dry_.exchange(false)) {
+            return depth > 0;
         }
+        playout_buffering_ = true;
+        playout_buffering_since_ = 0;
+    }
+    if (depth == 0) {
+        return false;
     }
 
-    ESP_LOGW(TAG, "Opus codec task stopped");
+    int64_t now = esp_timer_get_time();
+    if (playout_buffering_since_ == 0) {
+        playout_buffering_since_ = now;
+    }
+    int64_t target_us = jitter_target_ms_ * 1000LL;
+    int64_t waited_us = now - playout_buffering_since_;
+    if ((int64_t)(depth - 1) * frame_duration_ms_ * 1000 < target_us && waited_us < target_us) {
+        wait_ticks = std::max<TickType_t>(pdMS_TO_TICKS((target_us - waited_us + 999) / 1000), 1);
+        return false;
+    }
+    playout_buffering_ = false;
+    playout_starts_++;
+    return true;
 }
 
 void AudioService::SetDecodeSampleRate(int sample_rate, int frame_duration) {
+    auto codec = Board::GetInstance().GetAudioCodec();
     if (opus_decoder_->sample_rate() == sample_rate && opus_decoder_->duration_ms() == frame_duration) {
+        /* The music player may have changed the codec output rate, voice is mixed with music at that rate */
+        if (sample_rate != codec->output_sample_rate() && output_resampler_.output_sample_rate() != codec->output_sample_rate()) {
+            ESP_LOGI(TAG, "Resampling audio from %d to %d", sample_rate, codec->output_sample_rate());
+            output_resampler_.Configure(sample_rate, codec->output_sample_rate());
+        }
         return;
     }
 
     opus_decoder_.reset();
     opus_decoder_ = std::make_unique<OpusDecoderWrapper>(sample_rate, 1, frame_duration);
 
-    auto codec = Board::GetInstance().GetAudioCodec();
     if (opus_decoder_->sample_rate() != codec->output_sample_rate()) {
         ESP_LOGI(TAG, "Resampling audio from %d to %d", opus_decoder_->sample_rate(), codec->output_sample_rate());
         output_resampler_.Configure(opus_decoder_->sample_rate(), codec->output_sample_rate());
     }
 }
 
-void AudioService::PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm) {
-    auto task = std::make_unique<AudioTask>();
+void AudioService::PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>& pcm) {
+    auto task = task_pool_.Acquire();
     task->type = type;
-    task->pcm = std::move(pcm);
+    task->timestamp = 0;
+    task->queued_time = esp_timer_get_time();
+    task->pcm.swap(pcm);
     
-    /* Push the task to the encode queue */
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
+    /* The ring takes one producer at a time, the other producer blocks here while this one waits for room */
+    std::lock_guard<std::mutex> lock(encode_push_mutex_);
 
     /* If the task is to send queue, we need to set the timestamp */
-    if (type == kAudioTaskTypeEncodeToSendQueue && !timestamp_queue_.empty()) {
-        if (timestamp_queue_.size() <= MAX_TIMESTAMPS_IN_QUEUE) {
-            task->timestamp = timestamp_queue_.front();
+    uint32_t timestamp;
+    size_t timestamps = timestamp_queue_.Size();
+    if (type == kAudioTaskTypeEncodeToSendQueue && timestamp_queue_.Pop(timestamp)) {
+        if (timestamps <= MAX_TIMESTAMPS_IN_QUEUE) {
+            task->timestamp = timestamp;
         } else {
-            ESP_LOGW(TAG, "Timestamp queue (%u) is full, dropping timestamp", timestamp_queue_.size());
+            ESP_LOGW(TAG, "Timestamp queue (%u) is full, dropping timestamp", timestamps);
+        }
+    }
+
+    /* Push the task to the encode queue, waiting for the encode task to make room */
+    if (!audio_encode_queue_.Push(std::move(task))) {
+        audio_encode_queue_.SetProducer(xTaskGetCurrentTaskHandle());
+        while (!audio_encode_queue_.Push(std::move(task)) && !service_stopped_) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
         }
-        timestamp_queue_.pop_front();
+        audio_encode_queue_.SetProducer(nullptr);
+        task_pool_.Release(std::move(task));
     }
+}
+
+std::unique_ptr<AudioStreamPacket> AudioService::AcquirePacket() {
+    return packet_pool_.Acquire();
+}
 
-    audio_queue_cv_.wait(lock, [this]() { return audio_encode_queue_.size() < MAX_ENCODE_TASKS_IN_QUEUE; });
-    audio_encode_queue_.push_back(std::move(task));
-    audio_queue_cv_.notify_all();
+void AudioService::ReleasePacket(std::unique_ptr<AudioStreamPacket> packet) {
+    packet_pool_.Release(std::move(packet));
 }
 
 bool AudioService::PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait) {
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-    if (audio_decode_queue_.size() >= MAX_DECODE_PACKETS_IN_QUEUE) {
-        if (wait) {
-            audio_queue_cv_.wait(lock, [this]() { return audio_decode_queue_.size() < MAX_DECODE_PACKETS_IN_QUEUE; });
-        } else {
-            return false;
+    {
+        std::lock_guard<std::mutex> lock(decode_push_mutex_);
+        /* Packets pushed without waiting come from the network, cue sounds stay out of the jitter estimate */
+        if (!wait) {
+            TrackArrival(*packet);
+        }
+        if (audio_decode_queue_.Push(std::move(packet))) {
+            return true;
         }
     }
-    audio_decode_queue_.push_back(std::move(packet));
-    audio_queue_cv_.notify_all();
-    return true;
+    if (!wait) {
+        packet_pool_.Release(std::move(packet));
+        return false;
+    }
+
+    /* Other producers keep pushing (and dropping) while this one waits for the decode task */
+    std::lock_guard<std::mutex> wait_lock(decode_wait_mutex_);
+    audio_decode_queue_.SetProducer(xTaskGetCurrentTaskHandle());
+    bool pushed = false;
+    while (!service_stopped_) {
+        {
+            std::lock_guard<std::mutex> lock(decode_push_mutex_);
+            pushed = audio_decode_queue_.Push(std::move(packet));
+        }
+        if (pushed) {
+            break;
+        }
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    audio_decode_queue_.SetProducer(nullptr);
+    packet_pool_.Release(std::move(packet));
+    return pushed;
 }
 
 std::unique_ptr<AudioStreamPacket> AudioService::PopPacketFromSendQueue() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    if (audio_send_queue_.empty()) {
-        return nullptr;
-    }
-    auto packet = std::move(audio_send_queue_.front());
-    audio_send_queue_.pop_front();
-    audio_queue_cv_.notify_all();
+    std::unique_ptr<AudioStreamPacket> packet;
+    audio_send_queue_.Pop(packet);
     return packet;
 }
 
 void AudioService::EncodeWakeWord() {
     if (wake_word_) {
-        wake_word_->EncodeWakeWordData();
+        wake_word_->EncodeWakeWordData(frame_duration_ms_);
     }
 }
 
@@ -494,8 +939,12 @@ void AudioService::EnableVoiceProcessing(bool enable) {
     ESP_LOGD(TAG, "%s voice processing", enable ? "Enabling" : "Disabling");
     if (enable) {
         if (!audio_processor_initialized_) {
-            audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS);
+            audio_processor_->Initialize(codec_, frame_duration_ms_);
+            audio_processor_frame_duration_ = frame_duration_ms_;
             audio_processor_initialized_ = true;
+        } else if (audio_processor_frame_duration_ != frame_duration_ms_) {
+            audio_processor_frame_duration_ = frame_duration_ms_;
+            audio_processor_->SetFrameDuration(audio_processor_frame_duration_);
         }
 
         /* We should make sure no audio is playing */
@@ -512,20 +961,25 @@ void AudioService::EnableVoiceProcessing(bool enable) {
 void AudioService::EnableAudioTesting(bool enable) {
     ESP_LOGI(TAG, "%s audio testing", enable ? "Enabling" : "Disabling");
     if (enable) {
+        /* Drop a recording that has not finished playing */
+        audio_testing_queue_.Discard();
+        audio_testing_clear_ = true;
+        audio_decode_queue_.WakeConsumer();
         xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
     } else {
         xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
-        /* Copy audio_testing_queue_ to audio_decode_queue_ */
-        std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-        audio_decode_queue_ = std::move(audio_testing_queue_);
-        audio_queue_cv_.notify_all();
+        /* Play back audio_testing_queue_ instead of what is in audio_decode_queue_ */
+        audio_decode_queue_.Discard();
+        audio_testing_playback_ = true;
+        audio_decode_queue_.WakeConsumer();
     }
 }
 
 void AudioService::EnableDeviceAec(bool enable) {
     ESP_LOGI(TAG, "%s device AEC", enable ? "Enabling" : "Disabling");
     if (!audio_processor_initialized_) {
-        audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS);
+        audio_processor_->Initialize(codec_, frame_duration_ms_);
+        audio_processor_frame_duration_ = frame_duration_ms_;
         audio_processor_initialized_ = true;
     }
 
@@ -536,6 +990,24 @@ void AudioService::SetCallbacks(AudioServiceCallbacks& callbacks) {
     callbacks_ = callbacks;
 }
 
+bool AudioService::SetFrameDuration(int frame_duration_ms) {
+    if (frame_duration_ms < OPUS_MIN_FRAME_DURATION_MS || frame_duration_ms > OPUS_MAX_FRAME_DURATION_MS ||
+        frame_duration_ms % OPUS_MIN_FRAME_DURATION_MS != 0) {
+        ESP_LOGW(TAG, "Unsupported frame duration: %d ms, keeping %d ms", frame_duration_ms, frame_duration_ms_.load());
+        return false;
+    }
+    if (frame_duration_ms_.exchange(frame_duration_ms) != frame_duration_ms) {
+        ESP_LOGI(TAG, "Frame duration: %d ms", frame_duration_ms);
+    }
+    /*
+     * The encoder follows the frames the processor outputs, the processor picks the new duration up
+     * the next time voice processing is enabled. The decoder follows the duration of each packet.
+     */
+    audio_decode_queue_.SetLimit(MAX_DECODE_QUEUE_DURATION_MS / frame_duration_ms);
+    audio_send_queue_.SetLimit(MAX_SEND_QUEUE_DURATION_MS / frame_duration_ms);
+    return true;
+}
+
 void AudioService::PlaySound(const std::string_view& sound) {
     const char* data = sound.data();
     size_t size = sound.size();
@@ -544,11 +1016,12 @@ void AudioService::PlaySound(const std::string_view& sound) {
         p += sizeof(BinaryProtocol3);
 
         auto payload_size = ntohs(p3->payload_size);
-        auto packet = std::make_unique<AudioStreamPacket>();
+        auto packet = packet_pool_.Acquire();
         packet->sample_rate = 16000;
         packet->frame_duration = 60;
-        packet->payload.resize(payload_size);
-        memcpy(packet->payload.data(), p3->payload, payload_size);
+        packet->timestamp = 0;
+        packet->lost_before = 0;
+        packet->payload.assign(p3->payload, p3->payload + payload_size);
         p += payload_size;
 
         PushPacketToDecodeQueue(std::move(packet), true);
@@ -556,18 +1029,20 @@ void AudioService::PlaySound(const std::string_view& sound) {
 }
 
 bool AudioService::IsIdle() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    return audio_encode_queue_.empty() && audio_decode_queue_.empty() && audio_playback_queue_.empty() && audio_testing_queue_.empty();
+    return audio_encode_queue_.Empty() && audio_decode_queue_.Empty() && audio_playback_queue_.Empty() &&
+        music_playback_queue_.Empty() && !music_frame_in_flight_ && audio_testing_queue_.Empty();
 }
 
 void AudioService::ResetDecoder() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    opus_decoder_->ResetState();
-    timestamp_queue_.clear();
-    audio_decode_queue_.clear();
-    audio_playback_queue_.clear();
-    audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
+    /* The decoder and the testing queue belong to the decode task, it resets them on its next round */
+    audio_testing_queue_.Discard();
+    decoder_reset_ = true;
+    audio_testing_clear_ = true;
+    timestamp_queue_.Discard();
+    audio_decode_queue_.Discard();
+    audio_playback_queue_.Discard();
+    audio_decode_queue_.WakeConsumer();
+    audio_playback_queue_.WakeConsumer();
 }
 
 void AudioService::CheckAndUpdateAudioPowerState() {
@@ -587,4 +1062,145 @@ void AudioService::CheckAndUpdateAudioPowerState() {
 
 void AudioService::UpdateOutputTimestamp() {
     last_output_time_ = std::chrono::steady_clock::now();
-}
\ No newline at end of file
+}
+
+bool AudioService::PushMusicData(std::vector<int16_t>& pcm) {
+    auto task = music_task_pool_.Acquire();
+    task->type = kAudioTaskTypeMusicPlayback;
+    task->timestamp = 0;
+    task->queued_time = 0;
+    task->pcm.swap(pcm);
+
+    if (!music_playback_queue_.Push(std::move(task))) {
+        music_producer_waits_++;
+        music_playback_queue_.SetProducer(xTaskGetCurrentTaskHandle());
+        while (!music_playback_queue_.Push(std::move(task)) && !service_stopped_) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+        music_playback_queue_.SetProducer(nullptr);
+        if (task != nullptr) {
+            /* Stopped, hand the buffer back so the caller keeps its capacity */
+            pcm.swap(task->pcm);
+            music_task_pool_.Release(std::move(task));
+            return false;
+        }
+    }
+
+    /* Only count underruns once the decoder has got ahead, so the start of a stream is not one */
+    uint32_t depth = music_playback_queue_.Size();
+    if (depth >= MAX_MUSIC_FRAMES_IN_QUEUE / 2) {
+        music_underrun_armed_ = true;
+    }
+    if (depth > music_max_depth_) {
+        music_max_depth_ = depth;
+    }
+    return true;
+}
+
+void AudioService::FinishMusicData() {
+    music_underrun_armed_ = false;
+}
+
+void AudioService::ClearMusicQueue() {
+    music_playback_queue_.Discard();
+    /* The partly played frame belongs to the output task, it drops it on its next round */
+    music_flush_ = true;
+    music_underrun_armed_ = false;
+    music_playback_queue_.WakeConsumer();
+}
+
+void AudioService::EnableMusicDucking(bool enable) {
+    music_ducking_ = enable;
+}
+
+void AudioService::PauseMusic(bool paused) {
+    music_paused_ = paused;
+    music_playback_queue_.WakeConsumer();
+}
+
+MusicQueueStatistics AudioService::GetMusicQueueStatistics() {
+    MusicQueueStatistics statistics;
+    statistics.frames_played = music_frames_played_;
+    statistics.underruns = music_underruns_;
+    statistics.producer_waits = music_producer_waits_;
+    statistics.max_depth = music_max_depth_;
+    return statistics;
+}
+
+void AudioService::PrintPoolStats() {
+    auto packets = packet_pool_.GetStatistics();
+    auto tasks = task_pool_.GetStatistics();
+    auto music = music_task_pool_.GetStatistics();
+    ESP_LOGI(TAG, "pools (in use/high water/capacity, misses) packets: %lu/%lu/%lu, %lu tasks: %lu/%lu/%lu, %lu music: %lu/%lu/%lu, %lu",
+        packets.in_use, packets.high_water, packets.capacity, packets.misses,
+        tasks.in_use, tasks.high_water, tasks.capacity, tasks.misses,
+        music.in_use, music.high_water, music.capacity, music.misses);
+}
+
+void AudioService::ReportSendFailure() {
+    uplink_send_failures_++;
+}
+
+UplinkEncoderStatistics AudioService::GetUplinkEncoderStatistics() {
+    UplinkEncoderStatistics statistics;
+    statistics.complexity = encoder_complexity_;
+    statistics.dtx = encoder_dtx_;
+    statistics.complexity_changes = encoder_complexity_changes_;
+    statistics.dtx_changes = encoder_dtx_changes_;
+    statistics.congested_windows = uplink_congested_windows_;
+    statistics.send_failures = uplink_send_failures_;
+    statistics.cpu_percent = uplink_cpu_percent_;
+    return statistics;
+}
+
+JitterBufferStatistics AudioService::GetJitterBufferStatistics() {
+    JitterBufferStatistics statistics;
+    statistics.target_delay_ms = jitter_target_ms_;
+    {
+        std::lock_guard<std::mutex> lock(decode_push_mutex_);
+        statistics.peak_delay_ms = jitter_peak_us_ / 1000;
+    }
+    statistics.playout_starts = playout_starts_;
+    statistics.late_frames = jitter_late_frames_;
+    statistics.lost_frames = downlink_lost_packets_;
+    statistics.concealed_frames = downlink_concealed_frames_;
+    return statistics;
+}
+
+void AudioService::PrintTimingStats() {
+    auto take = [](AudioStageTiming& timing, uint32_t& average, uint32_t& max) {
+        uint32_t count = timing.count.exchange(0);
+        uint32_t total = timing.total_us.exchange(0);
+        max = timing.max_us.exchange(0);
+        average = count > 0 ? total / count : 0;
+        return count;
+    };
+    uint32_t uplink_avg, uplink_max, encode_avg, encode_max, decode_avg, decode_max;
+    uint32_t uplink_frames = take(uplink_timing_, uplink_avg, uplink_max);
+    uint32_t encode_frames = take(encode_timing_, encode_avg, encode_max);
+    uint32_t decode_frames = take(decode_timing_, decode_avg, decode_max);
+    if (encode_frames == 0 && decode_frames == 0) {
+        return;
+    }
+    /* Stack high water marks in bytes, to size OPUS_ENCODE_TASK_STACK_SIZE and OPUS_DECODE_TASK_STACK_SIZE */
+    unsigned encode_stack_free = uxTaskGetStackHighWaterMark(opus_encode_task_handle_);
+    unsigned decode_stack_free = uxTaskGetStackHighWaterMark(opus_decode_task_handle_);
+    ESP_LOGI(TAG, "timing (avg/max us, frames) uplink: %lu/%lu, %lu encode: %lu/%lu, %lu decode: %lu/%lu, %lu stack free: %u/%u",
+        uplink_avg, uplink_max, uplink_frames, encode_avg, encode_max, encode_frames, decode_avg, decode_max, decode_frames,
+        encode_stack_free, decode_stack_free);
+    if (encode_stack_free < OPUS_TASK_STACK_MIN_FREE || decode_stack_free < OPUS_TASK_STACK_MIN_FREE) {
+        ESP_LOGW(TAG, "Opus task stack is running low, free: encode %u, decode %u bytes", encode_stack_free, decode_stack_free);
+    }
+    if (decode_frames > 0) {
+        auto jitter = GetJitterBufferStatistics();
+        ESP_LOGI(TAG, "jitter buffer target: %lu ms peak: %lu ms starts: %lu late: %lu lost: %lu concealed: %lu",
+            jitter.target_delay_ms, jitter.peak_delay_ms, jitter.playout_starts, jitter.late_frames,
+            jitter.lost_frames, jitter.concealed_frames);
+    }
+    if (uplink_frames > 0) {
+        auto uplink = GetUplinkEncoderStatistics();
+        ESP_LOGI(TAG, "uplink encoder complexity: %d dtx: %d encode: %lu%% changes: %lu/%lu congested windows: %lu send failures: %lu",
+            uplink.complexity, uplink.dtx, uplink.cpu_percent, uplink.complexity_changes, uplink.dtx_changes,
+            uplink.congested_windows, uplink.send_failures);
+    }
+}
@@ -2,8 +2,7 @@
 #define AUDIO_SERVICE_H
 
 #include <memory>
-#include <deque>
-#include <condition_variable>
+#include <atomic>
 #include <chrono>
 #include <mutex>
 
@@ -17,6 +16,8 @@
 #include <opus_resampler.h>
 
 #include "audio_codec.h"
+#include "audio_object_pool.h"
+#include "audio_ring.h"
 #include "audio_processor.h"
 #include "processors/audio_debugger.h"
 #include "wake_word.h"
@@ -27,20 +28,95 @@
  * There are two types of audio data flow:
  * 1. (MIC) -> [Processors] -> {Encode Queue} -> [Opus Encoder] -> {Send Queue} -> (Server)
  * 2. (Server) -> {Decode Queue} -> [Opus Decoder] -> {Playback Queue} -> (Speaker)
+ * 3. (Music Player) -> {Music Queue} -> [Mixer] -> (Speaker)
  *
- * We use one task for MIC / Speaker / Processors, and one task for Opus Encoder / Opus Decoder.
+ * We use one task for MIC / Processors, one for Speaker, and one task each for Opus Encoder and Opus Decoder,
+ * so decoding a burst of TTS packets never holds up the uplink (and the other way around).
+ * On dual-core chips the two Opus tasks can be pinned to different cores (see Kconfig.projbuild).
  * 
  * Decode Queue and Send Queue are the main queues, because Opus packets are quite smaller than PCM packets.
  * 
+ * The Music Queue holds PCM frames that are already mono and at the codec output rate. It lets the
+ * music decoder run a few frames ahead of the speaker, so I2S writes never block decoding.
+ * The output task mixes music under voice frames (TTS and cue sounds), ducking the music while
+ * voice plays or while the application asks for it.
+ *
+ * Every queue is a bounded ring with one producer and one consumer. The decode queue has several
+ * producers, they take turns on decode_push_mutex_. The encode queue is fed by the audio processor
+ * output, and by the input task in audio testing mode, they take turns on encode_push_mutex_.
+ * A task sleeps on its own task notification and is only woken when one of its queues goes from
+ * empty to not empty, or from full to not full, so a frame moving along one edge does not wake the
+ * tasks on the other edges.
+ * Queues are cleared with Discard, the consumer recycles the stale entries on its next pop.
+ * 
  */
 
-#define OPUS_FRAME_DURATION_MS 60
+/* Proposed in the hello, the frame duration in use is the one the server hello answers with */
+#define OPUS_FRAME_DURATION_MS CONFIG_OPUS_FRAME_DURATION_MS
+#define OPUS_MIN_FRAME_DURATION_MS 20
+#define OPUS_MAX_FRAME_DURATION_MS 60
 #define MAX_ENCODE_TASKS_IN_QUEUE 2
 #define MAX_PLAYBACK_TASKS_IN_QUEUE 2
-#define MAX_DECODE_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
-#define MAX_SEND_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
+/* Bounded in milliseconds. The rings hold enough of the shortest frames, SetFrameDuration sets their limits */
+#define MAX_DECODE_QUEUE_DURATION_MS 2400
+#define MAX_SEND_QUEUE_DURATION_MS 2400
+#define MAX_DECODE_PACKETS_IN_QUEUE (MAX_DECODE_QUEUE_DURATION_MS / OPUS_MIN_FRAME_DURATION_MS)
+#define MAX_SEND_PACKETS_IN_QUEUE (MAX_SEND_QUEUE_DURATION_MS / OPUS_MIN_FRAME_DURATION_MS)
+#define MAX_MUSIC_FRAMES_IN_QUEUE 8
+/* The input task stops testing when the queue holds AUDIO_TESTING_MAX_DURATION_MS, frames still being encoded fit on top */
+#define MAX_TESTING_PACKETS_IN_QUEUE (AUDIO_TESTING_MAX_DURATION_MS / OPUS_MIN_FRAME_DURATION_MS + MAX_ENCODE_TASKS_IN_QUEUE + 1)
+/* Pool sizes: everything the queues can hold, plus the objects the tasks hold while working on them */
+#define AUDIO_PACKET_POOL_SIZE (MAX_DECODE_PACKETS_IN_QUEUE + MAX_SEND_PACKETS_IN_QUEUE + 2)     // Receiving, sending
+/* Allocated up front for the proposed duration, shorter frames grow the pool on demand */
+#define AUDIO_PACKET_POOL_PREALLOCATED ((MAX_DECODE_QUEUE_DURATION_MS + MAX_SEND_QUEUE_DURATION_MS) / OPUS_FRAME_DURATION_MS + 2)
+#define AUDIO_TASK_POOL_SIZE (MAX_ENCODE_TASKS_IN_QUEUE + MAX_PLAYBACK_TASKS_IN_QUEUE + 3)      // Input, codec, output
+#define MUSIC_TASK_POOL_SIZE (MAX_MUSIC_FRAMES_IN_QUEUE + 1)                                    // Mixing
+#define MUSIC_UNITY_GAIN 32768                      // Q15
+#define MUSIC_DUCKING_GAIN (MUSIC_UNITY_GAIN / 4)   // Music level under speech
+#define MUSIC_DUCKING_RAMP_MS 100
 #define AUDIO_TESTING_MAX_DURATION_MS 10000
 #define MAX_TIMESTAMPS_IN_QUEUE 3
+#define MAX_CONCEALMENT_DURATION_MS 120     // Lost downlink audio the decoder conceals per gap
+/*
+ * Downlink jitter buffer. Playout starts once the target delay is queued behind the first frame, or the
+ * target delay after it arrived. The target follows the peak arrival delay of recent packets plus a margin.
+ */
+#define JITTER_MIN_DELAY_MS 40
+#define JITTER_MAX_DELAY_MS 600
+#define JITTER_DELAY_MARGIN_MS 20
+#define JITTER_PEAK_DECAY_MS 5000           // The peak delay decays over this much received audio
+#define JITTER_STREAM_GAP_MS 1000           // An arrival gap this long starts a new stream
+
+/*
+ * The decode task peaks inside libopus: decoding one 20 ms CELT frame keeps about 9 KB of working
+ * arrays on the stack, the resampler and logging run after it and need less. The task's own frames
+ * add under 1 KB. PrintTimingStats logs the free stack of both tasks and warns when it falls below
+ * OPUS_TASK_STACK_MIN_FREE, raise the sizes if that shows up.
+ */
+#define OPUS_ENCODE_TASK_STACK_SIZE (2048 * 13)
+#define OPUS_DECODE_TASK_STACK_SIZE (2048 * 8)
+#define OPUS_TASK_STACK_MIN_FREE 2048
+#if !CONFIG_FREERTOS_UNICORE && CONFIG_OPUS_ENCODE_TASK_CORE >= 0
+#define OPUS_ENCODE_TASK_CORE CONFIG_OPUS_ENCODE_TASK_CORE
+#else
+#define OPUS_ENCODE_TASK_CORE tskNO_AFFINITY
+#endif
+#if !CONFIG_FREERTOS_UNICORE && CONFIG_OPUS_DECODE_TASK_CORE >= 0
+#define OPUS_DECODE_TASK_CORE CONFIG_OPUS_DECODE_TASK_CORE
+#else
+#define OPUS_DECODE_TASK_CORE tskNO_AFFINITY
+#endif
+
+/*
+ * Uplink encoder controller, evaluated once per UPLINK_CONTROL_WINDOW_MS of encoded audio.
+ * CPU headroom is the encode time of a frame in percent of the frame duration.
+ */
+#define UPLINK_CONTROL_WINDOW_MS 1000
+#define UPLINK_CONGESTED_QUEUE_MS 300       // A send queue this deep means the link does not keep up
+#define UPLINK_CLEAR_WINDOWS 5              // Clean windows before the controller spends more CPU or bytes
+#define UPLINK_CPU_HIGH_PERCENT 30
+#define UPLINK_CPU_LOW_PERCENT 10
+#define UPLINK_MAX_COMPLEXITY 5
 
 #define AUDIO_POWER_TIMEOUT_MS 15000
 #define AUDIO_POWER_CHECK_INTERVAL_MS 1000
@@ -63,12 +139,14 @@ enum AudioTaskType {
     kAudioTaskTypeEncodeToSendQueue,
     kAudioTaskTypeEncodeToTestingQueue,
     kAudioTaskTypeDecodeToPlaybackQueue,
+    kAudioTaskTypeMusicPlayback,
 };
 
 struct AudioTask {
     AudioTaskType type;
     std::vector<int16_t> pcm;
     uint32_t timestamp;
+    int64_t queued_time;    // esp_timer time when the frame entered the encode queue
 };
 
 struct DebugStatistics {
@@ -78,6 +156,47 @@ struct DebugStatistics {
     uint32_t playback_count = 0;
 };
 
+/* Time spent in one pipeline stage, written by one task and read (and reset) by PrintTimingStats */
+struct AudioStageTiming {
+    std::atomic<uint32_t> count = 0;
+    std::atomic<uint32_t> total_us = 0;
+    std::atomic<uint32_t> max_us = 0;
+
+    void Add(int64_t us) {
+        count++;
+        total_us += (uint32_t)us;
+        if ((uint32_t)us > max_us) {
+            max_us = (uint32_t)us;
+        }
+    }
+};
+
+struct MusicQueueStatistics {
+    uint32_t frames_played = 0;
+    uint32_t underruns = 0;         // The queue ran dry after the decoder had got ahead
+    uint32_t producer_waits = 0;    // The decoder had to wait for room in the queue
+    uint32_t max_depth = 0;
+};
+
+struct UplinkEncoderStatistics {
+    int complexity = 0;
+    bool dtx = true;
+    uint32_t complexity_changes = 0;
+    uint32_t dtx_changes = 0;
+    uint32_t congested_windows = 0;     // Windows with a send failure or a deep send queue
+    uint32_t send_failures = 0;
+    uint32_t cpu_percent = 0;           // Last window
+};
+
+struct JitterBufferStatistics {
+    uint32_t target_delay_ms = 0;
+    uint32_t peak_delay_ms = 0;     // Peak arrival delay behind the earliest packet of the stream
+    uint32_t playout_starts = 0;    // Stream starts and refills after the queue ran dry
+    uint32_t late_frames = 0;       // Arrived later than the target delay allowed for
+    uint32_t lost_frames = 0;       // Sequence gaps reported by the protocol
+    uint32_t concealed_frames = 0;
+};
+
 class AudioService {
 public:
     AudioService();
@@ -100,15 +219,41 @@ public:
     void EnableDeviceAec(bool enable);
 
     void SetCallbacks(AudioServiceCallbacks& callbacks);
+    // Applies the frame duration negotiated in the hello (20, 40 or 60 ms) to the encoder, the audio
+    // processor and the queue limits. Returns false and keeps the current one for other values.
+    bool SetFrameDuration(int frame_duration_ms);
+    int GetFrameDuration() const { return frame_duration_ms_; }
 
+    // Packets for the decode queue should come from AcquirePacket, and packets popped from the send
+    // queue should go back with ReleasePacket, so their payload buffers are reused
+    std::unique_ptr<AudioStreamPacket> AcquirePacket();
+    void ReleasePacket(std::unique_ptr<AudioStreamPacket> packet);
     bool PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait = false);
     std::unique_ptr<AudioStreamPacket> PopPacketFromSendQueue();
+    // Called by the sender when the protocol fails to send a packet, the uplink encoder backs off
+    void ReportSendFailure();
     void PlaySound(const std::string_view& sound);
+    // Reuses the capacity of data and converts through scratch buffers owned by the service,
+    // so it does not allocate once the frame size is stable. Only one task may read at a time.
     bool ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples);
     void ResetDecoder();
     
     void UpdateOutputTimestamp();
 
+    // Music playback. The frame is swapped with a recycled buffer, so the caller can reuse the vector.
+    bool PushMusicData(std::vector<int16_t>& pcm);
+    // Marks the end of the music stream, the remaining frames play out without counting an underrun
+    void FinishMusicData();
+    void ClearMusicQueue();
+    void EnableMusicDucking(bool enable);
+    // While paused the mixer leaves the queued music untouched, so resuming is immediate
+    void PauseMusic(bool paused);
+    MusicQueueStatistics GetMusicQueueStatistics();
+    UplinkEncoderStatistics GetUplinkEncoderStatistics();
+    JitterBufferStatistics GetJitterBufferStatistics();
+    void PrintPoolStats();
+    void PrintTimingStats();
+
 private:
     AudioCodec* codec_ = nullptr;
     AudioServiceCallbacks callbacks_;
@@ -120,6 +265,9 @@ private:
     OpusResampler input_resampler_;
     OpusResampler reference_resampler_;
     OpusResampler output_resampler_;
+    std::vector<int16_t> decode_buffer_;          // Decoder output when it has to be resampled
+    std::vector<int16_t> input_buffer_;           // Codec-rate samples, then the resampled channels
+    std::vector<int16_t> input_planar_buffer_;    // Deinterleaved mic and reference channels
     DebugStatistics debug_statistics_;
 
     EventGroupHandle_t event_group_;
@@ -127,21 +275,75 @@ private:
     // Audio encode / decode
     TaskHandle_t audio_input_task_handle_ = nullptr;
     TaskHandle_t audio_output_task_handle_ = nullptr;
-    TaskHandle_t opus_codec_task_handle_ = nullptr;
-    std::mutex audio_queue_mutex_;
-    std::condition_variable audio_queue_cv_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_decode_queue_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_send_queue_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_testing_queue_;
-    std::deque<std::unique_ptr<AudioTask>> audio_encode_queue_;
-    std::deque<std::unique_ptr<AudioTask>> audio_playback_queue_;
-    // For server AEC
-    std::deque<uint32_t> timestamp_queue_;
+    TaskHandle_t opus_encode_task_handle_ = nullptr;
+    TaskHandle_t opus_decode_task_handle_ = nullptr;
+    AudioRing<std::unique_ptr<AudioStreamPacket>> audio_decode_queue_{MAX_DECODE_PACKETS_IN_QUEUE};
+    AudioRing<std::unique_ptr<AudioStreamPacket>> audio_send_queue_{MAX_SEND_PACKETS_IN_QUEUE};
+    AudioRing<std::unique_ptr<AudioStreamPacket>> audio_testing_queue_{MAX_TESTING_PACKETS_IN_QUEUE};
+    AudioRing<std::unique_ptr<AudioTask>> audio_encode_queue_{MAX_ENCODE_TASKS_IN_QUEUE};
+    AudioRing<std::unique_ptr<AudioTask>> audio_playback_queue_{MAX_PLAYBACK_TASKS_IN_QUEUE};
+    AudioRing<std::unique_ptr<AudioTask>> music_playback_queue_{MAX_MUSIC_FRAMES_IN_QUEUE};
+    std::mutex decode_push_mutex_;            // Producers of the decode queue push one at a time
+    std::mutex decode_wait_mutex_;            // Only one producer at a time waits for room in the decode queue
+    std::mutex encode_push_mutex_;            // Producers of the encode queue push (and wait) one at a time
+    std::atomic<bool> decoder_reset_ = false;            // Requests for the decode task, which owns the decoder
+    std::atomic<bool> audio_testing_clear_ = false;      // and consumes the testing queue
+    std::atomic<bool> audio_testing_playback_ = false;   // The decode task decodes the testing queue first
+    AudioStageTiming encode_timing_;        // Opus encoding of one frame
+    AudioStageTiming uplink_timing_;        // From the encode queue to the send queue
+    AudioStageTiming decode_timing_;        // Opus decoding and resampling of one packet
+    std::atomic<uint32_t> downlink_lost_packets_ = 0;       // Sequence gaps reported by the protocol
+    std::atomic<uint32_t> downlink_concealed_frames_ = 0;
+    // Jitter estimate, updated by the network task under decode_push_mutex_
+    int64_t jitter_last_arrival_us_ = 0;
+    int64_t jitter_media_us_ = 0;           // Audio received since the stream started
+    int64_t jitter_base_transit_us_ = 0;    // Earliest arrival relative to the media time
+    int64_t jitter_peak_us_ = 0;
+    std::atomic<uint32_t> jitter_target_ms_ = JITTER_MIN_DELAY_MS;
+    std::atomic<uint32_t> jitter_late_frames_ = 0;
+    // Playout state, owned by the decode task
+    std::atomic<bool> playback_ran_dry_ = false;   // Set by the output task when it runs out of voice frames
+    bool playout_buffering_ = true;
+    int64_t playout_buffering_since_ = 0;
+    std::atomic<uint32_t> playout_starts_ = 0;
+    // Uplink encoder controller. The settings and the window are written by the encode task only
+    std::atomic<int> encoder_complexity_ = 0;
+    std::atomic<bool> encoder_dtx_ = true;
+    std::atomic<uint32_t> encoder_complexity_changes_ = 0;
+    std::atomic<uint32_t> encoder_dtx_changes_ = 0;
+    std::atomic<uint32_t> uplink_congested_windows_ = 0;
+    std::atomic<uint32_t> uplink_send_failures_ = 0;
+    std::atomic<uint32_t> uplink_cpu_percent_ = 0;
+    uint32_t uplink_window_ms_ = 0;
+    uint32_t uplink_window_encode_us_ = 0;
+    uint32_t uplink_window_max_queue_ms_ = 0;
+    uint32_t uplink_window_send_failures_ = 0;     // uplink_send_failures_ when the window started
+    uint32_t uplink_clear_windows_ = 0;
+    AudioObjectPool<AudioStreamPacket> packet_pool_{AUDIO_PACKET_POOL_SIZE, AUDIO_PACKET_POOL_PREALLOCATED};
+    AudioObjectPool<AudioTask> task_pool_{AUDIO_TASK_POOL_SIZE};
+    AudioObjectPool<AudioTask> music_task_pool_{MUSIC_TASK_POOL_SIZE};
+    std::atomic<bool> music_underrun_armed_ = false;
+    std::unique_ptr<AudioTask> music_frame_;  // Music frame being played or mixed, used by the output task
+    size_t music_frame_offset_ = 0;           // Samples of music_frame_ already mixed under voice frames
+    std::atomic<bool> music_frame_in_flight_ = false;  // music_frame_ is set, published for other tasks
+    std::atomic<bool> music_flush_ = false;   // ClearMusicQueue asks the output task to drop music_frame_
+    std::atomic<bool> music_ducking_ = false;
+    std::atomic<bool> music_paused_ = false;
+    int32_t music_gain_ = MUSIC_UNITY_GAIN;   // Current music gain in Q15, ramps towards the target
+    std::atomic<uint32_t> music_frames_played_ = 0;
+    std::atomic<uint32_t> music_underruns_ = 0;
+    std::atomic<uint32_t> music_producer_waits_ = 0;
+    std::atomic<uint32_t> music_max_depth_ = 0;
+    // For server AEC, pushed by the output task and popped by the task that feeds the encode queue
+    AudioRing<uint32_t> timestamp_queue_{MAX_TIMESTAMPS_IN_QUEUE + 1};
+
+    std::atomic<int> frame_duration_ms_ = OPUS_FRAME_DURATION_MS;    // Negotiated in the hello, for both directions
+    int audio_processor_frame_duration_ = 0;                          // Frame duration the processor outputs
 
     bool wake_word_initialized_ = false;
     bool audio_processor_initialized_ = false;
     bool voice_detected_ = false;
-    bool service_stopped_ = true;
+    std::atomic<bool> service_stopped_ = true;
     bool audio_input_need_warmup_ = false;
 
     esp_timer_handle_t audio_power_timer_ = nullptr;
@@ -150,8 +352,17 @@ private:
 
     void AudioInputTask();
     void AudioOutputTask();
-    void OpusCodecTask();
-    void PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm);
+    void OpusEncodeTask();
+    void OpusDecodeTask();
+    void CreateOpusEncoder(int frame_duration);
+    void AdaptUplinkEncoder(int frame_duration, int64_t encode_us);
+    void TrackArrival(const AudioStreamPacket& packet);
+    bool ReadyToPlayout(TickType_t& wait_ticks);
+    void MixMusic(int16_t* output, size_t samples, int32_t target_gain, bool mix);
+    bool PopMusicFrame();
+    void ReleaseMusicFrame(bool played);
+    // The frame is swapped with a recycled buffer, so the caller can keep reading into the vector
+    void PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>& pcm);
     void SetDecodeSampleRate(int sample_rate, int frame_duration);
     void CheckAndUpdateAudioPowerState();
 };
@@ -1,7 +1,7 @@
 #include "no_audio_codec.h"
 
 #include <esp_log.h>
-#include <cmath>
+#include <algorithm>
 #include <cstring>
 
 #define TAG "NoAudioCodec"
@@ -279,42 +279,39 @@ NoAudioCodecSimplexPdm::NoAudioCodecSimplexPdm(int input_sample_rate, int output
 }
 
 int NoAudioCodec::Write(const int16_t* data, int samples) {
-    std::vector<int32_t> buffer(samples);
-
     // output_volume_: 0-100
-    // volume_factor_: 0-65536
-    int32_t volume_factor = pow(double(output_volume_) / 100.0, 2) * 65536;
-    for (int i = 0; i < samples; i++) {
-        int64_t temp = int64_t(data[i]) * volume_factor; // 使用 int64_t 进行乘法运算
-        if (temp > INT32_MAX) {
-            buffer[i] = INT32_MAX;
-        } else if (temp < INT32_MIN) {
-            buffer[i] = INT32_MIN;
-        } else {
-            buffer[i] = static_cast<int32_t>(temp);
-        }
+    // gain: 0-65536
+    int32_t gain = output_gain_.Get(output_volume_);
+    size_t total_bytes = 0;
+    for (int offset = 0; offset < samples; offset += AUDIO_CODEC_DMA_FRAME_NUM) {
+        int count = std::min(samples - offset, AUDIO_CODEC_DMA_FRAME_NUM);
+        PcmScale16To32(data + offset, write_buffer_, count, gain);
+
+        size_t bytes_written;
+        ESP_ERROR_CHECK(i2s_channel_write(tx_handle_, write_buffer_, count * sizeof(int32_t), &bytes_written, portMAX_DELAY));
+        total_bytes += bytes_written;
     }
-
-    size_t bytes_written;
-    ESP_ERROR_CHECK(i2s_channel_write(tx_handle_, buffer.data(), samples * sizeof(int32_t), &bytes_written, portMAX_DELAY));
-    return bytes_written / sizeof(int32_t);
+    return total_bytes / sizeof(int32_t);
 }
 
 int NoAudioCodec::Read(int16_t* dest, int samples) {
-    size_t bytes_read;
-
-    std::vector<int32_t> bit32_buffer(samples);
-    if (i2s_channel_read(rx_handle_, bit32_buffer.data(), samples * sizeof(int32_t), &bytes_read, portMAX_DELAY) != ESP_OK) {
-        ESP_LOGE(TAG, "Read Failed!");
-        return 0;
-    }
+    int total = 0;
+    while (total < samples) {
+        int count = std::min(samples - total, AUDIO_CODEC_DMA_FRAME_NUM);
+        size_t bytes_read;
+        if (i2s_channel_read(rx_handle_, read_buffer_, count * sizeof(int32_t), &bytes_read, portMAX_DELAY) != ESP_OK) {
+            ESP_LOGE(TAG, "Read Failed!");
+            return total;
+        }
 
-    samples = bytes_read / sizeof(int32_t);
-    for (int i = 0; i < samples; i++) {
-        int32_t value = bit32_buffer[i] >> 12;
-        dest[i] = (value > INT16_MAX) ? INT16_MAX : (value < -INT16_MAX) ? -INT16_MAX : (int16_t)value;
+        int read = bytes_read / sizeof(int32_t);
+        PcmConvert32To16(read_buffer_, dest + total, read, 12);
+        total += read;
+        if (read < count) {
+            break;
+        }
     }
-    return samples;
+    return total;
 }
 
 int NoAudioCodecSimplexPdm::Read(int16_t* dest, int samples) {
@@ -2,12 +2,18 @@
 #define _NO_AUDIO_CODEC_H
 
 #include "audio_codec.h"
+#include "pcm_format.h"
 
 #include <driver/gpio.h>
 #include <driver/i2s_pdm.h>
 
 class NoAudioCodec : public AudioCodec {
 private:
+    // 每次读写最多转换一个 DMA 缓冲区的样本，超出的分段处理
+    alignas(16) int32_t write_buffer_[AUDIO_CODEC_DMA_FRAME_NUM];
+    alignas(16) int32_t read_buffer_[AUDIO_CODEC_DMA_FRAME_NUM];
+    PcmGainCache output_gain_;
+
     virtual int Write(const int16_t* data, int samples) override;
     virtual int Read(int16_t* dest, int samples) override;
 
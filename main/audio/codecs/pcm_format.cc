@@ -0,0 +1,58 @@
+#include "pcm_format.h"
+
+#include <algorithm>
+
+// 主体按 PCM_BLOCK_SAMPLES 的整数倍处理，余下的样本单独处理。
+// 主体循环没有尾部，默认优化级别（-O2）下编译器也会把它向量化
+#define PCM_BLOCK_SAMPLES 8
+
+template <typename Kernel>
+static inline void ForEachSample(size_t samples, Kernel kernel) {
+    size_t body = samples & ~(size_t)(PCM_BLOCK_SAMPLES - 1);
+    for (size_t i = 0; i < body; i++) {
+        kernel(i);
+    }
+    for (size_t i = body; i < samples; i++) {
+        kernel(i);
+    }
+}
+
+static inline int ClampVolume(int volume) {
+    return std::min(std::max(volume, 0), 100);
+}
+
+int32_t PcmVolumeToGain(int volume) {
+    volume = ClampVolume(volume);
+    return volume * volume * PCM_UNITY_GAIN / 10000;
+}
+
+int32_t PcmVolumeToLinearGain(int volume) {
+    return ClampVolume(volume) * PCM_UNITY_GAIN / 100;
+}
+
+void PcmScale16To32(const int16_t* __restrict input, int32_t* __restrict output, size_t samples, int32_t gain) {
+    ForEachSample(samples, [=](size_t i) {
+        output[i] = input[i] * gain;
+    });
+}
+
+void PcmScale16To32Stereo(const int16_t* __restrict input, int32_t* __restrict output, size_t samples, int32_t gain) {
+    ForEachSample(samples, [=](size_t i) {
+        int32_t value = input[i] * gain;
+        output[i * 2] = value;
+        output[i * 2 + 1] = value;
+    });
+}
+
+void PcmScale16(const int16_t* __restrict input, int16_t* __restrict output, size_t samples, int32_t gain) {
+    ForEachSample(samples, [=](size_t i) {
+        output[i] = (int16_t)((input[i] * gain) >> 16);
+    });
+}
+
+void PcmConvert32To16(const int32_t* __restrict input, int16_t* __restrict output, size_t samples, int shift) {
+    ForEachSample(samples, [=](size_t i) {
+        int32_t value = input[i] >> shift;
+        output[i] = (int16_t)std::min<int32_t>(std::max<int32_t>(value, -INT16_MAX), INT16_MAX);
+    });
+}
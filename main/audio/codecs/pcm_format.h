@@ -0,0 +1,48 @@
+#ifndef _PCM_FORMAT_H
+#define _PCM_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * 直接驱动 I2S 的编解码器共用的格式转换与音量内核。
+ *
+ * - 循环体没有分支和函数调用，饱和用 min/max 表示，编译器可以直接向量化
+ * - 调用者提供缓冲区，内核本身不分配内存
+ * - 增益为 Q16 定点数，范围 [0, PCM_UNITY_GAIN]；在这个范围内 16 位样本乘增益不会溢出 32 位，
+ *   所以 16->32 位不需要饱和
+ */
+
+#define PCM_UNITY_GAIN 65536
+
+// 音量（0-100）到 Q16 增益，按平方曲线（与人耳感知接近）
+int32_t PcmVolumeToGain(int volume);
+// 音量（0-100）到 Q16 增益，线性
+int32_t PcmVolumeToLinearGain(int volume);
+
+// 16 位样本乘增益后写成 32 位 I2S 样本（左对齐）
+void PcmScale16To32(const int16_t* input, int32_t* output, size_t samples, int32_t gain);
+// 同上，每个样本写两遍（单声道扩展为双声道）
+void PcmScale16To32Stereo(const int16_t* input, int32_t* output, size_t samples, int32_t gain);
+// 16 位样本乘增益，输出仍为 16 位
+void PcmScale16(const int16_t* input, int16_t* output, size_t samples, int32_t gain);
+// 32 位 I2S 样本右移 shift 位后饱和到 [-INT16_MAX, INT16_MAX]
+void PcmConvert32To16(const int32_t* input, int16_t* output, size_t samples, int shift);
+
+// 音量变化时才重新计算增益
+class PcmGainCache {
+public:
+    int32_t Get(int volume) {
+        if (volume != volume_) {
+            volume_ = volume;
+            gain_ = PcmVolumeToGain(volume);
+        }
+        return gain_;
+    }
+
+private:
+    int volume_ = -1;
+    int32_t gain_ = 0;
+};
+
+#endif // _PCM_FORMAT_H
@@ -17,7 +17,7 @@ public:
     virtual void Start() = 0;
     virtual void Stop() = 0;
     virtual size_t GetFeedSize() = 0;
-    virtual void EncodeWakeWordData() = 0;
+    virtual void EncodeWakeWordData(int frame_duration_ms) = 0;
     virtual bool GetWakeWordOpus(std::vector<uint8_t>& opus) = 0;
     virtual const std::string& GetLastDetectedWakeWord() const = 0;
 };
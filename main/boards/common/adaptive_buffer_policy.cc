@@ -0,0 +1,111 @@
+#include "adaptive_buffer_policy.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <algorithm>
+#include <cstdlib>
+
+#define TAG "AdaptiveBufferPolicy"
+
+AdaptiveBufferPolicy::AdaptiveBufferPolicy(size_t max_prebuffer)
+    : max_prebuffer_(max_prebuffer) {
+}
+
+void AdaptiveBufferPolicy::BeginStream() {
+    window_start_us_ = 0;
+    window_active_us_ = 0;
+    window_bytes_ = 0;
+    bitrate_kbps_.store(0);
+    underrun_count_.store(0);
+}
+
+void AdaptiveBufferPolicy::OnDataReceived(size_t bytes) {
+    int64_t now = esp_timer_get_time();
+    if (window_start_us_ == 0) {
+        window_start_us_ = now;
+    }
+    window_bytes_ += bytes;
+
+    int64_t elapsed = window_active_us_ + now - window_start_us_;
+    if (elapsed < SAMPLE_WINDOW_US) {
+        return;
+    }
+
+    // 与 TCP 的 SRTT/RTTVAR 相同：均值按 1/8、偏差按 1/4 平滑
+    int64_t sample = (int64_t)window_bytes_ * 1000000 / elapsed;
+    int64_t average = throughput_bps_.load();
+    int64_t deviation = deviation_bps_.load();
+    if (average == 0) {
+        average = sample;
+        deviation = sample / 2;
+    } else {
+        int64_t error = sample - average;
+        average += error / 8;
+        deviation += (std::abs(error) - deviation) / 4;
+    }
+    throughput_bps_.store((uint32_t)std::max<int64_t>(average, 0));
+    deviation_bps_.store((uint32_t)std::max<int64_t>(deviation, 0));
+
+    window_start_us_ = now;
+    window_active_us_ = 0;
+    window_bytes_ = 0;
+}
+
+// 缓冲区满时下载线程不读 socket，这段时间的吞吐不代表网络，只保留之前已接收的部分
+void AdaptiveBufferPolicy::PauseMeasurement() {
+    if (window_start_us_ != 0) {
+        window_active_us_ += esp_timer_get_time() - window_start_us_;
+        window_start_us_ = 0;
+    }
+}
+
+void AdaptiveBufferPolicy::ResumeMeasurement() {
+    if (window_start_us_ == 0 && (window_active_us_ > 0 || window_bytes_ > 0)) {
+        window_start_us_ = esp_timer_get_time();
+    }
+}
+
+void AdaptiveBufferPolicy::OnStreamBitrate(int bitrate_kbps) {
+    if (bitrate_kbps <= 0) {
+        return;
+    }
+    // VBR 流的码率逐帧变化，取平滑值
+    int current = bitrate_kbps_.load();
+    bitrate_kbps_.store(current == 0 ? bitrate_kbps : current + (bitrate_kbps - current) / 8);
+}
+
+void AdaptiveBufferPolicy::OnUnderrun() {
+    int count = underrun_count_.fetch_add(1) + 1;
+    ESP_LOGW(TAG, "Buffer underrun #%d, prebuffer now %u bytes", count, (unsigned)PrebufferBytes());
+}
+
+size_t AdaptiveBufferPolicy::PrebufferBytes() const {
+    int64_t throughput = throughput_bps_.load();
+    // 还没有吞吐测量结果时使用保守的固定值
+    if (throughput == 0) {
+        return max_prebuffer_;
+    }
+
+    int bitrate_kbps = bitrate_kbps_.load();
+    int64_t stream_bps = (int64_t)(bitrate_kbps > 0 ? bitrate_kbps : DEFAULT_BITRATE_KBPS) * 1000 / 8;
+
+    int64_t cover_ms = BASE_COVER_MS + (int64_t)underrun_count_.load() * UNDERRUN_COVER_MS;
+
+    // 吞吐抖动越大，需要缓冲越长时间才能撑过一次下载停顿
+    int64_t deviation = deviation_bps_.load();
+    cover_ms += std::min<int64_t>(2000 * deviation / throughput, MAX_JITTER_COVER_MS);
+
+    // 按悲观吞吐（均值减两倍偏差）仍跟不上码率时，预先存下这段时间内的缺口
+    int64_t pessimistic = std::max<int64_t>(throughput - 2 * deviation, 0);
+    if (pessimistic < stream_bps) {
+        cover_ms += DEFICIT_HORIZON_MS * (stream_bps - pessimistic) / stream_bps;
+    }
+
+    size_t bytes = (size_t)(stream_bps * cover_ms / 1000);
+    size_t floor = (size_t)(stream_bps * BASE_COVER_MS / 1000);
+    return std::min(std::max(bytes, floor), max_prebuffer_);
+}
+
+bool AdaptiveBufferPolicy::ReadyToPlay(size_t buffered_bytes) const {
+    return buffered_bytes >= PrebufferBytes();
+}
@@ -0,0 +1,67 @@
+#ifndef ADAPTIVE_BUFFER_POLICY_H
+#define ADAPTIVE_BUFFER_POLICY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * 音乐流的自适应预缓冲策略。
+ *
+ * 下载线程上报收到的数据量，策略按固定时间窗口测量下载吞吐，并像 TCP RTT 估计一样
+ * 维护吞吐的平滑均值与平均偏差；播放线程上报帧头中的码率和欠载事件。
+ *
+ * - 预缓冲量 = 码率 × 需要覆盖的时长，该时长由网络抖动、吞吐不足的程度和本次欠载次数决定
+ * - 预缓冲量不超过 max_prebuffer（原来的固定值）：网络稳定时提前开始播放，网络差时与固定值相同。
+ *   缓冲更多只会推迟出声，弱网下减少的卡顿不足以抵消（见 test/host/adaptive_buffer_policy_sim）
+ * - 下载线程始终可以写满整个环形缓冲区
+ *
+ * 下载线程和播放线程各自只写属于自己的字段，对外读取的结果都是原子变量。
+ */
+class AdaptiveBufferPolicy {
+public:
+    explicit AdaptiveBufferPolicy(size_t max_prebuffer);
+
+    // 开始新的数据流：清空本次的测量窗口与计数，保留已学到的网络状况
+    void BeginStream();
+
+    // 下载线程调用
+    void OnDataReceived(size_t bytes);
+    // 下载线程因缓冲区已满而阻塞前后调用，阻塞期间不计入吞吐测量窗口
+    void PauseMeasurement();
+    void ResumeMeasurement();
+
+    // 播放线程调用
+    void OnStreamBitrate(int bitrate_kbps);
+    void OnUnderrun();
+
+    bool ReadyToPlay(size_t buffered_bytes) const;
+    size_t PrebufferBytes() const;
+
+    uint32_t throughput_bps() const { return throughput_bps_.load(); }
+    uint32_t throughput_deviation_bps() const { return deviation_bps_.load(); }
+    int bitrate_kbps() const { return bitrate_kbps_.load(); }
+    int underrun_count() const { return underrun_count_.load(); }
+
+private:
+    static constexpr int64_t SAMPLE_WINDOW_US = 250 * 1000;  // 吞吐测量窗口
+    static constexpr int BASE_COVER_MS = 500;                // 网络稳定时也至少缓冲这么长
+    static constexpr int MAX_JITTER_COVER_MS = 4000;         // 抖动带来的额外缓冲上限
+    static constexpr int UNDERRUN_COVER_MS = 1000;           // 每次欠载增加的缓冲时长
+    static constexpr int DEFICIT_HORIZON_MS = 10000;         // 吞吐低于码率时需要撑过的时长
+    static constexpr int DEFAULT_BITRATE_KBPS = 128;
+
+    const size_t max_prebuffer_;
+
+    // 仅由下载线程访问
+    int64_t window_start_us_ = 0;   // 当前这段接收的起始时间，0 表示尚未开始或已暂停
+    int64_t window_active_us_ = 0;  // 窗口内此前各段接收的累计时长
+    size_t window_bytes_ = 0;
+
+    std::atomic<uint32_t> throughput_bps_{0};  // 字节/秒，平滑均值
+    std::atomic<uint32_t> deviation_bps_{0};   // 字节/秒，平均偏差
+    std::atomic<int> bitrate_kbps_{0};
+    std::atomic<int> underrun_count_{0};
+};
+
+#endif // ADAPTIVE_BUFFER_POLICY_H
@@ -1,8 +1,10 @@
 #include "esp32_music.h"
+#include "mp3_music_decoder.h"
 #include "board.h"
 #include "system_info.h"
 #include "audio/audio_codec.h"
 #include "application.h"
+#include "device_state_event.h"
 #include "protocols/protocol.h"
 #include "display/display.h"
 
@@ -10,6 +12,7 @@
 #include <esp_heap_caps.h>
 #include <esp_pthread.h>
 #include <esp_timer.h>
+#include <esp_spiffs.h>
 #include <mbedtls/sha256.h>
 #include <cJSON.h>
 #include <cstring>
@@ -166,11 +169,16 @@ Esp32Music::Esp32Music() : last_downloaded_data_(), current_music_url_(), curren
                          song_name_displayed_(false), current_lyric_url_(), lyrics_(), 
                          current_lyric_index_(-1), lyric_thread_(), is_lyric_running_(false),
                          display_mode_(DISPLAY_MODE_LYRICS), is_playing_(false), is_downloading_(false), 
-                         play_thread_(), download_thread_(), audio_buffer_(), buffer_mutex_(), 
-                         buffer_cv_(), buffer_size_(0), mp3_decoder_(nullptr), mp3_frame_info_(), 
-                         mp3_decoder_initialized_(false) {
+                         play_thread_(), download_thread_(), stream_buffer_(),
+                         buffer_policy_(MAX_PREBUFFER_SIZE) {
     ESP_LOGI(TAG, "Music player initialized with default spectrum display mode");
-    InitializeMp3Decoder();
+    InitializeSongCache();
+    
+    // 播放线程不轮询设备状态，状态变化时由事件唤醒
+    DeviceStateEventManager::GetInstance().RegisterStateChangeCallback(
+        [this](DeviceState previous_state, DeviceState current_state) {
+            OnDeviceStateChanged(previous_state, current_state);
+        });
 }
 
 Esp32Music::~Esp32Music() {
@@ -181,11 +189,11 @@ Esp32Music::~Esp32Music() {
     is_playing_ = false;
     is_lyric_running_ = false;
     
-    // 通知所有等待的线程
-    {
-        std::lock_guard<std::mutex> lock(buffer_mutex_);
-        buffer_cv_.notify_all();
+    // 唤醒所有在缓冲区上等待的线程
+    if (stream_buffer_) {
+        stream_buffer_->Close();
     }
+    WakePlayThread();
     
     // 等待下载线程结束，设置5秒超时
     if (download_thread_.joinable()) {
@@ -207,12 +215,6 @@ Esp32Music::~Esp32Music() {
             // 再次设置停止标志，确保线程能够检测到
             is_downloading_ = false;
             
-            // 通知条件变量
-            {
-                std::lock_guard<std::mutex> lock(buffer_mutex_);
-                buffer_cv_.notify_all();
-            }
-            
             // 检查线程是否已经结束
             if (!download_thread_.joinable()) {
                 thread_finished = true;
@@ -249,12 +251,6 @@ Esp32Music::~Esp32Music() {
             // 再次设置停止标志
             is_playing_ = false;
             
-            // 通知条件变量
-            {
-                std::lock_guard<std::mutex> lock(buffer_mutex_);
-                buffer_cv_.notify_all();
-            }
-            
             // 检查线程是否已经结束
             if (!play_thread_.joinable()) {
                 thread_finished = true;
@@ -274,9 +270,8 @@ Esp32Music::~Esp32Music() {
         ESP_LOGI(TAG, "Lyric thread finished");
     }
     
-    // 清理缓冲区和MP3解码器
+    // 清理缓冲区
     ClearAudioBuffer();
-    CleanupMp3Decoder();
     
     ESP_LOGI(TAG, "Music player destroyed successfully");
 }
@@ -288,15 +283,83 @@ bool Esp32Music::Download(const std::string& song_name, const std::string& artis
     // 清空之前的下载数据
     last_downloaded_data_.clear();
     
-    // 保存歌名用于后续显示
-    current_song_name_ = song_name;
+    // 出声耗时从收到播放请求开始计算
+    request_start_time_us_ = esp_timer_get_time();
     
-    // 第一步：请求stream_pcm接口获取音频信息
+    // 先通知上一首的各线程停止，让它们在请求歌曲详情期间并行收尾，StartStreaming时就不用再等
+    is_downloading_ = false;
+    is_playing_ = false;
+    is_lyric_running_ = false;
+    if (stream_buffer_) {
+        stream_buffer_->Close();
+    }
+    WakePlayThread();
+    
+    TrackInfo track;
+    if (LookupCachedTrack(song_name, artist_name, &track)) {
+        // 已缓存的歌曲不需要再请求歌曲详情
+        ESP_LOGI(TAG, "Found cached song: %s", song_name.c_str());
+        return PlayTrack(track);
+    }
+    
+    // 请求详情的连接交给下载线程继续使用，音频请求复用同一个 keep-alive 连接
+    if (!ResolveTrack(song_name, artist_name, &track, &last_downloaded_data_, &handoff_http_)) {
+        // 上一首已经收到停止信号，在这里完成收尾：回收线程、清除暂停状态，预取的歌曲放回播放列表
+        StopStreaming();
+        RequeuePrefetchedTracks();
+        return false;
+    }
+    ESP_LOGI(TAG, "Music details resolved in %lld ms", (esp_timer_get_time() - request_start_time_us_) / 1000);
+    return PlayTrack(track);
+}
+
+bool Esp32Music::LookupCachedTrack(const std::string& song_name, const std::string& artist_name, TrackInfo* track) {
+    SongCache::Entry entry;
+    if (!song_cache_ || !song_cache_->Lookup(song_name, artist_name, &entry)) {
+        return false;
+    }
+    track->song_name = entry.song_name;
+    track->artist_name = entry.artist_name;
+    track->audio_url = entry.audio_url;
+    track->lyric_url = entry.lyric_url;
+    return true;
+}
+
+// 挂载缓存分区，分区不存在时不启用缓存
+void Esp32Music::InitializeSongCache() {
+    esp_vfs_spiffs_conf_t conf = {
+        .base_path = SONG_CACHE_BASE_PATH,
+        .partition_label = SONG_CACHE_PARTITION,
+        .max_files = 4,
+        .format_if_mount_failed = true,
+    };
+    esp_err_t ret = esp_vfs_spiffs_register(&conf);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Song cache disabled, failed to mount partition '%s': %s",
+                SONG_CACHE_PARTITION, esp_err_to_name(ret));
+        return;
+    }
+    
+    size_t total = 0, used = 0;
+    esp_spiffs_info(SONG_CACHE_PARTITION, &total, &used);
+    // SPIFFS 需要留出空闲块做垃圾回收，只用其中四分之三
+    song_cache_ = std::make_unique<SongCache>(SONG_CACHE_BASE_PATH, total / 4 * 3);
+    song_cache_->Load();
+}
+
+// 请求stream_pcm接口获取歌曲详情，解析出音频和歌词的完整URL
+bool Esp32Music::ResolveTrack(const std::string& song_name, const std::string& artist_name,
+                              TrackInfo* track, std::string* response, std::unique_ptr<Http>* connection) {
     std::string base_url = "http://www.xiaozhishop.xyz:5005";
     std::string full_url = base_url + "/stream_pcm?song=" + url_encode(song_name) + "&artist=" + url_encode(artist_name);
     
     ESP_LOGI(TAG, "Request URL: %s", full_url.c_str());
     
+    // 丢弃上一次留下的连接，只有成功解析出歌曲详情才交出新的连接
+    if (connection != nullptr) {
+        connection->reset();
+    }
+    
     // 使用Board提供的HTTP客户端
     auto network = Board::GetInstance().GetNetwork();
     auto http = network->CreateHttp(0);
@@ -304,6 +367,7 @@ bool Esp32Music::Download(const std::string& song_name, const std::string& artis
     // 设置基本请求头
     http->SetHeader("User-Agent", "ESP32-Music-Player/1.0");
     http->SetHeader("Accept", "application/json");
+    http->SetHeader("Connection", "keep-alive");
     
     // 添加ESP32认证头
     add_auth_headers(http.get());
@@ -322,117 +386,291 @@ bool Esp32Music::Download(const std::string& song_name, const std::string& artis
         return false;
     }
     
-    // 读取响应数据
-    last_downloaded_data_ = http->ReadAll();
-    http->Close();
+    // 读取响应数据。响应已完整读出，需要复用时保持连接不关闭，解析成功后交给调用者；
+    // 解析失败时连接随 http 一起释放
+    std::string data = http->ReadAll();
+    if (connection == nullptr) {
+        http->Close();
+    }
     
-    ESP_LOGI(TAG, "HTTP GET Status = %d, content_length = %d", status_code, last_downloaded_data_.length());
-    ESP_LOGD(TAG, "Complete music details response: %s", last_downloaded_data_.c_str());
+    ESP_LOGI(TAG, "HTTP GET Status = %d, content_length = %d", status_code, data.length());
+    ESP_LOGD(TAG, "Complete music details response: %s", data.c_str());
+    if (response != nullptr) {
+        *response = data;
+    }
     
     // 简单的认证响应检查（可选）
-    if (last_downloaded_data_.find("ESP32动态密钥验证失败") != std::string::npos) {
+    if (data.find("ESP32动态密钥验证失败") != std::string::npos) {
         ESP_LOGE(TAG, "Authentication failed for song: %s", song_name.c_str());
         return false;
     }
     
-    if (!last_downloaded_data_.empty()) {
-        // 解析响应JSON以提取音频URL
-        cJSON* response_json = cJSON_Parse(last_downloaded_data_.c_str());
-        if (response_json) {
-            // 提取关键信息
-            cJSON* artist = cJSON_GetObjectItem(response_json, "artist");
-            cJSON* title = cJSON_GetObjectItem(response_json, "title");
-            cJSON* audio_url = cJSON_GetObjectItem(response_json, "audio_url");
-            cJSON* lyric_url = cJSON_GetObjectItem(response_json, "lyric_url");
-            
-            if (cJSON_IsString(artist)) {
-                ESP_LOGI(TAG, "Artist: %s", artist->valuestring);
-            }
-            if (cJSON_IsString(title)) {
-                ESP_LOGI(TAG, "Title: %s", title->valuestring);
-            }
+    if (data.empty()) {
+        ESP_LOGE(TAG, "Empty response from music API");
+        return false;
+    }
+    
+    // 解析响应JSON以提取音频URL
+    cJSON* response_json = cJSON_Parse(data.c_str());
+    if (!response_json) {
+        ESP_LOGE(TAG, "Failed to parse JSON response");
+        return false;
+    }
+    
+    // 提取关键信息
+    cJSON* artist = cJSON_GetObjectItem(response_json, "artist");
+    cJSON* title = cJSON_GetObjectItem(response_json, "title");
+    cJSON* audio_url = cJSON_GetObjectItem(response_json, "audio_url");
+    cJSON* lyric_url = cJSON_GetObjectItem(response_json, "lyric_url");
+    
+    if (cJSON_IsString(artist)) {
+        ESP_LOGI(TAG, "Artist: %s", artist->valuestring);
+    }
+    if (cJSON_IsString(title)) {
+        ESP_LOGI(TAG, "Title: %s", title->valuestring);
+    }
+    
+    // 检查audio_url是否有效
+    if (!cJSON_IsString(audio_url) || !audio_url->valuestring || strlen(audio_url->valuestring) == 0) {
+        // audio_url为空或无效
+        ESP_LOGE(TAG, "Audio URL not found or empty for song: %s", song_name.c_str());
+        ESP_LOGE(TAG, "Failed to find music: 没有找到歌曲 '%s'", song_name.c_str());
+        cJSON_Delete(response_json);
+        return false;
+    }
+    
+    ESP_LOGI(TAG, "Audio URL path: %s", audio_url->valuestring);
+    
+    track->song_name = song_name;
+    track->artist_name = artist_name;
+    
+    // 第二步：拼接完整的音频下载URL，确保对audio_url进行URL编码
+    std::string audio_path = audio_url->valuestring;
+    
+    // 使用统一的URL构建功能
+    if (audio_path.find("?") != std::string::npos) {
+        size_t query_pos = audio_path.find("?");
+        std::string path = audio_path.substr(0, query_pos);
+        std::string query = audio_path.substr(query_pos + 1);
+        
+        track->audio_url = buildUrlWithParams(base_url, path, query);
+    } else {
+        track->audio_url = base_url + audio_path;
+    }
+    
+    // 处理歌词URL，使用相同的URL构建逻辑
+    track->lyric_url.clear();
+    if (cJSON_IsString(lyric_url) && lyric_url->valuestring && strlen(lyric_url->valuestring) > 0) {
+        std::string lyric_path = lyric_url->valuestring;
+        if (lyric_path.find("?") != std::string::npos) {
+            size_t query_pos = lyric_path.find("?");
+            std::string path = lyric_path.substr(0, query_pos);
+            std::string query = lyric_path.substr(query_pos + 1);
             
-            // 检查audio_url是否有效
-            if (cJSON_IsString(audio_url) && audio_url->valuestring && strlen(audio_url->valuestring) > 0) {
-                ESP_LOGI(TAG, "Audio URL path: %s", audio_url->valuestring);
-                
-                // 第二步：拼接完整的音频下载URL，确保对audio_url进行URL编码
-                std::string audio_path = audio_url->valuestring;
-                
-                // 使用统一的URL构建功能
-                if (audio_path.find("?") != std::string::npos) {
-                    size_t query_pos = audio_path.find("?");
-                    std::string path = audio_path.substr(0, query_pos);
-                    std::string query = audio_path.substr(query_pos + 1);
-                    
-                    current_music_url_ = buildUrlWithParams(base_url, path, query);
-                } else {
-                    current_music_url_ = base_url + audio_path;
-                }
-                
-                ESP_LOGI(TAG, "小智开源音乐固件qq交流群:826072986");
-                ESP_LOGI(TAG, "Starting streaming playback for: %s", song_name.c_str());
-                song_name_displayed_ = false;  // 重置歌名显示标志
-                StartStreaming(current_music_url_);
-                
-                // 处理歌词URL - 只有在歌词显示模式下才启动歌词
-                if (cJSON_IsString(lyric_url) && lyric_url->valuestring && strlen(lyric_url->valuestring) > 0) {
-                    // 拼接完整的歌词下载URL，使用相同的URL构建逻辑
-                    std::string lyric_path = lyric_url->valuestring;
-                    if (lyric_path.find("?") != std::string::npos) {
-                        size_t query_pos = lyric_path.find("?");
-                        std::string path = lyric_path.substr(0, query_pos);
-                        std::string query = lyric_path.substr(query_pos + 1);
-                        
-                        current_lyric_url_ = buildUrlWithParams(base_url, path, query);
-                    } else {
-                        current_lyric_url_ = base_url + lyric_path;
-                    }
-                    
-                    // 根据显示模式决定是否启动歌词
-                    if (display_mode_ == DISPLAY_MODE_LYRICS) {
-                        ESP_LOGI(TAG, "Loading lyrics for: %s (lyrics display mode)", song_name.c_str());
-                        
-                        // 启动歌词下载和显示
-                        if (is_lyric_running_) {
-                            is_lyric_running_ = false;
-                            if (lyric_thread_.joinable()) {
-                                lyric_thread_.join();
-                            }
-                        }
-                        
-                        is_lyric_running_ = true;
-                        current_lyric_index_ = -1;
-                        lyrics_.clear();
-                        
-                        lyric_thread_ = std::thread(&Esp32Music::LyricDisplayThread, this);
-                    } else {
-                        ESP_LOGI(TAG, "Lyric URL found but spectrum display mode is active, skipping lyrics");
-                    }
-                } else {
-                    ESP_LOGW(TAG, "No lyric URL found for this song");
-                }
-                
-                cJSON_Delete(response_json);
-                return true;
-            } else {
-                // audio_url为空或无效
-                ESP_LOGE(TAG, "Audio URL not found or empty for song: %s", song_name.c_str());
-                ESP_LOGE(TAG, "Failed to find music: 没有找到歌曲 '%s'", song_name.c_str());
-                cJSON_Delete(response_json);
-                return false;
-            }
+            track->lyric_url = buildUrlWithParams(base_url, path, query);
         } else {
-            ESP_LOGE(TAG, "Failed to parse JSON response");
+            track->lyric_url = base_url + lyric_path;
+        }
+    }
+    
+    cJSON_Delete(response_json);
+    if (connection != nullptr) {
+        *connection = std::move(http);
+    }
+    return true;
+}
+
+// 从头开始播放一首已获取详情的歌曲
+bool Esp32Music::PlayTrack(const TrackInfo& track) {
+    // 上一首的播放线程会读写歌曲信息，下载线程会读写缓存，等它们退出后再切换
+    JoinStreamThreads();
+    
+    // 保存歌名用于后续显示
+    {
+        std::lock_guard<std::mutex> lock(track_mutex_);
+        current_song_name_ = track.song_name;
+        current_music_url_ = track.audio_url;
+        current_lyric_url_ = track.lyric_url;
+    }
+    
+    ESP_LOGI(TAG, "小智开源音乐固件qq交流群:826072986");
+    ESP_LOGI(TAG, "Starting streaming playback for: %s", track.song_name.c_str());
+    song_name_displayed_ = false;  // 重置歌名显示标志
+    streaming_track_ = track;
+    if (!StartStreaming(track.audio_url)) {
+        return false;
+    }
+    
+    // 处理歌词 - 只有在歌词显示模式下才启动歌词
+    if (!track.lyric_url.empty()) {
+        if (display_mode_ == DISPLAY_MODE_LYRICS) {
+            ESP_LOGI(TAG, "Loading lyrics for: %s (lyrics display mode)", track.song_name.c_str());
+            StartLyricThread(track.lyric_url);
+        } else {
+            ESP_LOGI(TAG, "Lyric URL found but spectrum display mode is active, skipping lyrics");
         }
     } else {
-        ESP_LOGE(TAG, "Empty response from music API");
+        ESP_LOGW(TAG, "No lyric URL found for this song");
+    }
+    return true;
+}
+
+// 启动（或重启）歌词下载和显示线程。歌词优先级低于音频下载和解码，与它们并行获取
+// 上一个歌词线程可能正阻塞在HTTP请求中，回收它需要等待，不能在解码线程中调用
+void Esp32Music::StartLyricThread(const std::string& lyric_url) {
+    std::lock_guard<std::mutex> thread_lock(lyric_thread_mutex_);
+    is_lyric_running_ = false;
+    if (lyric_thread_.joinable()) {
+        lyric_thread_.join();
     }
     
-    return false;
+    {
+        std::lock_guard<std::mutex> lock(lyrics_mutex_);
+        lyrics_.clear();
+        current_lyric_index_ = -1;
+        is_lyric_running_ = true;
+    }
+    
+    esp_pthread_cfg_t cfg = esp_pthread_get_default_config();
+    cfg.stack_size = 8192;
+    cfg.prio = 3;  // 低于音频流线程
+    cfg.thread_name = "lyrics";
+    esp_pthread_set_cfg(&cfg);
+    lyric_thread_ = std::thread(&Esp32Music::LyricDisplayThread, this, lyric_url);
 }
 
+// 加入播放列表；当前没有在播放时立即开始播放
+bool Esp32Music::EnqueueSong(const std::string& song_name, const std::string& artist_name) {
+    {
+        std::lock_guard<std::mutex> lock(playlist_mutex_);
+        playlist_.push_back({song_name, artist_name, "", ""});
+        ESP_LOGI(TAG, "Enqueued song: %s (queue length: %u)", song_name.c_str(), (unsigned)playlist_.size());
+    }
+    playlist_cv_.notify_all();
+    
+    if (!is_playing_ && !is_downloading_) {
+        return PlayNext();
+    }
+    return true;
+}
 
+// 立即切到队列中的下一首（已开始预取的歌曲优先）
+bool Esp32Music::PlayNext() {
+    if (is_playing_ || is_downloading_) {
+        StopStreaming();
+    }
+    RequeuePrefetchedTracks();
+    
+    TrackInfo track;
+    {
+        std::lock_guard<std::mutex> lock(playlist_mutex_);
+        if (playlist_.empty()) {
+            ESP_LOGI(TAG, "Playlist is empty");
+            return false;
+        }
+        track = std::move(playlist_.front());
+        playlist_.pop_front();
+    }
+    
+    if (track.audio_url.empty()) {
+        return Download(track.song_name, track.artist_name);
+    }
+    return PlayTrack(track);
+}
+
+void Esp32Music::ClearQueue() {
+    std::lock_guard<std::mutex> lock(playlist_mutex_);
+    playlist_.clear();
+    ESP_LOGI(TAG, "Playlist cleared");
+}
+
+size_t Esp32Music::GetQueueLength() const {
+    std::lock_guard<std::mutex> lock(playlist_mutex_);
+    return playlist_.size() + track_boundaries_.size();
+}
+
+// 把已经开始下载但还没播放到的歌曲放回播放列表开头（调用前读写线程都必须已经退出）
+void Esp32Music::RequeuePrefetchedTracks() {
+    std::lock_guard<std::mutex> lock(playlist_mutex_);
+    while (!track_boundaries_.empty()) {
+        playlist_.push_front(std::move(track_boundaries_.back().track));
+        track_boundaries_.pop_back();
+    }
+}
+
+// 下载线程调用：取出播放列表中的下一首并获取其详情，无法获取详情的歌曲直接跳过
+bool Esp32Music::TakeNextTrack(TrackInfo* track) {
+    while (is_downloading_ && is_playing_) {
+        {
+            std::lock_guard<std::mutex> lock(playlist_mutex_);
+            if (playlist_.empty()) {
+                return false;
+            }
+            *track = std::move(playlist_.front());
+            playlist_.pop_front();
+        }
+        if (!track->audio_url.empty() ||
+            LookupCachedTrack(track->song_name, track->artist_name, track) ||
+            ResolveTrack(track->song_name, track->artist_name, track, nullptr)) {
+            return true;
+        }
+        ESP_LOGW(TAG, "Skipping queued song: %s", track->song_name.c_str());
+    }
+    return false;
+}
+
+// 播放线程调用：已播放到下一首歌的起始位置，切换歌曲信息
+void Esp32Music::SwitchToNextTrack() {
+    TrackInfo track;
+    {
+        std::lock_guard<std::mutex> lock(playlist_mutex_);
+        track = std::move(track_boundaries_.front().track);
+        track_boundaries_.pop_front();
+    }
+    ESP_LOGI(TAG, "Gapless transition to: %s", track.song_name.c_str());
+    
+    {
+        std::lock_guard<std::mutex> lock(track_mutex_);
+        current_song_name_ = track.song_name;
+        current_music_url_ = track.audio_url;
+        current_lyric_url_ = track.lyric_url;
+    }
+    current_play_time_ms_ = 0;
+    last_frame_time_ms_ = 0;
+    {
+        std::lock_guard<std::mutex> lock(seek_mutex_);
+        seek_index_.clear();
+        decoder_start_offset_ = 0;
+    }
+    
+    auto display = Board::GetInstance().GetDisplay();
+    if (display) {
+        std::string formatted_song_name = "《" + track.song_name + "》播放中...";
+        display->SetMusicInfo(formatted_song_name.c_str());
+    }
+    
+    // 不显示上一首的歌词，并让上一首的歌词线程停止；下载中的歌词在解析时被丢弃
+    {
+        std::lock_guard<std::mutex> lock(lyrics_mutex_);
+        is_lyric_running_ = false;
+        lyrics_.clear();
+        current_lyric_index_ = -1;
+    }
+    // 回收上一个歌词线程可能要等它的HTTP请求返回，交给主循环去做，解码不等待
+    if (display_mode_ == DISPLAY_MODE_LYRICS && !track.lyric_url.empty()) {
+        Application::GetInstance().Schedule([this, lyric_url = track.lyric_url]() {
+            // 轮到主循环执行时可能已经又换了歌或停止了播放
+            {
+                std::lock_guard<std::mutex> lock(track_mutex_);
+                if (!is_playing_ || current_lyric_url_ != lyric_url) {
+                    return;
+                }
+            }
+            StartLyricThread(lyric_url);
+        });
+    }
+    streaming_track_ = std::move(track);
+}
 
 std::string Esp32Music::GetDownloadResult() {
     return last_downloaded_data_;
@@ -440,6 +678,14 @@ std::string Esp32Music::GetDownloadResult() {
 
 // 开始流式播放
 bool Esp32Music::StartStreaming(const std::string& music_url) {
+    return StartStreamingAt(music_url, 0, 0);
+}
+
+// 从文件中的 start_offset 字节处开始流式播放，start_time_ms 为该位置对应的播放时间
+bool Esp32Music::StartStreamingAt(const std::string& music_url, size_t start_offset, int64_t start_time_ms) {
+    // 请求歌曲详情留下的连接只用于刚解析出的这首歌，其他情况（包括下面提前返回）都丢弃
+    std::unique_ptr<Http> connection = std::move(handoff_http_);
+    
     if (music_url.empty()) {
         ESP_LOGE(TAG, "Music URL is empty");
         return false;
@@ -447,28 +693,53 @@ bool Esp32Music::StartStreaming(const std::string& music_url) {
     
     ESP_LOGD(TAG, "Starting streaming for URL: %s", music_url.c_str());
     
-    // 停止之前的播放和下载
-    is_downloading_ = false;
-    is_playing_ = false;
+    // 停止之前的播放和下载，跳转或换歌后从播放状态开始
+    JoinStreamThreads();
+    device_allows_music_ = CanPlayInState(Application::GetInstance().GetDeviceState());
+    if (connection && (start_offset != 0 || music_url != streaming_track_.audio_url)) {
+        connection.reset();
+    }
     
-    // 等待之前的线程完全结束
-    if (download_thread_.joinable()) {
-        {
-            std::lock_guard<std::mutex> lock(buffer_mutex_);
-            buffer_cv_.notify_all();  // 通知线程退出
-        }
-        download_thread_.join();
+    // 丢弃输出队列中尚未播放的旧位置的音频
+    auto& audio_service = Application::GetInstance().GetAudioService();
+    audio_service.ClearMusicQueue();
+    
+    // 环形缓冲区只分配一次，之后的歌曲复用同一块内存
+    if (!stream_buffer_) {
+        stream_buffer_ = std::make_unique<StreamRingBuffer>(MAX_BUFFER_SIZE, Mp3FrameScanner::SCAN_WINDOW);
     }
-    if (play_thread_.joinable()) {
-        {
-            std::lock_guard<std::mutex> lock(buffer_mutex_);
-            buffer_cv_.notify_all();  // 通知线程退出
-        }
-        play_thread_.join();
+    if (!stream_buffer_->valid()) {
+        ESP_LOGE(TAG, "Audio stream buffer is not available");
+        return false;
     }
     
-    // 清空缓冲区
+    // 清空缓冲区，尚未播放到的预取歌曲放回播放列表
     ClearAudioBuffer();
+    RequeuePrefetchedTracks();
+    
+    stream_start_offset_ = start_offset;
+    stream_start_play_ms_ = start_time_ms;
+    {
+        std::lock_guard<std::mutex> lock(seek_mutex_);
+        if (start_offset == 0) {
+            // 新的一首歌，重新建立定位信息
+            seek_index_.clear();
+            decoder_start_offset_ = 0;
+        } else if (decoder_) {
+            // 跳转：丢弃解码器中上一位置的状态，保留已经解析出的流信息
+            decoder_->Restart(start_offset - decoder_start_offset_);
+        }
+    }
+    
+    // 新的数据流重新统计，已学到的网络状况保留
+    buffer_policy_.BeginStream();
+    stream_start_time_us_ = request_start_time_us_ != 0 ? request_start_time_us_ : esp_timer_get_time();
+    request_start_time_us_ = 0;
+    time_to_first_audio_ms_ = -1;
+    time_to_first_byte_ms_ = -1;
+    auto output_stats = audio_service.GetMusicQueueStatistics();
+    output_underruns_at_start_ = output_stats.underruns;
+    output_waits_at_start_ = output_stats.producer_waits;
     
     // 配置线程栈大小以避免栈溢出
     esp_pthread_cfg_t cfg = esp_pthread_get_default_config();
@@ -479,7 +750,12 @@ bool Esp32Music::StartStreaming(const std::string& music_url) {
     
     // 开始下载线程
     is_downloading_ = true;
-    download_thread_ = std::thread(&Esp32Music::DownloadAudioStream, this, music_url);
+    // 直接传入URL时没有歌名，无法写入缓存
+    TrackInfo track = streaming_track_;
+    if (track.audio_url != music_url) {
+        track = {"", "", music_url, ""};
+    }
+    download_thread_ = std::thread(&Esp32Music::DownloadAudioStream, this, track, std::move(connection), start_offset);
     
     // 开始播放线程（会等待缓冲区有足够数据）
     is_playing_ = true;
@@ -490,16 +766,161 @@ bool Esp32Music::StartStreaming(const std::string& music_url) {
     return true;
 }
 
+// 跳转到当前歌曲的指定位置：把时间映射为字节偏移，用 Range 请求从该处重新开始下载
+bool Esp32Music::Seek(int position_ms) {
+    std::string music_url;
+    {
+        std::lock_guard<std::mutex> lock(track_mutex_);
+        music_url = current_music_url_;
+    }
+    if (!is_playing_ || music_url.empty()) {
+        ESP_LOGW(TAG, "No song is playing, cannot seek");
+        return false;
+    }
+    if (position_ms < 0) {
+        position_ms = 0;
+    }
+    
+    size_t offset = 0;
+    int64_t start_ms = position_ms;
+    {
+        std::lock_guard<std::mutex> lock(seek_mutex_);
+        // 已播放过的部分优先使用播放时记录的索引，位置精确到帧
+        auto it = std::upper_bound(seek_index_.begin(), seek_index_.end(), (int64_t)position_ms,
+            [](int64_t time_ms, const SeekPoint& point) { return time_ms < point.time_ms; });
+        if (it != seek_index_.begin() && position_ms - std::prev(it)->time_ms <= 2 * SEEK_INDEX_INTERVAL_MS) {
+            offset = std::prev(it)->file_offset;
+            start_ms = std::prev(it)->time_ms;
+        } else {
+            size_t relative = 0;
+            if (!decoder_ || !decoder_->TimeToOffset(position_ms, &relative)) {
+                ESP_LOGW(TAG, "Cannot map %d ms to a byte offset", position_ms);
+                return false;
+            }
+            offset = decoder_start_offset_ + relative;
+        }
+    }
+    
+    ESP_LOGI(TAG, "Seeking to %lld ms at byte offset %u", start_ms, (unsigned)offset);
+    
+    // 歌词从新位置重新查找，歌名和频谱显示由新的播放线程重新开启
+    request_start_time_us_ = esp_timer_get_time();
+    current_lyric_index_ = -1;
+    song_name_displayed_ = false;
+    return StartStreamingAt(music_url, offset, start_ms);
+}
+
+// 暂停：解码器、环形缓冲区和输出队列中的数据都保留，恢复时从原处继续
+// 下载线程在缓冲区写满后停在 WaitForDownloadSpace，不再读取 socket
+bool Esp32Music::Pause() {
+    if (!is_playing_) {
+        ESP_LOGW(TAG, "No song is playing, cannot pause");
+        return false;
+    }
+    if (is_paused_) {
+        return true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(playback_gate_mutex_);
+        is_paused_ = true;
+        pause_count_++;
+    }
+    Application::GetInstance().GetAudioService().PauseMusic(true);
+    ESP_LOGI(TAG, "Music paused at %lld ms", current_play_time_ms_);
+    
+    std::string song_name;
+    {
+        std::lock_guard<std::mutex> lock(track_mutex_);
+        song_name = current_song_name_;
+    }
+    auto display = Board::GetInstance().GetDisplay();
+    if (display && !song_name.empty()) {
+        std::string formatted_song_name = "《" + song_name + "》已暂停";
+        display->SetMusicInfo(formatted_song_name.c_str());
+    }
+    return true;
+}
+
+bool Esp32Music::Resume() {
+    if (!is_playing_ || !is_paused_) {
+        ESP_LOGW(TAG, "Music is not paused, cannot resume");
+        return false;
+    }
+    // 输出队列中已经有解码好的音频，先让它出声，再唤醒播放线程继续解码
+    Application::GetInstance().GetAudioService().PauseMusic(false);
+    {
+        std::lock_guard<std::mutex> lock(playback_gate_mutex_);
+        is_paused_ = false;
+    }
+    playback_gate_cv_.notify_all();
+    song_name_displayed_ = false;  // 由播放线程恢复“播放中”的显示
+    ESP_LOGI(TAG, "Music resumed at %lld ms", current_play_time_ms_);
+    return true;
+}
+
+// 通知上一个数据流的下载和播放线程退出，并等待它们结束
+void Esp32Music::JoinStreamThreads() {
+    is_downloading_ = false;
+    is_playing_ = false;
+    // 清除暂停：暂停中的播放线程可能正等在已满的输出队列上
+    ClearPause();
+    if (stream_buffer_) {
+        stream_buffer_->Close();  // 唤醒在缓冲区上等待的线程，让其退出
+    }
+    if (download_thread_.joinable()) {
+        download_thread_.join();
+    }
+    if (play_thread_.joinable()) {
+        play_thread_.join();
+    }
+}
+
+// 清除暂停状态并唤醒等待中的播放线程（停止或重新开始数据流时调用）
+void Esp32Music::ClearPause() {
+    {
+        std::lock_guard<std::mutex> lock(playback_gate_mutex_);
+        is_paused_ = false;
+    }
+    playback_gate_cv_.notify_all();
+    Application::GetInstance().GetAudioService().PauseMusic(false);
+}
+
+// 让等待中的播放线程重新检查 is_playing_ 等条件
+void Esp32Music::WakePlayThread() {
+    {
+        std::lock_guard<std::mutex> lock(playback_gate_mutex_);
+    }
+    playback_gate_cv_.notify_all();
+}
+
+// 在事件循环任务中调用，只更新标志并唤醒播放线程
+void Esp32Music::OnDeviceStateChanged(DeviceState previous_state, DeviceState current_state) {
+    bool allowed = CanPlayInState(current_state);
+    if (allowed == device_allows_music_) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(playback_gate_mutex_);
+        device_allows_music_ = allowed;
+    }
+    playback_gate_cv_.notify_all();
+    if (is_playing_) {
+        ESP_LOGI(TAG, "Device state %d -> %d, music playback %s", previous_state, current_state,
+                allowed ? "allowed" : "held");
+    }
+}
+
 // 停止流式播放
 bool Esp32Music::StopStreaming() {
     ESP_LOGI(TAG, "Stopping music streaming - current state: downloading=%d, playing=%d", 
             is_downloading_.load(), is_playing_.load());
 
-    // 重置采样率到原始值
-    ResetSampleRate();
+    // 立即停止出声，不等播放线程退出
+    auto& audio_service = Application::GetInstance().GetAudioService();
+    audio_service.ClearMusicQueue();
     
-    // 检查是否有流式播放正在进行
-    if (!is_playing_ && !is_downloading_) {
+    // 检查是否有流式播放正在进行。Download 可能已经发出停止信号，线程还没有回收
+    if (!is_playing_ && !is_downloading_ && !download_thread_.joinable() && !play_thread_.joinable()) {
         ESP_LOGW(TAG, "No streaming in progress");
         return true;
     }
@@ -507,6 +928,7 @@ bool Esp32Music::StopStreaming() {
     // 停止下载和播放标志
     is_downloading_ = false;
     is_playing_ = false;
+    ClearPause();
     
     // 清空歌名显示
     auto& board = Board::GetInstance();
@@ -516,10 +938,9 @@ bool Esp32Music::StopStreaming() {
         ESP_LOGI(TAG, "Cleared song name display");
     }
     
-    // 通知所有等待的线程
-    {
-        std::lock_guard<std::mutex> lock(buffer_mutex_);
-        buffer_cv_.notify_all();
+    // 唤醒所有在缓冲区上等待的线程
+    if (stream_buffer_) {
+        stream_buffer_->Close();
     }
     
     // 等待线程结束（避免重复代码，让StopStreaming也能等待线程完全停止）
@@ -533,12 +954,6 @@ bool Esp32Music::StopStreaming() {
         // 先设置停止标志
         is_playing_ = false;
         
-        // 通知条件变量，确保线程能够退出
-        {
-            std::lock_guard<std::mutex> lock(buffer_mutex_);
-            buffer_cv_.notify_all();
-        }
-        
         // 使用超时机制等待线程结束，避免死锁
         bool thread_finished = false;
         int wait_count = 0;
@@ -566,154 +981,336 @@ bool Esp32Music::StopStreaming() {
         }
     }
     
-    // 在线程完全结束后，只在频谱模式下停止FFT显示
-    if (display && display_mode_ == DISPLAY_MODE_SPECTRUM) {
-        display->stopFft();
-        ESP_LOGI(TAG, "Stopped FFT display in StopStreaming (spectrum mode)");
-    } else if (display) {
-        ESP_LOGI(TAG, "Not in spectrum mode, skipping FFT stop in StopStreaming");
+    // 播放线程退出前可能又送入了一帧
+    audio_service.ClearMusicQueue();
+    
+    // 在线程完全结束后，只在频谱模式下停止FFT显示
+    if (display && display_mode_ == DISPLAY_MODE_SPECTRUM) {
+        display->stopFft();
+        ESP_LOGI(TAG, "Stopped FFT display in StopStreaming (spectrum mode)");
+    } else if (display) {
+        ESP_LOGI(TAG, "Not in spectrum mode, skipping FFT stop in StopStreaming");
+    }
+    
+    ESP_LOGI(TAG, "Music streaming stop signal sent");
+    return true;
+}
+
+// 流式下载音频数据
+// 当前歌曲下载完成后，如果播放列表中还有歌曲，就把下一首接着写进同一个环形缓冲区，
+// 并记录两首歌的边界位置，播放线程播到边界时切换歌曲信息，中间没有停顿
+void Esp32Music::DownloadAudioStream(TrackInfo track, std::unique_ptr<Http> connection, size_t start_offset) {
+    while (DownloadTrack(track, connection, start_offset)) {
+        start_offset = 0;
+        TrackInfo next;
+        if (!TakeNextTrack(&next)) {
+            // 播放列表为空：在缓冲区中的数据快播完之前，仍然可以无缝接上新加入的歌曲
+            std::unique_lock<std::mutex> lock(playlist_mutex_);
+            while (playlist_.empty() && is_downloading_ && is_playing_ &&
+                   stream_buffer_->size() > GAPLESS_HANDOFF_SIZE) {
+                playlist_cv_.wait_for(lock, std::chrono::milliseconds(200));
+            }
+            bool has_next = !playlist_.empty();
+            lock.unlock();
+            if (!has_next || !TakeNextTrack(&next)) {
+                break;
+            }
+        }
+        
+        ESP_LOGI(TAG, "Prefetching next song: %s", next.song_name.c_str());
+        {
+            std::lock_guard<std::mutex> lock(playlist_mutex_);
+            track_boundaries_.push_back({stream_buffer_->write_position(), next});
+        }
+        track = std::move(next);
+    }
+    
+    is_downloading_ = false;
+    
+    // 标记数据流结束，通知播放线程把剩余数据播完
+    stream_buffer_->Close();
+    
+    ESP_LOGI(TAG, "Audio stream download thread finished");
+}
+
+// 等待缓冲区空出能写入一个块的空间；缓冲区被关闭时返回false
+bool Esp32Music::WaitForDownloadSpace() {
+    // 缓冲区满时，等消费者读走一段后再被唤醒，避免每读一个块就切换一次线程
+    if (stream_buffer_->free_space() < DOWNLOAD_CHUNK_SIZE) {
+        // 等待期间（包括暂停）没有读取网络，不计入吞吐
+        buffer_policy_.PauseMeasurement();
+        bool open = stream_buffer_->WaitForSpace(WRITE_WATERMARK);
+        buffer_policy_.ResumeMeasurement();
+        return open;
+    }
+    return !stream_buffer_->closed();
+}
+
+// 从闪存缓存读取一首歌到环形缓冲区，完整读完返回true
+bool Esp32Music::StreamFromCache(const SongCache::Entry& entry, size_t start_offset) {
+    FILE* file = song_cache_->OpenForRead(entry);
+    if (file == nullptr) {
+        return false;
     }
+    if (start_offset > 0 && fseek(file, start_offset, SEEK_SET) != 0) {
+        fclose(file);
+        return false;
+    }
+    ESP_LOGI(TAG, "Playing from cache: %s (%u bytes)", entry.song_name.c_str(), (unsigned)entry.size);
+    song_cache_->Touch(entry);
+    
+    size_t total_read = start_offset;
+    while (is_downloading_ && is_playing_ && WaitForDownloadSpace()) {
+        uint8_t* write_ptr = nullptr;
+        size_t writable = std::min(stream_buffer_->PrepareWrite(&write_ptr), DOWNLOAD_CHUNK_SIZE);
+        if (writable == 0) {
+            continue;
+        }
+        size_t bytes_read = fread(write_ptr, 1, writable, file);
+        if (bytes_read == 0) {
+            break;
+        }
+        stream_buffer_->CommitWrite(bytes_read);
+        total_read += bytes_read;
+    }
+    fclose(file);
     
-    ESP_LOGI(TAG, "Music streaming stop signal sent");
-    return true;
+    if (total_read != entry.size && is_downloading_ && is_playing_) {
+        ESP_LOGW(TAG, "Cached song read incomplete: %u / %u bytes", (unsigned)total_read, (unsigned)entry.size);
+        return false;
+    }
+    return is_downloading_ && is_playing_;
 }
 
-// 流式下载音频数据
-void Esp32Music::DownloadAudioStream(const std::string& music_url) {
+// 下载一首歌到环形缓冲区，完整下载返回true
+// 连接中断时用 Range 请求从已下载的位置继续，重连期间播放线程继续消耗环形缓冲区中的数据。
+// 有歌名的歌曲会同时写入闪存缓存，完整下载后提交
+// connection 不为空时先复用这个连接，完整下载后把连接留给下一首
+bool Esp32Music::DownloadTrack(const TrackInfo& track, std::unique_ptr<Http>& connection, size_t start_offset) {
+    const std::string& music_url = track.audio_url;
     ESP_LOGD(TAG, "Starting audio stream download from: %s", music_url.c_str());
     
+    SongCache::Entry cached;
+    if (song_cache_ && !track.song_name.empty() &&
+        song_cache_->Lookup(track.song_name, track.artist_name, &cached) && cached.audio_url == music_url) {
+        return StreamFromCache(cached, start_offset);
+    }
+    
     // 验证URL有效性
     if (music_url.empty() || music_url.find("http") != 0) {
         ESP_LOGE(TAG, "Invalid URL format: %s", music_url.c_str());
-        is_downloading_ = false;
-        return;
+        return false;
     }
     
     auto network = Board::GetInstance().GetNetwork();
-    auto http = network->CreateHttp(0);
-    
-    // 设置基本请求头
-    http->SetHeader("User-Agent", "ESP32-Music-Player/1.0");
-    http->SetHeader("Accept", "*/*");
-    http->SetHeader("Range", "bytes=0-");  // 支持断点续传
-    
-    // 添加ESP32认证头
-    add_auth_headers(http.get());
-    
-    if (!http->Open("GET", music_url)) {
-        ESP_LOGE(TAG, "Failed to connect to music stream URL");
-        is_downloading_ = false;
-        return;
-    }
-    
-    int status_code = http->GetStatusCode();
-    if (status_code != 200 && status_code != 206) {  // 206 for partial content
-        ESP_LOGE(TAG, "HTTP GET failed with status code: %d", status_code);
-        http->Close();
-        is_downloading_ = false;
-        return;
-    }
-    
-    ESP_LOGI(TAG, "Started downloading audio stream, status: %d", status_code);
     
-    // 分块读取音频数据
-    const size_t chunk_size = 4096;  // 4KB每块
-    char buffer[chunk_size];
-    size_t total_downloaded = 0;
+    size_t total_downloaded = start_offset;  // 跳转时从文件中间开始
+    size_t expected_total = 0;  // 文件总长度，0表示服务器没有告知
+    bool completed = false;
+    bool caching = false;
+    int retry_count = 0;        // 连续失败的重连次数，成功收到数据后清零
     
     while (is_downloading_ && is_playing_) {
-        int bytes_read = http->Read(buffer, chunk_size);
-        if (bytes_read < 0) {
-            ESP_LOGE(TAG, "Failed to read audio data: error code %d", bytes_read);
-            break;
-        }
-        if (bytes_read == 0) {
-            ESP_LOGI(TAG, "Audio stream download completed, total: %d bytes", total_downloaded);
-            break;
+        if (retry_count > 0) {
+            // 指数退避，期间每100ms检查一次是否已被停止
+            int delay_ms = std::min(DOWNLOAD_RETRY_BASE_DELAY_MS << (retry_count - 1), DOWNLOAD_RETRY_MAX_DELAY_MS);
+            ESP_LOGW(TAG, "Reconnecting audio stream in %d ms (attempt %d/%d, resume at %u bytes)",
+                    delay_ms, retry_count, MAX_DOWNLOAD_RETRIES, (unsigned)total_downloaded);
+            for (int waited = 0; waited < delay_ms && is_downloading_ && is_playing_; waited += 100) {
+                vTaskDelay(pdMS_TO_TICKS(100));
+            }
+            if (!is_downloading_ || !is_playing_) {
+                break;
+            }
         }
         
-        // 打印数据块信息
-        // ESP_LOGI(TAG, "Downloaded chunk: %d bytes at offset %d", bytes_read, total_downloaded);
+        // 优先复用请求歌曲详情（或上一首歌）时的 keep-alive 连接，省去一次建连
+        bool reused = connection != nullptr;
+        std::unique_ptr<Http> http = reused ? std::move(connection) : network->CreateHttp(0);
         
-        // 安全地打印数据块的十六进制内容（前16字节）
-        if (bytes_read >= 16) {
-            // ESP_LOGI(TAG, "Data: %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X ...", 
-            //         (unsigned char)buffer[0], (unsigned char)buffer[1], (unsigned char)buffer[2], (unsigned char)buffer[3],
-            //         (unsigned char)buffer[4], (unsigned char)buffer[5], (unsigned char)buffer[6], (unsigned char)buffer[7],
-            //         (unsigned char)buffer[8], (unsigned char)buffer[9], (unsigned char)buffer[10], (unsigned char)buffer[11],
-            //         (unsigned char)buffer[12], (unsigned char)buffer[13], (unsigned char)buffer[14], (unsigned char)buffer[15]);
-        } else {
-            ESP_LOGI(TAG, "Data chunk too small: %d bytes", bytes_read);
-        }
+        // 设置基本请求头，从已下载的位置继续
+        http->SetHeader("User-Agent", "ESP32-Music-Player/1.0");
+        http->SetHeader("Accept", "*/*");
+        http->SetHeader("Connection", "keep-alive");
+        http->SetHeader("Range", "bytes=" + std::to_string(total_downloaded) + "-");
         
-        // 尝试检测文件格式（检查文件头）
-        if (total_downloaded == 0 && bytes_read >= 4) {
-            if (memcmp(buffer, "ID3", 3) == 0) {
-                ESP_LOGI(TAG, "Detected MP3 file with ID3 tag");
-            } else if (buffer[0] == 0xFF && (buffer[1] & 0xE0) == 0xE0) {
-                ESP_LOGI(TAG, "Detected MP3 file header");
-            } else if (memcmp(buffer, "RIFF", 4) == 0) {
-                ESP_LOGI(TAG, "Detected WAV file");
-            } else if (memcmp(buffer, "fLaC", 4) == 0) {
-                ESP_LOGI(TAG, "Detected FLAC file");
-            } else if (memcmp(buffer, "OggS", 4) == 0) {
-                ESP_LOGI(TAG, "Detected OGG file");
-            } else {
-                ESP_LOGI(TAG, "Unknown audio format, first 4 bytes: %02X %02X %02X %02X", 
-                        (unsigned char)buffer[0], (unsigned char)buffer[1], 
-                        (unsigned char)buffer[2], (unsigned char)buffer[3]);
+        // 添加ESP32认证头
+        add_auth_headers(http.get());
+        
+        if (!http->Open("GET", music_url)) {
+            if (reused) {
+                // 服务器可能已经关闭了空闲连接，立即换新连接重试，不计入重连次数
+                ESP_LOGW(TAG, "Reused connection failed, opening a new one");
+                continue;
+            }
+            ESP_LOGE(TAG, "Failed to connect to music stream URL");
+            if (++retry_count > MAX_DOWNLOAD_RETRIES) {
+                break;
             }
+            continue;
         }
         
-        // 创建音频数据块
-        uint8_t* chunk_data = (uint8_t*)heap_caps_malloc(bytes_read, MALLOC_CAP_SPIRAM);
-        if (!chunk_data) {
-            ESP_LOGE(TAG, "Failed to allocate memory for audio chunk");
+        int pause_count_at_open = pause_count_;
+        int status_code = http->GetStatusCode();
+        if (status_code == 416 && expected_total > 0 && total_downloaded >= expected_total) {
+            // 断开时恰好已经下载完整个文件
+            http->Close();
+            completed = true;
             break;
         }
-        memcpy(chunk_data, buffer, bytes_read);
+        if (status_code != 200 && status_code != 206) {  // 206 for partial content
+            ESP_LOGE(TAG, "HTTP GET failed with status code: %d", status_code);
+            http->Close();
+            // 4xx 是请求本身的问题，重试也不会成功
+            if ((status_code >= 400 && status_code < 500) || ++retry_count > MAX_DOWNLOAD_RETRIES) {
+                break;
+            }
+            continue;
+        }
         
-        // 等待缓冲区有空间
-        {
-            std::unique_lock<std::mutex> lock(buffer_mutex_);
-            buffer_cv_.wait(lock, [this] { return buffer_size_ < MAX_BUFFER_SIZE || !is_downloading_; });
+        // 服务器忽略了Range请求时会从头发送，需要丢弃已经下载过的部分
+        size_t skip_bytes = (status_code == 200) ? total_downloaded : 0;
+        size_t body_length = http->GetBodyLength();
+        if (body_length > 0) {
+            expected_total = (status_code == 206) ? total_downloaded + body_length : body_length;
+        }
+        
+        if (total_downloaded == start_offset) {
+            ESP_LOGI(TAG, "Started downloading audio stream at %u, status: %d, length: %u",
+                    (unsigned)start_offset, status_code, (unsigned)expected_total);
+            // 只缓存从头开始的完整下载
+            if (start_offset == 0 && song_cache_ && !track.song_name.empty() && !song_cache_->writing()) {
+                SongCache::Entry meta;
+                meta.song_name = track.song_name;
+                meta.artist_name = track.artist_name;
+                meta.audio_url = track.audio_url;
+                meta.lyric_url = track.lyric_url;
+                caching = song_cache_->BeginWrite(meta, expected_total);
+            }
+        } else {
+            ESP_LOGI(TAG, "Resumed audio stream at %u bytes, status: %d", (unsigned)total_downloaded, status_code);
+        }
+        
+        // 分块读取音频数据，直接读入环形缓冲区，不再为每个块单独分配内存
+        bool interrupted = false;
+        while (is_downloading_ && is_playing_) {
+            if (!WaitForDownloadSpace()) {
+                break;  // 缓冲区已关闭，停止下载
+            }
             
-            if (is_downloading_) {
-                audio_buffer_.push(AudioChunk(chunk_data, bytes_read));
-                buffer_size_ += bytes_read;
-                total_downloaded += bytes_read;
-                
-                // 通知播放线程有新数据
-                buffer_cv_.notify_one();
-                
-                if (total_downloaded % (256 * 1024) == 0) {  // 每256KB打印一次进度
-                    ESP_LOGI(TAG, "Downloaded %d bytes, buffer size: %d", total_downloaded, buffer_size_);
+            uint8_t* write_ptr = nullptr;
+            size_t writable = std::min(stream_buffer_->PrepareWrite(&write_ptr), DOWNLOAD_CHUNK_SIZE);
+            if (writable == 0) {
+                continue;
+            }
+            if (skip_bytes > 0) {
+                // 读进尚未提交的空间再丢弃，不需要额外的临时缓冲区
+                writable = std::min(writable, skip_bytes);
+            }
+            
+            int bytes_read = http->Read((char*)write_ptr, writable);
+            if (bytes_read < 0) {
+                ESP_LOGE(TAG, "Failed to read audio data: error code %d", bytes_read);
+                interrupted = true;
+                break;
+            }
+            if (bytes_read == 0) {
+                if (skip_bytes > 0 || (expected_total > 0 && total_downloaded < expected_total)) {
+                    // 连接提前关闭，数据还没收完
+                    ESP_LOGW(TAG, "Audio stream closed early at %u of %u bytes",
+                            (unsigned)total_downloaded, (unsigned)expected_total);
+                    interrupted = true;
+                } else {
+                    ESP_LOGI(TAG, "Audio stream download completed, total: %d bytes", total_downloaded);
+                    completed = true;
                 }
-            } else {
-                heap_caps_free(chunk_data);
                 break;
             }
+            retry_count = 0;
+            
+            if (skip_bytes > 0) {
+                skip_bytes -= bytes_read;
+                continue;
+            }
+            
+            if (bytes_read < 16) {
+                ESP_LOGI(TAG, "Data chunk too small: %d bytes", bytes_read);
+            }
+            
+            // 尝试检测文件格式（检查文件头）
+            if (total_downloaded == 0 && bytes_read >= 4) {
+                // 播放线程在跳过ID3标签之后再次识别格式并选择解码器
+                MusicFormat format = SniffMusicFormat(write_ptr, bytes_read);
+                if (memcmp(write_ptr, "ID3", 3) == 0) {
+                    ESP_LOGI(TAG, "Detected file with ID3 tag");
+                } else if (format != MusicFormat::kUnknown) {
+                    ESP_LOGI(TAG, "Detected %s file", MusicFormatName(format));
+                } else {
+                    ESP_LOGI(TAG, "Unknown audio format, first 4 bytes: %02X %02X %02X %02X", 
+                            write_ptr[0], write_ptr[1], write_ptr[2], write_ptr[3]);
+                }
+            }
+            
+            // 提交数据，只有在播放线程等待且数据越过其水位时才会唤醒它
+            stream_buffer_->CommitWrite(bytes_read);
+            total_downloaded += bytes_read;
+            buffer_policy_.OnDataReceived(bytes_read);
+            if (time_to_first_byte_ms_ < 0) {
+                time_to_first_byte_ms_ = (esp_timer_get_time() - stream_start_time_us_) / 1000;
+                ESP_LOGI(TAG, "Time to first audio byte: %lld ms", time_to_first_byte_ms_.load());
+            }
+            
+            // 提交后这段数据只会被播放线程读取，不会被改写，可以直接写入缓存
+            if (caching) {
+                caching = song_cache_->Append(write_ptr, bytes_read);
+            }
+            
+            if (total_downloaded % (256 * 1024) == 0) {  // 每256KB打印一次进度
+                ESP_LOGI(TAG, "Downloaded %d bytes, buffer size: %d, throughput: %u B/s",
+                        total_downloaded, stream_buffer_->size(), (unsigned)buffer_policy_.throughput_bps());
+            }
+        }
+        
+        if (completed) {
+            connection = std::move(http);
+        } else {
+            http->Close();
+        }
+        
+        if (!interrupted) {
+            break;  // 下载完成或被停止
+        }
+        if (pause_count_ != pause_count_at_open) {
+            // 暂停期间不读取数据，服务器关闭了空闲连接：缓冲区里还有数据，立即用 Range 请求续传
+            ESP_LOGI(TAG, "Connection closed while paused, resuming at %u bytes", (unsigned)total_downloaded);
+            retry_count = 0;
+            continue;
+        }
+        if (++retry_count > MAX_DOWNLOAD_RETRIES) {
+            ESP_LOGE(TAG, "Giving up audio stream after %d reconnect attempts", MAX_DOWNLOAD_RETRIES);
+            break;
         }
     }
     
-    http->Close();
-    is_downloading_ = false;
-    
-    // 通知播放线程下载完成
-    {
-        std::lock_guard<std::mutex> lock(buffer_mutex_);
-        buffer_cv_.notify_all();
+    if (!completed && is_downloading_ && is_playing_) {
+        ESP_LOGW(TAG, "Audio stream download ended early, total: %u bytes", (unsigned)total_downloaded);
     }
-    
-    ESP_LOGI(TAG, "Audio stream download thread finished");
+    if (caching) {
+        if (completed) {
+            song_cache_->CommitWrite();
+        } else {
+            song_cache_->AbortWrite();
+        }
+    }
+    return completed && is_downloading_ && is_playing_;
 }
 
 // 流式播放音频数据
 void Esp32Music::PlayAudioStream() {
     ESP_LOGI(TAG, "Starting audio stream playback");
     
-    // 初始化时间跟踪变量
-    current_play_time_ms_ = 0;
+    // 初始化时间跟踪变量，跳转时从目标位置开始计时
+    current_play_time_ms_ = stream_start_play_ms_;
     last_frame_time_ms_ = 0;
     total_frames_decoded_ = 0;
     
@@ -724,71 +1321,52 @@ void Esp32Music::PlayAudioStream() {
         return;
     }
     
-    if (!mp3_decoder_initialized_) {
-        ESP_LOGE(TAG, "MP3 decoder not initialized");
-        is_playing_ = false;
-        return;
-    }
-    
-    
-    // 等待缓冲区有足够数据开始播放
-    {
-        std::unique_lock<std::mutex> lock(buffer_mutex_);
-        buffer_cv_.wait(lock, [this] { 
-            return buffer_size_ >= MIN_BUFFER_SIZE || (!is_downloading_ && !audio_buffer_.empty()); 
-        });
-    }
-    
     ESP_LOGI(TAG, "小智开源音乐固件qq交流群:826072986");
-    ESP_LOGI(TAG, "Starting playback with buffer size: %d", buffer_size_);
     
     size_t total_played = 0;
-    uint8_t* mp3_input_buffer = nullptr;
-    int bytes_left = 0;
-    uint8_t* read_ptr = nullptr;
-    
-    // 分配MP3输入缓冲区
-    mp3_input_buffer = (uint8_t*)heap_caps_malloc(8192, MALLOC_CAP_SPIRAM);
-    if (!mp3_input_buffer) {
-        ESP_LOGE(TAG, "Failed to allocate MP3 input buffer");
-        is_playing_ = false;
-        return;
-    }
-    
-    // 标记是否已经处理过ID3标签
-    bool id3_processed = false;
+    size_t id3_remaining = 0;     // ID3标签中尚未跳过的字节数
+    
+    // 标记是否已经处理过ID3标签（从文件中间开始时没有ID3标签）
+    bool id3_processed = stream_start_offset_ > 0;
+    // 本首歌是否已经识别出格式、准备好解码器（跳转时沿用原来的解码器）
+    bool decoder_ready = stream_start_offset_ > 0 && decoder_ != nullptr;
+    // 解码输出，交错的各声道样本
+    std::vector<int16_t> pcm;
+    pcm.reserve(Mp3MusicDecoder::MAX_FRAME_SAMPLES);
+    // 新的数据流（包括跳转）与之前播放的音频不连续，丢弃转换器的跨帧状态
+    pcm_converter_.Reset();
+    output_frame_.reserve(OUTPUT_FRAME_RESERVE);
+    // 用于把环形缓冲区中的位置换算为本首歌文件中的偏移
+    size_t track_ring_start = 0;
+    size_t track_file_base = stream_start_offset_;
+    // 预缓冲中：开始播放前以及每次欠载后，攒够缓冲策略要求的数据量才开始解码
+    bool buffering = true;
+    // 是否正常播放到了数据流末尾（而不是被停止）
+    bool reached_end = false;
     
     while (is_playing_) {
-        // 检查设备状态，只有在空闲状态才播放音乐
-        auto& app = Application::GetInstance();
-        DeviceState current_state = app.GetDeviceState();
-        
-        // 状态转换：说话中-》聆听中-》待机状态-》播放音乐
-        if (current_state == kDeviceStateListening || current_state == kDeviceStateSpeaking) {
-            if (current_state == kDeviceStateSpeaking) {
-                ESP_LOGI(TAG, "Device is in speaking state, switching to listening state for music playback");
-            }
-            if (current_state == kDeviceStateListening) {
-                ESP_LOGI(TAG, "Device is in listening state, switching to idle state for music playback");
-            }
-            // 切换状态
-            app.ToggleChatState(); // 变成待机状态
-            vTaskDelay(pdMS_TO_TICKS(300));
-            continue;
-        } else if (current_state != kDeviceStateIdle) { // 不是待机状态，就一直卡在这里，不让播放音乐
-            ESP_LOGD(TAG, "Device state is %d, pausing music playback", current_state);
-            // 如果不是空闲状态，暂停播放
-            vTaskDelay(pdMS_TO_TICKS(50));
+        // 暂停或设备状态不允许播放时不解码，解码器和缓冲区保持原样，等待通知
+        if (is_paused_ || !device_allows_music_) {
+            std::unique_lock<std::mutex> lock(playback_gate_mutex_);
+            playback_gate_cv_.wait(lock, [this]() {
+                return (!is_paused_ && device_allows_music_) || !is_playing_;
+            });
             continue;
         }
+        auto& app = Application::GetInstance();
         
         // 设备状态检查通过，显示当前播放的歌名
-        if (!song_name_displayed_ && !current_song_name_.empty()) {
+        std::string song_name;
+        if (!song_name_displayed_) {
+            std::lock_guard<std::mutex> lock(track_mutex_);
+            song_name = current_song_name_;
+        }
+        if (!song_name_displayed_ && !song_name.empty()) {
             auto& board = Board::GetInstance();
             auto display = board.GetDisplay();
             if (display) {
                 // 格式化歌名显示为《歌名》播放中...
-                std::string formatted_song_name = "《" + current_song_name_ + "》播放中...";
+                std::string formatted_song_name = "《" + song_name + "》播放中...";
                 display->SetMusicInfo(formatted_song_name.c_str());
                 ESP_LOGI(TAG, "Displaying song name: %s", formatted_song_name.c_str());
                 song_name_displayed_ = true;
@@ -805,207 +1383,253 @@ void Esp32Music::PlayAudioStream() {
             }
         }
         
-        // 如果需要更多MP3数据，从缓冲区读取
-        if (bytes_left < 4096) {  // 保持至少4KB数据用于解码
-            AudioChunk chunk;
-            
-            // 从缓冲区获取音频数据
-            {
-                std::unique_lock<std::mutex> lock(buffer_mutex_);
-                if (audio_buffer_.empty()) {
-                    if (!is_downloading_) {
-                        // 下载完成且缓冲区为空，播放结束
-                        ESP_LOGI(TAG, "Playback finished, total played: %d bytes", total_played);
-                        break;
-                    }
-                    // 等待新数据
-                    buffer_cv_.wait(lock, [this] { return !audio_buffer_.empty() || !is_downloading_; });
-                    if (audio_buffer_.empty()) {
-                        continue;
-                    }
+        // 播放到了播放列表中下一首歌的起始位置：切换歌曲信息，重新处理ID3标签
+        size_t bytes_to_boundary = SIZE_MAX;
+        {
+            std::lock_guard<std::mutex> lock(playlist_mutex_);
+            if (!track_boundaries_.empty()) {
+                bytes_to_boundary = track_boundaries_.front().position - stream_buffer_->read_position();
+            }
+        }
+        if (bytes_to_boundary == 0) {
+            SwitchToNextTrack();
+            id3_processed = false;
+            id3_remaining = 0;
+            decoder_ready = false;
+            track_ring_start = stream_buffer_->read_position();
+            track_file_base = 0;
+            continue;
+        }
+        
+        // 跳过文件开头的ID3标签（标签可能比当前缓冲的数据还长）
+        if (!id3_processed || id3_remaining > 0) {
+            bool end_of_stream = stream_buffer_->closed();
+            if (!id3_processed && stream_buffer_->size() < 10 && !end_of_stream) {
+                stream_buffer_->WaitForData(10);
+                continue;
+            }
+            if (!id3_processed) {
+                const uint8_t* head = nullptr;
+                size_t head_size = stream_buffer_->PeekLinear(&head, 10);
+                if (head_size >= 10) {
+                    id3_remaining = SkipId3Tag(head, head_size);
                 }
-                
-                chunk = audio_buffer_.front();
-                audio_buffer_.pop();
-                buffer_size_ -= chunk.size;
-                
-                // 通知下载线程缓冲区有空间
-                buffer_cv_.notify_one();
+                id3_processed = true;
             }
-            
-            // 将新数据添加到MP3输入缓冲区
-            if (chunk.data && chunk.size > 0) {
-                // 移动剩余数据到缓冲区开头
-                if (bytes_left > 0 && read_ptr != mp3_input_buffer) {
-                    memmove(mp3_input_buffer, read_ptr, bytes_left);
+            if (id3_remaining > 0) {
+                size_t skip = std::min({id3_remaining, stream_buffer_->size(), bytes_to_boundary});
+                stream_buffer_->Consume(skip);
+                id3_remaining -= skip;
+                if (skip == bytes_to_boundary) {
+                    continue;  // 标签长度有误，越过了歌曲边界
                 }
-                
-                // 检查缓冲区空间
-                size_t space_available = 8192 - bytes_left;
-                size_t copy_size = std::min(chunk.size, space_available);
-                
-                // 复制新数据
-                memcpy(mp3_input_buffer + bytes_left, chunk.data, copy_size);
-                bytes_left += copy_size;
-                read_ptr = mp3_input_buffer;
-                
-                // 检查并跳过ID3标签（仅在开始时处理一次）
-                if (!id3_processed && bytes_left >= 10) {
-                    size_t id3_skip = SkipId3Tag(read_ptr, bytes_left);
-                    if (id3_skip > 0) {
-                        read_ptr += id3_skip;
-                        bytes_left -= id3_skip;
-                        ESP_LOGI(TAG, "Skipped ID3 tag: %u bytes", (unsigned int)id3_skip);
+                if (id3_remaining > 0) {
+                    if (end_of_stream) {
+                        break;
                     }
-                    id3_processed = true;
+                    stream_buffer_->WaitForData(std::min(id3_remaining, DOWNLOAD_CHUNK_SIZE));
+                    continue;
                 }
-                
-                // 释放chunk内存
-                heap_caps_free(chunk.data);
             }
         }
         
-        // 尝试找到MP3帧同步
-        int sync_offset = MP3FindSyncWord(read_ptr, bytes_left);
-        if (sync_offset < 0) {
-            ESP_LOGW(TAG, "No MP3 sync word found, skipping %d bytes", bytes_left);
-            bytes_left = 0;
-            continue;
+        // 识别本首歌的格式，选择对应的解码器
+        if (!decoder_ready) {
+            bool end_of_stream = stream_buffer_->closed();
+            const uint8_t* head = nullptr;
+            size_t head_size = std::min(stream_buffer_->PeekLinear(&head, FORMAT_SNIFF_SIZE), bytes_to_boundary);
+            if (head_size < FORMAT_SNIFF_SIZE && head_size < bytes_to_boundary && !end_of_stream) {
+                stream_buffer_->WaitForData(FORMAT_SNIFF_SIZE);
+                continue;
+            }
+            MusicFormat format = SniffMusicFormat(head, head_size);
+            if (format == MusicFormat::kUnknown) {
+                // 无法识别时按MP3处理，帧扫描器会跳过开头的无效数据
+                format = MusicFormat::kMp3;
+            }
+            
+            std::lock_guard<std::mutex> lock(seek_mutex_);
+            if (decoder_ && decoder_->format() == format) {
+                decoder_->Reset();  // 连续的同格式歌曲复用同一个解码器
+            } else {
+                decoder_ = CreateMusicDecoder(format, codec->output_sample_rate());
+            }
+            decoder_start_offset_ = track_file_base + (stream_buffer_->read_position() - track_ring_start);
+            decoder_ready = true;
+            if (decoder_) {
+                ESP_LOGI(TAG, "Decoding %s stream", MusicFormatName(format));
+            } else {
+                ESP_LOGE(TAG, "Unsupported audio format: %s, skipping song", MusicFormatName(format));
+            }
         }
         
-        // 跳过到同步位置
-        if (sync_offset > 0) {
-            read_ptr += sync_offset;
-            bytes_left -= sync_offset;
+        if (!decoder_) {
+            // 不支持的格式：丢弃本首歌剩余的数据
+            size_t skip = std::min(stream_buffer_->size(), bytes_to_boundary);
+            stream_buffer_->Consume(skip);
+            if (stream_buffer_->closed() && stream_buffer_->size() == 0) {
+                reached_end = true;
+                break;
+            }
+            if (skip == 0) {
+                stream_buffer_->WaitForData(DOWNLOAD_CHUNK_SIZE);
+            }
+            continue;
         }
         
-        // 解码MP3帧
-        int16_t pcm_buffer[2304];
-        int decode_result = MP3Decode(mp3_decoder_, &read_ptr, &bytes_left, pcm_buffer, 0);
+        // 解码器直接在环形缓冲区上解析，不再拷贝到中间缓冲区
+        bool end_of_stream = stream_buffer_->closed();
+        const uint8_t* input = nullptr;
+        size_t input_size = stream_buffer_->PeekLinear(&input, Mp3FrameScanner::SCAN_WINDOW);
+        // 不跨越歌曲边界解码，边界之前的数据按一首歌的结尾处理
+        bool at_boundary = bytes_to_boundary <= input_size;
+        if (at_boundary) {
+            input_size = bytes_to_boundary;
+        }
+        size_t input_offset = track_file_base + (stream_buffer_->read_position() - track_ring_start);
+        MusicDecoder::Result decoded;
+        {
+            // Seek() 会在其它线程读取解码器中的定位信息
+            std::lock_guard<std::mutex> lock(seek_mutex_);
+            decoded = decoder_->Decode(input, input_size, end_of_stream || at_boundary, pcm);
+        }
+        stream_buffer_->Consume(decoded.consumed);
         
-        if (decode_result == 0) {
-            // 解码成功，获取帧信息
-            MP3GetLastFrameInfo(mp3_decoder_, &mp3_frame_info_);
-            total_frames_decoded_++;
-            
-            // 基本的帧信息有效性检查，防止除零错误
-            if (mp3_frame_info_.samprate == 0 || mp3_frame_info_.nChans == 0) {
-                ESP_LOGW(TAG, "Invalid frame info: rate=%d, channels=%d, skipping", 
-                        mp3_frame_info_.samprate, mp3_frame_info_.nChans);
+        if (decoded.samples == 0) {
+            if (!decoded.need_more || decoded.consumed > 0) {
+                continue;
+            }
+            if (at_boundary) {
+                // 上一首结尾无法解码的数据直接丢弃，下一轮切换到下一首
+                stream_buffer_->Consume(input_size);
                 continue;
             }
+            if (end_of_stream) {
+                // 下载完成，剩余数据已无法继续解码，播放结束
+                ESP_LOGI(TAG, "Playback finished, total played: %d bytes", total_played);
+                reached_end = true;
+                break;
+            }
+            if (!buffering && total_frames_decoded_ > 0) {
+                // 播放过程中缓冲区被读空：记录欠载，重新预缓冲
+                buffer_policy_.OnUnderrun();
+                buffering = true;
+            }
+            // 数据不足以继续解码，等待下载线程补充
+            stream_buffer_->WaitForData(std::min(input_size + DOWNLOAD_CHUNK_SIZE, Mp3FrameScanner::SCAN_WINDOW));
+            continue;
+        }
+        
+        // 码率用于估算需要预缓冲的数据量
+        if (decoder_->bitrate_kbps() > 0) {
+            buffer_policy_.OnStreamBitrate(decoder_->bitrate_kbps());
+        }
+        
+        if (buffering) {
+            // 预计的缓冲量足以覆盖网络波动，或下载已经结束，才开始（恢复）播放
+            // 定时醒来重新评估，吞吐和码率的估计会随数据到来而变化
+            while (is_playing_ && !stream_buffer_->closed() && !buffer_policy_.ReadyToPlay(stream_buffer_->size())) {
+                stream_buffer_->WaitForData(buffer_policy_.PrebufferBytes(), pdMS_TO_TICKS(100));
+            }
+            buffering = false;
+            ESP_LOGI(TAG, "Starting playback with buffer size: %u (target %u, throughput %u B/s, bitrate %d kbps)",
+                    (unsigned)stream_buffer_->size(), (unsigned)buffer_policy_.PrebufferBytes(),
+                    (unsigned)buffer_policy_.throughput_bps(), buffer_policy_.bitrate_kbps());
+        }
+        
+        {
+            int sample_rate = decoder_->sample_rate();
+            int channels = decoder_->channels();
+            total_frames_decoded_++;
             
             // 计算当前帧的持续时间(毫秒)
-            int frame_duration_ms = (mp3_frame_info_.outputSamps * 1000) / 
-                                  (mp3_frame_info_.samprate * mp3_frame_info_.nChans);
+            int frame_duration_ms = (decoded.samples * 1000) / (sample_rate * channels);
+            
+            // 每隔一段时间记录 时间->字节偏移，之后跳回已播放过的位置时可以精确定位
+            if (seek_index_.empty() || current_play_time_ms_ - seek_index_.back().time_ms >= SEEK_INDEX_INTERVAL_MS) {
+                std::lock_guard<std::mutex> lock(seek_mutex_);
+                seek_index_.push_back({current_play_time_ms_, input_offset});
+            }
             
             // 更新当前播放时间
             current_play_time_ms_ += frame_duration_ms;
             
             ESP_LOGD(TAG, "Frame %d: time=%lldms, duration=%dms, rate=%d, ch=%d", 
                     total_frames_decoded_, current_play_time_ms_, frame_duration_ms,
-                    mp3_frame_info_.samprate, mp3_frame_info_.nChans);
+                    sample_rate, channels);
             
             // 更新歌词显示
             int buffer_latency_ms = 600; // 实测调整值
             UpdateLyricDisplay(current_play_time_ms_ + buffer_latency_ms);
             
-            // 将PCM数据发送到Application的音频解码队列
-            if (mp3_frame_info_.outputSamps > 0) {
-                int16_t* final_pcm_data = pcm_buffer;
-                int final_sample_count = mp3_frame_info_.outputSamps;
-                std::vector<int16_t> mono_buffer;
-                
-                // 如果是双通道，转换为单通道混合
-                if (mp3_frame_info_.nChans == 2) {
-                    // 双通道转单通道：将左右声道混合
-                    int stereo_samples = mp3_frame_info_.outputSamps;  // 包含左右声道的总样本数
-                    int mono_samples = stereo_samples / 2;  // 实际的单声道样本数
-                    
-                    mono_buffer.resize(mono_samples);
-                    
-                    for (int i = 0; i < mono_samples; ++i) {
-                        // 混合左右声道 (L + R) / 2
-                        int left = pcm_buffer[i * 2];      // 左声道
-                        int right = pcm_buffer[i * 2 + 1]; // 右声道
-                        mono_buffer[i] = (int16_t)((left + right) / 2);
-                    }
-                    
-                    final_pcm_data = mono_buffer.data();
-                    final_sample_count = mono_samples;
-
-                    ESP_LOGD(TAG, "Converted stereo to mono: %d -> %d samples", 
-                            stereo_samples, mono_samples);
-                } else if (mp3_frame_info_.nChans == 1) {
-                    // 已经是单声道，无需转换
-                    ESP_LOGD(TAG, "Already mono audio: %d samples", final_sample_count);
-                } else {
-                    ESP_LOGW(TAG, "Unsupported channel count: %d, treating as mono", 
-                            mp3_frame_info_.nChans);
+            // 混合为单声道并重采样到 codec 的输出采样率，写入复用的输出帧；不切换 I2S 时钟
+            {
+                int output_rate = codec->output_sample_rate();
+                if (sample_rate != pcm_converter_.input_rate() || channels != pcm_converter_.input_channels() ||
+                    output_rate != pcm_converter_.output_rate()) {
+                    pcm_converter_.Configure(sample_rate, channels, output_rate);
+                    ESP_LOGI(TAG, "Music output: %d Hz x%d -> %d Hz mono (%d taps)", sample_rate, channels,
+                            output_rate, pcm_converter_.taps());
                 }
-                
-                // 创建AudioStreamPacket
-                AudioStreamPacket packet;
-                packet.sample_rate = mp3_frame_info_.samprate;
-                packet.frame_duration = 60;  // 使用Application默认的帧时长
-                packet.timestamp = 0;
-                
-                // 将int16_t PCM数据转换为uint8_t字节数组
-                size_t pcm_size_bytes = final_sample_count * sizeof(int16_t);
-                packet.payload.resize(pcm_size_bytes);
-                memcpy(packet.payload.data(), final_pcm_data, pcm_size_bytes);
 
-                if (final_pcm_data_fft == nullptr) {
-                    final_pcm_data_fft = (int16_t*)heap_caps_malloc(
-                        final_sample_count * sizeof(int16_t),
-                        MALLOC_CAP_SPIRAM
-                    );
+                size_t output_samples = pcm_converter_.Process(pcm.data(), decoded.samples, output_frame_);
+                if (output_samples == 0) {
+                    continue;
                 }
+                size_t pcm_size_bytes = output_samples * sizeof(int16_t);
+
+                // 送出之前记录到旁路（AddAudioData 会换走 output_frame_ 的内容）
+                pcm_tap_.Write(output_frame_.data(), output_samples, output_rate);
                 
-                memcpy(
-                    final_pcm_data_fft,
-                    final_pcm_data,
-                    final_sample_count * sizeof(int16_t)
-                );
+                ESP_LOGD(TAG, "Sending %d PCM samples (rate=%d->%d, channels=%d->1) to Application", 
+                        (int)output_samples, sample_rate, output_rate, channels);
                 
-                ESP_LOGD(TAG, "Sending %d PCM samples (%d bytes, rate=%d, channels=%d->1) to Application", 
-                        final_sample_count, pcm_size_bytes, mp3_frame_info_.samprate, mp3_frame_info_.nChans);
+                if (time_to_first_audio_ms_ < 0) {
+                    time_to_first_audio_ms_ = (esp_timer_get_time() - stream_start_time_us_) / 1000;
+                    ESP_LOGI(TAG, "Time to first sound: %lld ms (first byte at %lld ms)",
+                            time_to_first_audio_ms_.load(), time_to_first_byte_ms_.load());
+                }
                 
-                // 发送到Application的音频解码队列
-                app.AddAudioData(std::move(packet));
+                // 发送到Application播放
+                app.AddAudioData(output_frame_);
                 total_played += pcm_size_bytes;
                 
                 // 打印播放进度
                 if (total_played % (128 * 1024) == 0) {
-                    ESP_LOGI(TAG, "Played %d bytes, buffer size: %d", total_played, buffer_size_);
+                    ESP_LOGI(TAG, "Played %d bytes, buffer size: %d", total_played, stream_buffer_->size());
                 }
             }
-            
-        } else {
-            // 解码失败
-            ESP_LOGW(TAG, "MP3 decode failed with error: %d", decode_result);
-            
-            // 跳过一些字节继续尝试
-            if (bytes_left > 1) {
-                read_ptr++;
-                bytes_left--;
-            } else {
-                bytes_left = 0;
-            }
         }
     }
     
-    // 清理
-    if (mp3_input_buffer) {
-        heap_caps_free(mp3_input_buffer);
-    }
-    
     // 播放结束时进行基本清理，但不调用StopStreaming避免线程自我等待
     ESP_LOGI(TAG, "Audio stream playback finished, total played: %d bytes", total_played);
+    ESP_LOGI(TAG, "Stream stats: time to first audio %lld ms, rebuffers %d, throughput %u B/s",
+            time_to_first_audio_ms_.load(), buffer_policy_.underrun_count(),
+            (unsigned)buffer_policy_.throughput_bps());
+    {
+        auto output_stats = Application::GetInstance().GetAudioService().GetMusicQueueStatistics();
+        ESP_LOGI(TAG, "Output queue: %u underruns, %u decoder waits, max depth %u",
+                (unsigned)(output_stats.underruns - output_underruns_at_start_),
+                (unsigned)(output_stats.producer_waits - output_waits_at_start_),
+                (unsigned)output_stats.max_depth);
+    }
     ESP_LOGI(TAG, "Performing basic cleanup from play thread");
     
     // 停止播放标志
     is_playing_ = false;
+    if (reached_end) {
+        // 队列中剩余的帧正常播完，读空不算欠载
+        Application::GetInstance().GetAudioService().FinishMusicData();
+    }
+    
+    // 下载结束后才加入播放列表的歌曲，由主循环接着播放（播放线程不能等待自己退出）
+    if (reached_end && GetQueueLength() > 0) {
+        ESP_LOGI(TAG, "Scheduling next song from playlist");
+        Application::GetInstance().Schedule([this]() {
+            PlayNext();
+        });
+    }
     
     // 只在频谱显示模式下才停止FFT显示
     if (display_mode_ == DISPLAY_MODE_SPECTRUM) {
@@ -1020,64 +1644,30 @@ void Esp32Music::PlayAudioStream() {
     }
 }
 
-// 清空音频缓冲区
-void Esp32Music::ClearAudioBuffer() {
-    std::lock_guard<std::mutex> lock(buffer_mutex_);
-    
-    while (!audio_buffer_.empty()) {
-        AudioChunk chunk = audio_buffer_.front();
-        audio_buffer_.pop();
-        if (chunk.data) {
-            heap_caps_free(chunk.data);
-        }
-    }
-    
-    buffer_size_ = 0;
-    ESP_LOGI(TAG, "Audio buffer cleared");
-}
-
-// 初始化MP3解码器
-bool Esp32Music::InitializeMp3Decoder() {
-    mp3_decoder_ = MP3InitDecoder();
-    if (mp3_decoder_ == nullptr) {
-        ESP_LOGE(TAG, "Failed to initialize MP3 decoder");
-        mp3_decoder_initialized_ = false;
-        return false;
-    }
-    
-    mp3_decoder_initialized_ = true;
-    ESP_LOGI(TAG, "MP3 decoder initialized successfully");
-    return true;
-}
-
-// 清理MP3解码器
-void Esp32Music::CleanupMp3Decoder() {
-    if (mp3_decoder_ != nullptr) {
-        MP3FreeDecoder(mp3_decoder_);
-        mp3_decoder_ = nullptr;
-    }
-    mp3_decoder_initialized_ = false;
-    ESP_LOGI(TAG, "MP3 decoder cleaned up");
+Esp32Music::StreamStats Esp32Music::GetStreamStats() const {
+    StreamStats stats;
+    stats.time_to_first_audio_ms = time_to_first_audio_ms_.load();
+    stats.time_to_first_byte_ms = time_to_first_byte_ms_.load();
+    stats.rebuffer_count = buffer_policy_.underrun_count();
+    stats.throughput_bps = buffer_policy_.throughput_bps();
+    stats.bitrate_kbps = buffer_policy_.bitrate_kbps();
+    stats.prebuffer_bytes = buffer_policy_.PrebufferBytes();
+    auto output_stats = Application::GetInstance().GetAudioService().GetMusicQueueStatistics();
+    stats.output_underruns = output_stats.underruns - output_underruns_at_start_;
+    stats.output_waits = output_stats.producer_waits - output_waits_at_start_;
+    return stats;
 }
 
-// 重置采样率到原始值
-void Esp32Music::ResetSampleRate() {
-    auto& board = Board::GetInstance();
-    auto codec = board.GetAudioCodec();
-    if (codec && codec->original_output_sample_rate() > 0 && 
-        codec->output_sample_rate() != codec->original_output_sample_rate()) {
-        ESP_LOGI(TAG, "重置采样率：从 %d Hz 重置到原始值 %d Hz", 
-                codec->output_sample_rate(), codec->original_output_sample_rate());
-        if (codec->SetOutputSampleRate(-1)) {  // -1 表示重置到原始值
-            ESP_LOGI(TAG, "成功重置采样率到原始值: %d Hz", codec->output_sample_rate());
-        } else {
-            ESP_LOGW(TAG, "无法重置采样率到原始值");
-        }
+// 清空音频缓冲区（调用前读写线程都必须已经退出）
+void Esp32Music::ClearAudioBuffer() {
+    if (stream_buffer_) {
+        stream_buffer_->Reset();
     }
+    ESP_LOGI(TAG, "Audio buffer cleared");
 }
 
-// 跳过MP3文件开头的ID3标签
-size_t Esp32Music::SkipId3Tag(uint8_t* data, size_t size) {
+// 计算MP3文件开头ID3标签的总长度，标签可能比传入的数据更长
+size_t Esp32Music::SkipId3Tag(const uint8_t* data, size_t size) {
     if (!data || size < 10) {
         return 0;
     }
@@ -1093,12 +1683,10 @@ size_t Esp32Music::SkipId3Tag(uint8_t* data, size_t size) {
                         ((uint32_t)(data[8] & 0x7F) << 7)  |
                         ((uint32_t)(data[9] & 0x7F));
     
-    // ID3v2头部(10字节) + 标签内容
+    // ID3v2头部(10字节) + 标签内容 (+ 可选的10字节尾部)
     size_t total_skip = 10 + tag_size;
-    
-    // 确保不超过可用数据大小
-    if (total_skip > size) {
-        total_skip = size;
+    if (data[5] & 0x10) {
+        total_skip += 10;
     }
     
     ESP_LOGI(TAG, "Found ID3v2 tag, skipping %u bytes", (unsigned int)total_skip);
@@ -1127,8 +1715,13 @@ bool Esp32Music::DownloadLyrics(const std::string& lyric_url) {
     while (retry_count < max_retries && !success && redirect_count < max_redirects) {
         if (retry_count > 0) {
             ESP_LOGI(TAG, "Retrying lyric download (attempt %d of %d)", retry_count + 1, max_retries);
-            // 重试前暂停一下
-            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            // 重试前暂停一下，歌曲已切换或停止时立即放弃
+            for (int waited = 0; waited < 500 && is_lyric_running_; waited += 50) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+            if (!is_lyric_running_) {
+                return false;
+            }
         }
         
         // 使用Board提供的HTTP客户端
@@ -1259,6 +1852,10 @@ bool Esp32Music::ParseLyrics(const std::string& lyric_content) {
     
     // 使用锁保护lyrics_数组访问
     std::lock_guard<std::mutex> lock(lyrics_mutex_);
+    // 已经换歌，不能用上一首的歌词覆盖
+    if (!is_lyric_running_) {
+        return false;
+    }
     
     lyrics_.clear();
     
@@ -1347,10 +1944,10 @@ bool Esp32Music::ParseLyrics(const std::string& lyric_content) {
 }
 
 // 歌词显示线程
-void Esp32Music::LyricDisplayThread() {
+void Esp32Music::LyricDisplayThread(std::string lyric_url) {
     ESP_LOGI(TAG, "Lyric display thread started");
     
-    if (!DownloadLyrics(current_lyric_url_)) {
+    if (!DownloadLyrics(lyric_url)) {
         ESP_LOGE(TAG, "Failed to download or parse lyrics");
         is_lyric_running_ = false;
         return;
@@ -4,26 +4,22 @@
 #include <string>
 #include <thread>
 #include <atomic>
-#include <queue>
 #include <mutex>
-#include <condition_variable>
+#include <memory>
 #include <vector>
+#include <deque>
+#include <condition_variable>
 
 #include "music.h"
+#include "device_state.h"
+#include "stream_ring_buffer.h"
+#include "mp3_frame_scanner.h"
+#include "adaptive_buffer_policy.h"
+#include "song_cache.h"
+#include "music_decoder.h"
+#include "music_pcm_converter.h"
 
-// MP3解码器支持
-extern "C" {
-#include "mp3dec.h"
-}
-
-// 音频数据块结构
-struct AudioChunk {
-    uint8_t* data;
-    size_t size;
-    
-    AudioChunk() : data(nullptr), size(0) {}
-    AudioChunk(uint8_t* d, size_t s) : data(d), size(s) {}
-};
+class Http;
 
 class Esp32Music : public Music {
 public:
@@ -33,8 +29,36 @@ public:
         DISPLAY_MODE_LYRICS = 1     // 显示歌词
     };
 
+    // 当前（或最近一次）数据流的播放统计
+    struct StreamStats {
+        int64_t time_to_first_audio_ms;  // 从收到播放请求到第一帧PCM送出的时间，-1表示尚未出声
+        int64_t time_to_first_byte_ms;   // 从收到播放请求到收到第一个音频字节的时间
+        int rebuffer_count;              // 播放过程中缓冲区被读空、重新预缓冲的次数
+        uint32_t throughput_bps;         // 平滑后的下载吞吐（字节/秒）
+        int bitrate_kbps;                // 帧头中的码率（VBR为平滑值）
+        size_t prebuffer_bytes;          // 当前的预缓冲目标
+        uint32_t output_underruns;       // 输出队列被读空的次数（解码跟不上扬声器）
+        uint32_t output_waits;           // 解码线程等待输出队列空位的次数
+    };
+
 private:
+    // 一首歌的信息，audio_url为空表示尚未请求歌曲详情
+    struct TrackInfo {
+        std::string song_name;
+        std::string artist_name;
+        std::string audio_url;
+        std::string lyric_url;
+    };
+
+    // 环形缓冲区中下一首歌开始的位置（StreamRingBuffer::write_position）
+    struct TrackBoundary {
+        size_t position;
+        TrackInfo track;
+    };
+
     std::string last_downloaded_data_;
+    // 当前歌曲的信息由 track_mutex_ 保护：播放线程无缝换歌时会改写，Seek/Pause 等在其它线程读取
+    mutable std::mutex track_mutex_;
     std::string current_music_url_;
     std::string current_song_name_;
     bool song_name_displayed_;
@@ -45,48 +69,113 @@ private:
     std::mutex lyrics_mutex_;  // 保护lyrics_数组的互斥锁
     std::atomic<int> current_lyric_index_;
     std::thread lyric_thread_;
+    std::mutex lyric_thread_mutex_;  // 工具调用线程和主循环都会重启歌词线程
     std::atomic<bool> is_lyric_running_;
     
     std::atomic<DisplayMode> display_mode_;
     std::atomic<bool> is_playing_;
     std::atomic<bool> is_downloading_;
+    // 暂停或设备状态不允许播放时，播放线程在 playback_gate_cv_ 上等待，
+    // 下载线程因缓冲区写满自然停止读取 socket
+    std::atomic<bool> is_paused_{false};
+    std::atomic<int> pause_count_{0};  // 每次暂停加一，下载线程据此区分暂停导致的断线
+    std::atomic<bool> device_allows_music_{true};  // 由设备状态变化事件更新
+    std::mutex playback_gate_mutex_;
+    std::condition_variable playback_gate_cv_;
     std::thread play_thread_;
     std::thread download_thread_;
     int64_t current_play_time_ms_;  // 当前播放时间(毫秒)
     int64_t last_frame_time_ms_;    // 上一帧的时间戳
     int total_frames_decoded_;      // 已解码的帧数
 
-    // 音频缓冲区
-    std::queue<AudioChunk> audio_buffer_;
-    std::mutex buffer_mutex_;
-    std::condition_variable buffer_cv_;
-    size_t buffer_size_;
-    static constexpr size_t MAX_BUFFER_SIZE = 256 * 1024;  // 256KB缓冲区（降低以减少brownout风险）
-    static constexpr size_t MIN_BUFFER_SIZE = 32 * 1024;   // 32KB最小播放缓冲（降低以减少brownout风险）
+    // 音频缓冲区：下载线程写入、播放线程读取的单生产者/单消费者环形缓冲区
+    std::unique_ptr<StreamRingBuffer> stream_buffer_;
+    static constexpr size_t MAX_BUFFER_SIZE = 256 * 1024;  // 256KB缓冲区，下载线程最多领先播放这么多数据
+    static constexpr size_t MAX_PREBUFFER_SIZE = 32 * 1024; // 预缓冲量的上限，也是尚未测出下载吞吐时的值
+    static constexpr size_t DOWNLOAD_CHUNK_SIZE = 4096;    // 每次HTTP读取的最大字节数
+    static constexpr size_t WRITE_WATERMARK = 16 * 1024;   // 缓冲区满时，空出这么多空间才唤醒下载线程
+    static constexpr int MAX_DOWNLOAD_RETRIES = 5;          // 连接中断后连续重连的最大次数
+    static constexpr int DOWNLOAD_RETRY_BASE_DELAY_MS = 500; // 第一次重连前的等待，之后每次翻倍
+    static constexpr int DOWNLOAD_RETRY_MAX_DELAY_MS = 8000;
+
+    // 根据下载吞吐和码率决定何时开始播放
+    AdaptiveBufferPolicy buffer_policy_;
+    int64_t request_start_time_us_ = 0;  // Download()收到播放请求的时间
+    int64_t stream_start_time_us_ = 0;
+    std::atomic<int64_t> time_to_first_audio_ms_{-1};
+    std::atomic<int64_t> time_to_first_byte_ms_{-1};
+    // 本次数据流开始时 AudioService 音乐输出队列的累计统计
+    uint32_t output_underruns_at_start_ = 0;
+    uint32_t output_waits_at_start_ = 0;
     
-    // MP3解码器相关
-    HMP3Decoder mp3_decoder_;
-    MP3FrameInfo mp3_frame_info_;
-    bool mp3_decoder_initialized_;
+    // 解码器根据每首歌开头的格式选择，由播放线程创建和使用，其它线程需持有 seek_mutex_
+    std::unique_ptr<MusicDecoder> decoder_;
+    static constexpr size_t FORMAT_SNIFF_SIZE = 12;   // 识别格式所需的文件头长度
+
+    // 解码输出 -> 单声道、codec 输出采样率，转换结果写入复用的 output_frame_
+    MusicPcmConverter pcm_converter_;
+    std::vector<int16_t> output_frame_;
+    static constexpr size_t OUTPUT_FRAME_RESERVE = 2304;  // 够放一帧 MP3 升采样到 2 倍后的样本
     
     // 私有方法
-    void DownloadAudioStream(const std::string& music_url);
+    void DownloadAudioStream(TrackInfo track, std::unique_ptr<Http> connection, size_t start_offset);
     void PlayAudioStream();
     void ClearAudioBuffer();
-    bool InitializeMp3Decoder();
-    void CleanupMp3Decoder();
-    void ResetSampleRate();  // 重置采样率到原始值
     
     // 歌词相关私有方法
     bool DownloadLyrics(const std::string& lyric_url);
     bool ParseLyrics(const std::string& lyric_content);
-    void LyricDisplayThread();
+    void LyricDisplayThread(std::string lyric_url);
     void UpdateLyricDisplay(int64_t current_time_ms);
     
     // ID3标签处理
-    size_t SkipId3Tag(uint8_t* data, size_t size);
+    size_t SkipId3Tag(const uint8_t* data, size_t size);
 
-    int16_t* final_pcm_data_fft = nullptr;
+    // 播放列表
+    std::deque<TrackInfo> playlist_;
+    std::deque<TrackBoundary> track_boundaries_;  // 已经开始下载、尚未开始播放的歌曲
+    mutable std::mutex playlist_mutex_;
+    std::condition_variable playlist_cv_;
+    static constexpr size_t GAPLESS_HANDOFF_SIZE = 16 * 1024;  // 缓冲区剩余数据少于此值时不再等待新歌入队
+
+    bool ResolveTrack(const std::string& song_name, const std::string& artist_name,
+                      TrackInfo* track, std::string* response, std::unique_ptr<Http>* connection = nullptr);
+    bool PlayTrack(const TrackInfo& track);
+    bool DownloadTrack(const TrackInfo& track, std::unique_ptr<Http>& connection, size_t start_offset);
+    bool WaitForDownloadSpace();
+    bool TakeNextTrack(TrackInfo* track);
+    void SwitchToNextTrack();
+    void RequeuePrefetchedTracks();
+    void StartLyricThread(const std::string& lyric_url);
+    
+    // 闪存歌曲缓存，分区不存在时为空
+    std::unique_ptr<SongCache> song_cache_;
+    TrackInfo streaming_track_;  // 由PlayTrack设置，下载线程据此写入缓存
+    std::unique_ptr<Http> handoff_http_;  // 请求歌曲详情后保持打开的连接，交给下载线程复用
+    static constexpr const char* SONG_CACHE_PARTITION = "music";
+    static constexpr const char* SONG_CACHE_BASE_PATH = "/music";
+    void InitializeSongCache();
+    bool LookupCachedTrack(const std::string& song_name, const std::string& artist_name, TrackInfo* track);
+    bool StreamFromCache(const SongCache::Entry& entry, size_t start_offset);
+
+    // 跳转：时间到字节偏移的映射
+    struct SeekPoint {
+        int64_t time_ms;
+        size_t file_offset;
+    };
+    static constexpr int64_t SEEK_INDEX_INTERVAL_MS = 1000;
+    std::mutex seek_mutex_;              // 保护 decoder_ 中的定位信息和 seek_index_
+    std::vector<SeekPoint> seek_index_;  // 播放过程中记录的索引，按时间递增
+    size_t decoder_start_offset_ = 0;    // 解码器开始读取的位置在文件中的偏移（ID3标签之后）
+    size_t stream_start_offset_ = 0;     // 本次数据流在文件中的起始偏移
+    int64_t stream_start_play_ms_ = 0;   // 本次数据流起始位置对应的播放时间
+    bool StartStreamingAt(const std::string& music_url, size_t start_offset, int64_t start_time_ms);
+    void JoinStreamThreads();
+    void ClearPause();
+    void WakePlayThread();
+    void OnDeviceStateChanged(DeviceState previous_state, DeviceState current_state);
+
+    PcmTap pcm_tap_;
 
 public:
     Esp32Music();
@@ -99,9 +188,20 @@ public:
     // 新增方法
     virtual bool StartStreaming(const std::string& music_url) override;
     virtual bool StopStreaming() override;  // 停止流式播放
-    virtual size_t GetBufferSize() const override { return buffer_size_; }
+    virtual bool Seek(int position_ms) override;
+    virtual bool Pause() override;
+    virtual bool Resume() override;
+    virtual bool IsPaused() const override { return is_paused_; }
+    virtual size_t GetBufferSize() const override { return stream_buffer_ ? stream_buffer_->size() : 0; }
     virtual bool IsDownloading() const override { return is_downloading_; }
-    virtual int16_t* GetAudioData() override { return final_pcm_data_fft; }
+    virtual const PcmTap& GetPcmTap() const override { return pcm_tap_; }
+    StreamStats GetStreamStats() const;
+    
+    // 播放列表
+    virtual bool EnqueueSong(const std::string& song_name, const std::string& artist_name) override;
+    virtual bool PlayNext() override;
+    virtual void ClearQueue() override;
+    virtual size_t GetQueueLength() const override;
     
     // 显示模式控制方法
     void SetDisplayMode(DisplayMode mode);
@@ -0,0 +1,105 @@
+#include "mp3_frame_scanner.h"
+
+#include <cstring>
+
+// Layer III 码率表（kbps），[0]为MPEG1，[1]为MPEG2/MPEG2.5
+static const int kBitrateTable[2][16] = {
+    {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0},
+    {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0},
+};
+
+// 采样率表（Hz），按 MPEG1 / MPEG2 / MPEG2.5 排列
+static const int kSampleRateTable[3][3] = {
+    {44100, 48000, 32000},
+    {22050, 24000, 16000},
+    {11025, 12000, 8000},
+};
+
+bool Mp3FrameScanner::ParseHeader(const uint8_t* data, Mp3FrameHeader* header) {
+    // 11位同步字
+    if (data[0] != 0xFF || (data[1] & 0xE0) != 0xE0) {
+        return false;
+    }
+
+    int version_bits = (data[1] >> 3) & 0x03;
+    int layer_bits = (data[1] >> 1) & 0x03;
+    int bitrate_index = data[2] >> 4;
+    int sample_rate_index = (data[2] >> 2) & 0x03;
+    int padding = (data[2] >> 1) & 0x01;
+    int channel_mode = data[3] >> 6;
+    int emphasis = data[3] & 0x03;
+
+    // 版本保留值、非 Layer III、自由码率/非法码率、保留采样率、保留加重值都视为无效帧头
+    if (version_bits == 1 || layer_bits != 1) {
+        return false;
+    }
+    if (bitrate_index == 0 || bitrate_index == 15 || sample_rate_index == 3 || emphasis == 2) {
+        return false;
+    }
+
+    int version = (version_bits == 3) ? 0 : (version_bits == 2) ? 1 : 2;
+    int bitrate_kbps = kBitrateTable[version == 0 ? 0 : 1][bitrate_index];
+    int sample_rate = kSampleRateTable[version][sample_rate_index];
+    int coefficient = (version == 0) ? 144 : 72;
+
+    header->version = version;
+    header->bitrate_kbps = bitrate_kbps;
+    header->sample_rate = sample_rate;
+    header->sample_rate_index = sample_rate_index;
+    header->channels = (channel_mode == 3) ? 1 : 2;
+    header->samples_per_frame = (version == 0) ? 1152 : 576;
+    header->frame_length = (size_t)(coefficient * bitrate_kbps * 1000 / sample_rate + padding);
+    return true;
+}
+
+Mp3FrameScanner::Result Mp3FrameScanner::Scan(const uint8_t* data, size_t size, bool end_of_stream, Mp3FrameHeader* header) {
+    if (size < 4) {
+        return {kNeedMoreData, 0};
+    }
+
+    size_t i = 0;
+    while (i + 4 <= size) {
+        // 直接跳到下一个可能的同步字节
+        const uint8_t* candidate = (const uint8_t*)memchr(data + i, 0xFF, size - 3 - i);
+        if (candidate == nullptr) {
+            break;
+        }
+        i = candidate - data;
+
+        Mp3FrameHeader current;
+        if (!ParseHeader(data + i, &current)) {
+            i++;
+            continue;
+        }
+
+        size_t next = i + current.frame_length;
+        if (next + 4 <= size) {
+            // 用下一个帧头确认，过滤掉音频数据中偶然出现的伪同步字
+            Mp3FrameHeader following;
+            if (ParseHeader(data + next, &following) &&
+                following.version == current.version &&
+                following.sample_rate_index == current.sample_rate_index) {
+                *header = current;
+                return {kFrameFound, i};
+            }
+            i++;
+            continue;
+        }
+
+        if (end_of_stream) {
+            // 流已结束，最后一帧无法用下一帧确认，只要完整即可
+            if (next <= size) {
+                *header = current;
+                return {kFrameFound, i};
+            }
+            i++;
+            continue;
+        }
+
+        // 候选帧还不完整，保留它等待更多数据
+        return {kNeedMoreData, i};
+    }
+
+    // 没有找到候选帧，只保留末尾可能构成半个帧头的3个字节
+    return {kNeedMoreData, size - 3};
+}
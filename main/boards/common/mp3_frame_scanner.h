@@ -0,0 +1,49 @@
+#ifndef MP3_FRAME_SCANNER_H
+#define MP3_FRAME_SCANNER_H
+
+#include <cstddef>
+#include <cstdint>
+
+// 解析后的 MPEG Layer III 帧头
+struct Mp3FrameHeader {
+    int version = 0;          // 0: MPEG1, 1: MPEG2, 2: MPEG2.5
+    int bitrate_kbps = 0;
+    int sample_rate = 0;
+    int channels = 0;
+    int samples_per_frame = 0;
+    size_t frame_length = 0;  // 含帧头的完整帧长度（字节）
+    uint8_t sample_rate_index = 0;
+};
+
+/*
+ * MP3 帧扫描器：完整解析并校验帧头（版本/层/码率/采样率/填充位），
+ * 计算出精确的帧长度，并用紧随其后的下一个帧头进行确认。
+ *
+ * 找到的帧可以直接交给 helix 解码器，无需先拷贝到中间缓冲区；
+ * 遇到损坏或非 MP3 数据时按候选同步字跳跃，而不是逐字节尝试解码。
+ */
+class Mp3FrameScanner {
+public:
+    // 一帧 Layer III 的最大长度：MPEG1 320kbps@32kHz 带填充为 1441 字节
+    static constexpr size_t MAX_FRAME_LENGTH = 1441;
+    // 扫描一帧所需的最大窗口：一帧 + 下一帧的帧头
+    static constexpr size_t SCAN_WINDOW = MAX_FRAME_LENGTH + 4;
+
+    enum Status {
+        kFrameFound,     // offset 处是一个已确认的完整帧
+        kNeedMoreData,   // offset 之前的数据可以丢弃，需要更多数据才能继续判断
+    };
+
+    struct Result {
+        Status status;
+        size_t offset;
+    };
+
+    static bool ParseHeader(const uint8_t* data, Mp3FrameHeader* header);
+
+    // 在 data 中查找第一个经过确认的帧。end_of_stream 为 true 时，
+    // 最后一帧无法用下一个帧头确认，只要完整即接受。
+    static Result Scan(const uint8_t* data, size_t size, bool end_of_stream, Mp3FrameHeader* header);
+};
+
+#endif // MP3_FRAME_SCANNER_H
@@ -0,0 +1,115 @@
+#include "mp3_music_decoder.h"
+
+#include <esp_log.h>
+
+#define TAG "Mp3MusicDecoder"
+
+Mp3MusicDecoder::Mp3MusicDecoder() {
+    decoder_ = MP3InitDecoder();
+    if (decoder_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to initialize MP3 decoder");
+    }
+}
+
+Mp3MusicDecoder::~Mp3MusicDecoder() {
+    if (decoder_ != nullptr) {
+        MP3FreeDecoder(decoder_);
+    }
+}
+
+MusicDecoder::Result Mp3MusicDecoder::Decode(const uint8_t* data, size_t size, bool end_of_stream, std::vector<int16_t>& pcm) {
+    Result result;
+    if (decoder_ == nullptr) {
+        // 跳转时重建解码器失败，丢弃剩余数据
+        result.consumed = size;
+        result.need_more = true;
+        return result;
+    }
+    Mp3FrameHeader header;
+    auto scan = Mp3FrameScanner::Scan(data, size, end_of_stream, &header);
+
+    // 帧之前的无效数据直接丢弃（按候选同步字跳跃，而不是逐字节尝试解码）
+    result.consumed = scan.offset;
+    if (scan.offset > 0) {
+        ESP_LOGD(TAG, "Skipped %u bytes while searching for MP3 frame", (unsigned)scan.offset);
+    }
+    if (scan.status == Mp3FrameScanner::kNeedMoreData) {
+        position_ += result.consumed;
+        result.need_more = true;
+        return result;
+    }
+
+    const uint8_t* frame = data + scan.offset;
+    if (!first_frame_seen_) {
+        // 第一帧可能带有 Xing/VBRI 头，记录下来用于跳转
+        first_frame_seen_ = true;
+        first_frame_offset_ = position_ + scan.offset;
+        seek_table_.Parse(frame, header);
+        ESP_LOGI(TAG, "First frame at %u, seek table type %d, duration %lld ms",
+                (unsigned)first_frame_offset_, (int)seek_table_.type(), seek_table_.DurationMs());
+    }
+    bitrate_kbps_ = header.bitrate_kbps;
+
+    // helix 直接读取输入中的完整帧，无论成功与否都整帧前进，出错时按帧跳跃恢复
+    uint8_t* read_ptr = const_cast<uint8_t*>(frame);
+    int bytes_left = (int)header.frame_length;
+    pcm.resize(MAX_FRAME_SAMPLES);
+    int decode_result = MP3Decode(decoder_, &read_ptr, &bytes_left, pcm.data(), 0);
+    result.consumed += header.frame_length;
+    position_ += result.consumed;
+
+    if (decode_result == 0) {
+        MP3FrameInfo info;
+        MP3GetLastFrameInfo(decoder_, &info);
+        // 基本的帧信息有效性检查，防止除零错误
+        if (info.samprate == 0 || info.nChans == 0) {
+            ESP_LOGW(TAG, "Invalid frame info: rate=%d, channels=%d, skipping", info.samprate, info.nChans);
+        } else {
+            sample_rate_ = info.samprate;
+            channels_ = info.nChans;
+            result.samples = info.outputSamps;
+        }
+    } else if (decode_result == ERR_MP3_MAINDATA_UNDERFLOW) {
+        // 比特池尚未填满（刚开始播放或重新同步之后），属于正常情况，继续下一帧
+        ESP_LOGD(TAG, "MP3 main data underflow, waiting for bit reservoir");
+    } else {
+        // 解码失败，帧头已校验过，直接跳到下一帧
+        ESP_LOGW(TAG, "MP3 decode failed with error: %d, skipping frame", decode_result);
+    }
+    pcm.resize(result.samples);
+    return result;
+}
+
+void Mp3MusicDecoder::Reset() {
+    // 相邻的两首歌之间不重建helix解码器，新歌第一帧的比特池偏移总是0
+    position_ = 0;
+    first_frame_seen_ = false;
+    first_frame_offset_ = 0;
+    seek_table_.Reset();
+}
+
+void Mp3MusicDecoder::Restart(size_t offset) {
+    // 丢弃解码器中上一位置的比特池
+    if (decoder_ != nullptr) {
+        MP3FreeDecoder(decoder_);
+    }
+    decoder_ = MP3InitDecoder();
+    if (decoder_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to initialize MP3 decoder");
+    }
+    position_ = offset;
+    // 从中间开始时不会再看到第一帧，已经解析出的定位信息保持不变
+    first_frame_seen_ = true;
+}
+
+bool Mp3MusicDecoder::TimeToOffset(int64_t time_ms, size_t* offset) const {
+    if (!first_frame_seen_) {
+        return false;
+    }
+    size_t relative = 0;
+    if (!seek_table_.TimeToOffset(time_ms, &relative)) {
+        return false;
+    }
+    *offset = first_frame_offset_ + relative;
+    return true;
+}
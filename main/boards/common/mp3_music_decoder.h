@@ -0,0 +1,49 @@
+#ifndef MP3_MUSIC_DECODER_H
+#define MP3_MUSIC_DECODER_H
+
+#include "music_decoder.h"
+#include "mp3_frame_scanner.h"
+#include "mp3_seek_table.h"
+
+extern "C" {
+#include "mp3dec.h"
+}
+
+/*
+ * helix MP3 解码器：用 Mp3FrameScanner 在输入上定位并确认完整的帧，
+ * 直接在调用者的缓冲区上解码，第一帧中的 Xing/VBRI 信息用于跳转。
+ */
+class Mp3MusicDecoder : public MusicDecoder {
+public:
+    // 一帧 Layer III 最多输出的样本数（1152 × 2声道）
+    static constexpr size_t MAX_FRAME_SAMPLES = 2304;
+
+    Mp3MusicDecoder();
+    ~Mp3MusicDecoder() override;
+
+    MusicFormat format() const override { return MusicFormat::kMp3; }
+    bool valid() const override { return decoder_ != nullptr; }
+
+    Result Decode(const uint8_t* data, size_t size, bool end_of_stream, std::vector<int16_t>& pcm) override;
+
+    int sample_rate() const override { return sample_rate_; }
+    int channels() const override { return channels_; }
+    int bitrate_kbps() const override { return bitrate_kbps_; }
+
+    void Reset() override;
+    void Restart(size_t offset) override;
+    bool TimeToOffset(int64_t time_ms, size_t* offset) const override;
+
+private:
+    HMP3Decoder decoder_ = nullptr;
+    int sample_rate_ = 0;
+    int channels_ = 0;
+    int bitrate_kbps_ = 0;
+
+    size_t position_ = 0;            // 已经消耗的输入字节数（相对于本首歌的起点）
+    bool first_frame_seen_ = false;
+    size_t first_frame_offset_ = 0;  // 第一帧之前可能还有无法识别的数据
+    Mp3SeekTable seek_table_;
+};
+
+#endif // MP3_MUSIC_DECODER_H
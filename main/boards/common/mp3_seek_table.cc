@@ -0,0 +1,124 @@
+#include "mp3_seek_table.h"
+
+#include <cstring>
+
+static uint32_t ReadBigEndian(const uint8_t* data, int bytes) {
+    uint32_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+void Mp3SeekTable::Reset() {
+    *this = Mp3SeekTable();
+}
+
+void Mp3SeekTable::Parse(const uint8_t* frame, const Mp3FrameHeader& header) {
+    Reset();
+    sample_rate_ = header.sample_rate;
+    samples_per_frame_ = header.samples_per_frame;
+    bitrate_kbps_ = header.bitrate_kbps;
+    size_t length = header.frame_length;
+
+    // Xing/Info 头位于帧头和边信息之后
+    size_t side_info;
+    if (header.version == 0) {
+        side_info = (header.channels == 1) ? 17 : 32;
+    } else {
+        side_info = (header.channels == 1) ? 9 : 17;
+    }
+    size_t pos = 4 + side_info;
+    if (pos + 8 <= length && (memcmp(frame + pos, "Xing", 4) == 0 || memcmp(frame + pos, "Info", 4) == 0)) {
+        uint32_t flags = ReadBigEndian(frame + pos + 4, 4);
+        pos += 8;
+        if ((flags & 0x01) && pos + 4 <= length) {
+            total_frames_ = ReadBigEndian(frame + pos, 4);
+            pos += 4;
+        }
+        if ((flags & 0x02) && pos + 4 <= length) {
+            total_bytes_ = ReadBigEndian(frame + pos, 4);
+            pos += 4;
+        }
+        if ((flags & 0x04) && pos + 100 <= length) {
+            memcpy(xing_toc_, frame + pos, 100);
+            has_xing_toc_ = true;
+        }
+        type_ = kXing;
+        return;
+    }
+
+    // VBRI 头固定位于帧头之后32字节
+    pos = 4 + 32;
+    if (pos + 26 <= length && memcmp(frame + pos, "VBRI", 4) == 0) {
+        total_bytes_ = ReadBigEndian(frame + pos + 10, 4);
+        total_frames_ = ReadBigEndian(frame + pos + 14, 4);
+        uint32_t entry_count = ReadBigEndian(frame + pos + 18, 2);
+        uint32_t scale = ReadBigEndian(frame + pos + 20, 2);
+        uint32_t entry_size = ReadBigEndian(frame + pos + 22, 2);
+        vbri_frames_per_entry_ = ReadBigEndian(frame + pos + 24, 2);
+        pos += 26;
+        if (entry_size >= 1 && entry_size <= 4 && pos + entry_count * entry_size <= length) {
+            vbri_entries_.reserve(entry_count);
+            for (uint32_t i = 0; i < entry_count; i++) {
+                vbri_entries_.push_back(ReadBigEndian(frame + pos, entry_size) * scale);
+                pos += entry_size;
+            }
+        }
+        type_ = kVbri;
+    }
+}
+
+int64_t Mp3SeekTable::DurationMs() const {
+    if (total_frames_ == 0 || sample_rate_ == 0) {
+        return -1;
+    }
+    return (int64_t)total_frames_ * samples_per_frame_ * 1000 / sample_rate_;
+}
+
+bool Mp3SeekTable::TimeToOffset(int64_t time_ms, size_t* offset) const {
+    if (time_ms < 0 || sample_rate_ == 0) {
+        return false;
+    }
+    int64_t duration = DurationMs();
+    if (duration > 0 && time_ms >= duration) {
+        return false;
+    }
+
+    if (type_ == kXing && has_xing_toc_ && total_bytes_ > 0 && duration > 0) {
+        // 目录表把时长等分为100份，每项是该时刻在文件中的位置（以总字节数的1/256为单位）
+        float percent = (float)time_ms * 100.0f / (float)duration;
+        int index = (int)percent;
+        if (index > 99) {
+            index = 99;
+        }
+        float a = xing_toc_[index];
+        float b = (index < 99) ? xing_toc_[index + 1] : 256.0f;
+        float position = a + (b - a) * (percent - index);
+        *offset = (size_t)(position / 256.0f * total_bytes_);
+        return true;
+    }
+
+    if (type_ == kVbri && !vbri_entries_.empty() && vbri_frames_per_entry_ > 0) {
+        // 逐项累加字节数，在落入的条目内线性插值
+        int64_t entry_ms = (int64_t)vbri_frames_per_entry_ * samples_per_frame_ * 1000 / sample_rate_;
+        size_t bytes = 0;
+        int64_t elapsed = 0;
+        for (uint32_t entry : vbri_entries_) {
+            if (elapsed + entry_ms > time_ms) {
+                *offset = bytes + (size_t)((int64_t)entry * (time_ms - elapsed) / entry_ms);
+                return true;
+            }
+            bytes += entry;
+            elapsed += entry_ms;
+        }
+        return false;
+    }
+
+    // 没有目录表时按CBR估算
+    if (bitrate_kbps_ > 0) {
+        *offset = (size_t)(time_ms * bitrate_kbps_ / 8);
+        return total_bytes_ == 0 || *offset < total_bytes_;
+    }
+    return false;
+}
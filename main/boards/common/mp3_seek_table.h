@@ -0,0 +1,48 @@
+#ifndef MP3_SEEK_TABLE_H
+#define MP3_SEEK_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mp3_frame_scanner.h"
+
+/*
+ * 第一帧中 Xing/Info 或 VBRI 头携带的整首歌信息（总帧数、总字节数、目录表），
+ * 用于把播放时间映射为文件中的字节偏移。两者都没有时按第一帧的码率当作CBR估算。
+ *
+ * 所有偏移都相对于第一帧的起始位置（即跳过ID3标签之后）。
+ */
+class Mp3SeekTable {
+public:
+    enum Type {
+        kNone,
+        kXing,
+        kVbri,
+    };
+
+    // 用一首歌的第一帧初始化，frame 至少包含 header.frame_length 字节
+    void Parse(const uint8_t* frame, const Mp3FrameHeader& header);
+    void Reset();
+
+    Type type() const { return type_; }
+    // 整首歌的时长，未知时返回-1
+    int64_t DurationMs() const;
+    // 时间映射为相对第一帧的字节偏移，无法映射时返回false
+    bool TimeToOffset(int64_t time_ms, size_t* offset) const;
+
+private:
+    Type type_ = kNone;
+    int sample_rate_ = 0;
+    int samples_per_frame_ = 0;
+    int bitrate_kbps_ = 0;
+
+    uint32_t total_frames_ = 0;
+    uint32_t total_bytes_ = 0;
+    uint8_t xing_toc_[100] = {};
+    bool has_xing_toc_ = false;
+    std::vector<uint32_t> vbri_entries_;  // 每个条目覆盖 vbri_frames_per_entry_ 帧的字节数
+    uint32_t vbri_frames_per_entry_ = 0;
+};
+
+#endif // MP3_SEEK_TABLE_H
@@ -3,19 +3,40 @@
 
 #include <string>
 
+#include "pcm_tap.h"
+#include "device_state.h"
+
 class Music {
 public:
     virtual ~Music() = default;  // 添加虚析构函数
     
+    // 对话中（连接、聆听、说话）音乐继续播放，由 AudioService 混音并压低音量；
+    // 升级、配网等状态下不播放
+    static bool CanPlayInState(DeviceState state) {
+        return state == kDeviceStateIdle || state == kDeviceStateConnecting ||
+            state == kDeviceStateListening || state == kDeviceStateSpeaking;
+    }
+    
     virtual bool Download(const std::string& song_name, const std::string& artist_name = "") = 0;
     virtual std::string GetDownloadResult() = 0;
     
     // 新增流式播放相关方法
     virtual bool StartStreaming(const std::string& music_url) = 0;
     virtual bool StopStreaming() = 0;  // 停止流式播放
+    virtual bool Seek(int position_ms) = 0;  // 跳转到当前歌曲的指定位置
+    virtual bool Pause() = 0;   // 暂停播放，保留解码状态和已缓冲的数据
+    virtual bool Resume() = 0;
+    virtual bool IsPaused() const = 0;
     virtual size_t GetBufferSize() const = 0;
     virtual bool IsDownloading() const = 0;
-    virtual int16_t* GetAudioData() = 0;
+    // 最近播放的单声道PCM，供频谱等显示效果读取，读者之间、读者与播放线程之间互不阻塞
+    virtual const PcmTap& GetPcmTap() const = 0;
+    
+    // 播放列表：队列中的下一首会在当前歌曲下载完成后接着下载，实现无缝切换
+    virtual bool EnqueueSong(const std::string& song_name, const std::string& artist_name = "") = 0;
+    virtual bool PlayNext() = 0;      // 立即切到队列中的下一首
+    virtual void ClearQueue() = 0;
+    virtual size_t GetQueueLength() const = 0;
 };
 
 #endif // MUSIC_H 
\ No newline at end of file
@@ -0,0 +1,73 @@
+#include "music_decoder.h"
+#include "mp3_music_decoder.h"
+#include "wav_music_decoder.h"
+#include "ogg_opus_music_decoder.h"
+
+#include <cstring>
+
+MusicFormat SniffMusicFormat(const uint8_t* data, size_t size) {
+    if (data == nullptr || size < 4) {
+        return MusicFormat::kUnknown;
+    }
+    if (memcmp(data, "OggS", 4) == 0) {
+        return MusicFormat::kOggOpus;
+    }
+    if (memcmp(data, "fLaC", 4) == 0) {
+        return MusicFormat::kFlac;
+    }
+    if (data[0] == 0xFF) {
+        // ADTS 与 MPEG 音频帧的同步字相同，靠层字段区分（ADTS 的层固定为0）
+        if ((data[1] & 0xF6) == 0xF0) {
+            return MusicFormat::kAac;
+        }
+        if ((data[1] & 0xE0) == 0xE0 && (data[1] & 0x06) != 0) {
+            return MusicFormat::kMp3;
+        }
+    }
+    if (size >= 12 && memcmp(data, "RIFF", 4) == 0 && memcmp(data + 8, "WAVE", 4) == 0) {
+        return MusicFormat::kWav;
+    }
+    if (size >= 8 && memcmp(data + 4, "ftyp", 4) == 0) {
+        return MusicFormat::kAac;  // MP4/M4A 容器
+    }
+    return MusicFormat::kUnknown;
+}
+
+const char* MusicFormatName(MusicFormat format) {
+    switch (format) {
+        case MusicFormat::kMp3:
+            return "MP3";
+        case MusicFormat::kWav:
+            return "WAV";
+        case MusicFormat::kOggOpus:
+            return "Ogg";
+        case MusicFormat::kFlac:
+            return "FLAC";
+        case MusicFormat::kAac:
+            return "AAC";
+        default:
+            return "unknown";
+    }
+}
+
+std::unique_ptr<MusicDecoder> CreateMusicDecoder(MusicFormat format, int output_sample_rate) {
+    std::unique_ptr<MusicDecoder> decoder;
+    switch (format) {
+        case MusicFormat::kMp3:
+            decoder = std::make_unique<Mp3MusicDecoder>();
+            break;
+        case MusicFormat::kWav:
+            decoder = std::make_unique<WavMusicDecoder>();
+            break;
+        case MusicFormat::kOggOpus:
+            decoder = std::make_unique<OggOpusMusicDecoder>(output_sample_rate);
+            break;
+        default:
+            // FLAC/AAC 固件中没有对应的解码库
+            return nullptr;
+    }
+    if (!decoder->valid()) {
+        return nullptr;
+    }
+    return decoder;
+}
@@ -0,0 +1,64 @@
+#ifndef MUSIC_DECODER_H
+#define MUSIC_DECODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// 根据文件头识别出的音频格式
+enum class MusicFormat {
+    kUnknown,
+    kMp3,
+    kWav,
+    kOggOpus,
+    kFlac,
+    kAac,
+};
+
+// 识别数据流开头（ID3标签之后）的格式，数据不足以判断时返回 kUnknown
+MusicFormat SniffMusicFormat(const uint8_t* data, size_t size);
+const char* MusicFormatName(MusicFormat format);
+
+/*
+ * 音乐解码器接口：播放线程直接在环形缓冲区上调用 Decode，解码器从 data 开头
+ * 增量地解析自己的容器格式，每次最多输出一个解码单元（一帧/一个包/一段PCM）。
+ *
+ * 解码器只在播放线程中使用；TimeToOffset 可能在其它线程调用，由调用者加锁。
+ */
+class MusicDecoder {
+public:
+    struct Result {
+        size_t consumed = 0;     // 可以从输入中丢弃的字节数
+        int samples = 0;         // 写入 pcm 的样本数（各声道交错，合计），0 表示本次没有输出
+        bool need_more = false;  // 剩余的输入不足以继续解码，需要等待更多数据
+    };
+
+    virtual ~MusicDecoder() = default;
+
+    virtual MusicFormat format() const = 0;
+    // 构造时分配的资源（解码器内存等）是否可用
+    virtual bool valid() const { return true; }
+
+    // end_of_stream 为 true 时 data 之后不会再有数据，解码器应尽量处理完最后的部分
+    virtual Result Decode(const uint8_t* data, size_t size, bool end_of_stream, std::vector<int16_t>& pcm) = 0;
+
+    // 最近一次输出的采样率和声道数，尚未输出时为0
+    virtual int sample_rate() const = 0;
+    virtual int channels() const = 0;
+    // 数据流的码率，用于估算预缓冲量，未知时为0
+    virtual int bitrate_kbps() const = 0;
+
+    // 开始解码一首新的歌曲
+    virtual void Reset() = 0;
+    // 跳转后从 offset 处（相对于本首歌解码器读取的第一个字节）继续解码，保留已经解析出的流信息
+    virtual void Restart(size_t offset) = 0;
+    // 时间映射为相对于本首歌解码器读取的第一个字节的偏移，不支持时返回false
+    virtual bool TimeToOffset(int64_t time_ms, size_t* offset) const { return false; }
+};
+
+// 创建对应格式的解码器，不支持的格式返回空。output_sample_rate 为希望的输出采样率，
+// 可以自由选择输出采样率的解码器（Opus）据此避免重采样
+std::unique_ptr<MusicDecoder> CreateMusicDecoder(MusicFormat format, int output_sample_rate);
+
+#endif // MUSIC_DECODER_H
@@ -0,0 +1,178 @@
+#include "music_pcm_converter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Kaiser 窗参数，约 70dB 阻带衰减
+static constexpr double KAISER_BETA = 7.0;
+static constexpr double KAISER_ATTENUATION_DB = 70.0;
+
+// 第一类零阶修正贝塞尔函数（级数展开）
+static double BesselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 32; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+void MusicPcmConverter::Configure(int input_rate, int input_channels, int output_rate) {
+    input_rate_ = input_rate;
+    input_channels_ = input_channels > 0 ? input_channels : 1;
+    output_rate_ = output_rate;
+    step_ = (output_rate > 0) ? (((uint64_t)input_rate << 32) / output_rate) : (1ULL << 32);
+    if (input_rate_ != output_rate_ && input_rate_ > 0 && output_rate_ > 0) {
+        BuildFilter();
+    } else {
+        taps_ = 0;
+        coefficients_.clear();
+    }
+    Reset();
+}
+
+void MusicPcmConverter::Reset() {
+    position_ = 0;
+    if (taps_ > 1) {
+        if (work_.size() < (size_t)taps_ - 1) {
+            work_.resize(taps_ - 1);
+        }
+        std::fill(work_.begin(), work_.begin() + taps_ - 1, 0);
+    }
+}
+
+void MusicPcmConverter::BuildFilter() {
+    double ratio = (double)output_rate_ / input_rate_;
+    int taps = BASE_TAPS;
+    if (ratio < 1.0) {
+        // 降采样：保持相对输出采样率的过渡带宽度
+        taps = (int)std::ceil(BASE_TAPS / ratio);
+    }
+    taps = std::min((taps + 3) & ~3, MAX_TAPS);
+    taps_ = taps;
+
+    // 截止频率以输入采样率归一化（0.5 为奈奎斯特频率），过渡带的上沿对齐较低的奈奎斯特频率
+    double transition = (KAISER_ATTENUATION_DB - 8.0) / (2.285 * 2.0 * M_PI * (taps - 1));
+    double cutoff = 0.5 * std::min(1.0, ratio) - transition / 2;
+    double half = taps / 2.0;
+    double center = taps / 2 - 1;
+    double i0_beta = BesselI0(KAISER_BETA);
+
+    coefficients_.resize((PHASES + 1) * taps);
+    double row[MAX_TAPS];
+    for (int r = 0; r <= PHASES; ++r) {
+        double delay = (double)r / PHASES;
+        double sum = 0.0;
+        for (int k = 0; k < taps; ++k) {
+            double x = k - center - delay;
+            double sinc = (x == 0.0) ? 1.0 : std::sin(2.0 * M_PI * cutoff * x) / (2.0 * M_PI * cutoff * x);
+            double w = 1.0 - (x / half) * (x / half);
+            double window = w > 0.0 ? BesselI0(KAISER_BETA * std::sqrt(w)) / i0_beta : 0.0;
+            row[k] = sinc * window;
+            sum += row[k];
+        }
+        // 每一行的直流增益归一化为 1，量化误差补在最大的系数上
+        int16_t* out = &coefficients_[r * taps];
+        int total = 0;
+        int largest = 0;
+        for (int k = 0; k < taps; ++k) {
+            out[k] = (int16_t)std::lround(row[k] / sum * 32768.0);
+            total += out[k];
+            if (std::abs(out[k]) > std::abs(out[largest])) {
+                largest = k;
+            }
+        }
+        out[largest] += 32768 - total;
+    }
+}
+
+size_t MusicPcmConverter::Process(const int16_t* input, size_t input_samples, std::vector<int16_t>& output) {
+    const int channels = input_channels_;
+    size_t frames = input_samples / channels;
+    if (frames == 0 || frames > 0x7FFF || output_rate_ <= 0) {
+        output.clear();
+        return 0;
+    }
+
+    auto mono_stereo = [input](size_t i) -> int16_t {
+        return (int16_t)((input[i * 2] + input[i * 2 + 1]) >> 1);
+    };
+    auto mono_any = [input, channels](size_t i) -> int16_t {
+        int32_t sum = 0;
+        for (int c = 0; c < channels; ++c) {
+            sum += input[i * channels + c];
+        }
+        return (int16_t)(sum / channels);
+    };
+    auto downmix = [&](int16_t* out) {
+        if (channels == 1) {
+            memcpy(out, input, frames * sizeof(int16_t));
+        } else if (channels == 2) {
+            for (size_t i = 0; i < frames; ++i) {
+                out[i] = mono_stereo(i);
+            }
+        } else {
+            for (size_t i = 0; i < frames; ++i) {
+                out[i] = mono_any(i);
+            }
+        }
+    };
+
+    if (input_rate_ == output_rate_) {
+        // 采样率相同：只做声道混合
+        output.resize(frames);
+        downmix(output.data());
+        return frames;
+    }
+
+    // 混合后的单声道样本接在上一帧留下的历史样本后面
+    const size_t history = taps_ - 1;
+    if (work_.size() < history + frames) {
+        work_.resize(history + frames);
+    }
+    downmix(work_.data() + history);
+
+    // 本帧能产生的输出个数：窗口起点 position_ + k * step_ 落在 [0, frames) 之内的 k 的个数
+    uint64_t end = (uint64_t)frames << 32;
+    size_t count = position_ < end ? (end - position_ + step_ - 1) / step_ : 0;
+    output.resize(count);
+    int16_t* out = output.data();
+
+    const int taps = taps_;
+    const int16_t* work = work_.data();
+    const int16_t* coefficients = coefficients_.data();
+    uint64_t pos = position_;
+    for (size_t n = 0; n < count; ++n) {
+        const int16_t* x = work + (pos >> 32);
+        uint32_t frac = (uint32_t)pos;
+        const int16_t* h0 = coefficients + (frac >> (32 - PHASE_BITS)) * taps;
+        const int16_t* h1 = h0 + taps;
+        // 相邻两个相位之间的位置（Q15）
+        int32_t sub = (frac >> (32 - PHASE_BITS - 15)) & 0x7FFF;
+
+        int32_t acc0 = 0;
+        int32_t acc1 = 0;
+        for (int k = 0; k < taps; ++k) {
+            acc0 += x[k] * h0[k];
+            acc1 += x[k] * h1[k];
+        }
+        int64_t y = acc0 + ((((int64_t)acc1 - acc0) * sub) >> 15);
+        y = (y + (1 << 14)) >> 15;
+        out[n] = (int16_t)std::max<int64_t>(INT16_MIN, std::min<int64_t>(INT16_MAX, y));
+        pos += step_;
+    }
+    position_ = pos - end;
+
+    // 最后 taps - 1 个样本留作下一帧的历史
+    memmove(work_.data(), work_.data() + frames, history * sizeof(int16_t));
+    return count;
+}
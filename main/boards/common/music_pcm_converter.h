@@ -0,0 +1,56 @@
+#ifndef MUSIC_PCM_CONVERTER_H
+#define MUSIC_PCM_CONVERTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * 音乐输出转换：多声道->单声道混合 + 采样率转换，直接写入调用者复用的输出帧。
+ *
+ * - 重采样为定点多相FIR（Kaiser窗 sinc），支持任意比例（例如 44.1kHz -> 24kHz、22.05kHz -> 24kHz），
+ *   输出长度严格符合比例，滤波器历史和相位跨帧保留，帧与帧之间没有接缝
+ * - 每个输出样本是两个相邻相位的点积再按小数位置插值，内层循环是连续的 int16 x int16 -> int32 乘加
+ * - 截止频率取输入、输出中较低的奈奎斯特频率，降采样时按比例加长滤波器，不需要改变 I2S 时钟
+ * - 采样率相同时退化为单纯的混合（单声道时为一次拷贝）
+ * - 系数表只在 Configure 时计算，工作缓冲区和输出帧只在容量不足时增长，稳定播放后不再有堆操作
+ */
+class MusicPcmConverter {
+public:
+    // 输入格式或输出采样率变化时调用，会重新计算滤波器并清除跨帧状态
+    void Configure(int input_rate, int input_channels, int output_rate);
+    // 跳转或换歌后调用，丢弃上一段音频的滤波器历史
+    void Reset();
+
+    int input_rate() const { return input_rate_; }
+    int input_channels() const { return input_channels_; }
+    int output_rate() const { return output_rate_; }
+    int taps() const { return taps_; }
+
+    // input 为交错的多声道样本（合计 input_samples 个），返回写入 output 的单声道样本数
+    size_t Process(const int16_t* input, size_t input_samples, std::vector<int16_t>& output);
+
+private:
+    static constexpr int PHASE_BITS = 6;
+    static constexpr int PHASES = 1 << PHASE_BITS;
+    static constexpr int BASE_TAPS = 32;  // 升采样时的滤波器长度，降采样时按比例加长
+    static constexpr int MAX_TAPS = 64;
+
+    int input_rate_ = 0;
+    int input_channels_ = 0;
+    int output_rate_ = 0;
+    int taps_ = 0;
+
+    // PHASES + 1 行系数，第 r 行对应 r / PHASES 个样本的小数延迟（Q15）
+    std::vector<int16_t> coefficients_;
+    // 单声道输入：前 taps_ - 1 个是上一帧留下的历史样本
+    std::vector<int16_t> work_;
+
+    // 下一个输出样本的滤波窗口在 work_ 中的起点（Q32），以及每个输出样本前进的距离
+    uint64_t position_ = 0;
+    uint64_t step_ = 1ULL << 32;
+
+    void BuildFilter();
+};
+
+#endif // MUSIC_PCM_CONVERTER_H
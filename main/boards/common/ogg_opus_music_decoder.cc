@@ -0,0 +1,270 @@
+#include "ogg_opus_music_decoder.h"
+
+#include <esp_log.h>
+#include <algorithm>
+#include <cstring>
+
+#define TAG "OggOpusMusicDecoder"
+
+OggOpusMusicDecoder::OggOpusMusicDecoder(int output_sample_rate) {
+    // libopus 只能直接输出这几种采样率
+    static const int kOpusRates[] = {8000, 12000, 16000, 24000, 48000};
+    sample_rate_ = 48000;
+    for (int rate : kOpusRates) {
+        if (rate >= output_sample_rate) {
+            sample_rate_ = rate;
+            break;
+        }
+    }
+    packet_.reserve(PACKET_RESERVE_SIZE);
+}
+
+int OggOpusMusicDecoder::bitrate_kbps() const {
+    if (audio_samples_ == 0) {
+        return 0;
+    }
+    return (int)(audio_bytes_ * 8 * sample_rate_ / audio_samples_ / 1000);
+}
+
+// 根据 TOC 字节计算一个包解码后的样本数（RFC 6716 3.1）
+int OggOpusMusicDecoder::PacketSamples(const uint8_t* packet, size_t size) const {
+    if (size < 1) {
+        return 0;
+    }
+    static const int kFrameSamples48k[32] = {
+        480, 960, 1920, 2880, 480, 960, 1920, 2880, 480, 960, 1920, 2880,  // SILK
+        480, 960, 480, 960,                                                  // Hybrid
+        120, 240, 480, 960, 120, 240, 480, 960, 120, 240, 480, 960, 120, 240, 480, 960,  // CELT
+    };
+    int frames;
+    switch (packet[0] & 0x03) {
+        case 0:
+            frames = 1;
+            break;
+        case 3:
+            if (size < 2) {
+                return 0;
+            }
+            frames = packet[1] & 0x3F;
+            break;
+        default:
+            frames = 2;
+            break;
+    }
+    return kFrameSamples48k[packet[0] >> 3] * frames / (48000 / sample_rate_);
+}
+
+int OggOpusMusicDecoder::HandlePacket(std::vector<int16_t>& pcm) {
+    if (!head_parsed_) {
+        if (packet_.size() < 19 || memcmp(packet_.data(), "OpusHead", 8) != 0) {
+            ESP_LOGE(TAG, "Ogg stream does not contain Opus audio");
+            unsupported_ = true;
+            return 0;
+        }
+        int channels = packet_[9];
+        int mapping_family = packet_[18];
+        if (mapping_family != 0) {
+            ESP_LOGE(TAG, "Unsupported Opus channel mapping family: %d (%d channels)", mapping_family, channels);
+            unsupported_ = true;
+            return 0;
+        }
+        // pre-skip 以48kHz样本计
+        head_pre_skip_ = packet_[10] | (packet_[11] << 8);
+        pre_skip_ = head_pre_skip_ / (48000 / sample_rate_);
+        opus_ = std::make_unique<OpusDecoderWrapper>(sample_rate_, 1, MAX_PACKET_DURATION_MS);
+        head_parsed_ = true;
+        ESP_LOGI(TAG, "Ogg Opus: %d channels, decoding to %d Hz mono, pre-skip %d", channels, sample_rate_, pre_skip_);
+        return 0;
+    }
+    if (!tags_skipped_) {
+        tags_skipped_ = true;
+        if (packet_.size() >= 8 && memcmp(packet_.data(), "OpusTags", 8) == 0) {
+            return 0;
+        }
+    }
+
+    int samples = PacketSamples(packet_.data(), packet_.size());
+    if (samples <= 0) {
+        return 0;
+    }
+    audio_bytes_ += packet_.size();
+    // OpusDecoderWrapper 接收右值：交给它一个临时的包，解码后把缓冲区换回来，
+    // 不让预留的缓冲区随 move 一起丢掉，否则之后每个包都要重新分配
+    std::vector<uint8_t> packet;
+    packet.swap(packet_);
+    bool decoded = opus_->Decode(std::move(packet), pcm);
+    packet_.swap(packet);
+    if (packet_.capacity() < PACKET_RESERVE_SIZE) {
+        packet_.reserve(PACKET_RESERVE_SIZE);
+    }
+    if (!decoded) {
+        return 0;
+    }
+    audio_samples_ += samples;
+    samples = std::min<int>(samples, pcm.size());
+    pcm.resize(samples);
+
+    // 丢弃编码器在开头填充的样本
+    if (pre_skip_ > 0) {
+        int skip = std::min(pre_skip_, samples);
+        pcm.erase(pcm.begin(), pcm.begin() + skip);
+        pre_skip_ -= skip;
+        samples -= skip;
+    }
+    return samples;
+}
+
+MusicDecoder::Result OggOpusMusicDecoder::Decode(const uint8_t* data, size_t size, bool end_of_stream, std::vector<int16_t>& pcm) {
+    Result result;
+    pcm.clear();
+    size_t& pos = result.consumed;
+
+    while (result.samples == 0) {
+        if (unsupported_) {
+            // 无法解码的数据全部丢弃
+            pos = size;
+            result.need_more = true;
+            break;
+        }
+
+        if (segment_index_ >= segment_count_) {
+            // 当前页已处理完，解析下一个页头
+            if (size - pos < PAGE_HEADER_SIZE) {
+                result.need_more = true;
+                break;
+            }
+            const uint8_t* page = data + pos;
+            if (memcmp(page, "OggS", 4) != 0 || page[4] != 0) {
+                // 失去同步（或跳转到了页中间），查找下一个页头
+                const uint8_t* next = nullptr;
+                for (size_t i = pos + 1; i + 4 <= size; i++) {
+                    if (memcmp(data + i, "OggS", 4) == 0) {
+                        next = data + i;
+                        break;
+                    }
+                }
+                pos = next ? next - data : size - 3;
+                packet_.clear();
+                skip_packet_ = true;
+                continue;
+            }
+            int count = page[26];
+            if (size - pos < PAGE_HEADER_SIZE + count) {
+                result.need_more = true;
+                break;
+            }
+            bool continued = page[5] & 0x01;
+            if (!continued) {
+                // 上一个包没有在上一页结束，说明数据有缺失
+                packet_.clear();
+                skip_packet_ = false;
+            } else if (packet_.empty()) {
+                skip_packet_ = true;
+            }
+            memcpy(segments_, page + PAGE_HEADER_SIZE, count);
+            // 记录音频页的 granule position（没有包在本页结束时为-1，头部页为0）用于跳转
+            uint64_t granule = 0;
+            for (int i = 7; i >= 0; i--) {
+                granule = (granule << 8) | page[6 + i];
+            }
+            if (granule > 0 && granule != UINT64_MAX) {
+                size_t page_offset = position_ + pos;
+                size_t page_size = PAGE_HEADER_SIZE + count;
+                for (int i = 0; i < count; i++) {
+                    page_size += segments_[i];
+                }
+                if (first_granule_ == 0) {
+                    audio_start_offset_ = page_offset;
+                    first_granule_ = (int64_t)granule;
+                    first_granule_offset_ = page_offset + page_size;
+                }
+                last_granule_ = (int64_t)granule;
+                last_granule_offset_ = page_offset + page_size;
+            }
+            segment_count_ = count;
+            segment_index_ = 0;
+            segment_offset_ = 0;
+            pos += PAGE_HEADER_SIZE + count;
+            continue;
+        }
+
+        // 把当前段的数据追加到包中，段可能跨越多次调用
+        size_t segment_size = segments_[segment_index_];
+        size_t take = std::min(segment_size - segment_offset_, size - pos);
+        if (!skip_packet_) {
+            packet_.insert(packet_.end(), data + pos, data + pos + take);
+        }
+        pos += take;
+        segment_offset_ += take;
+        if (segment_offset_ < segment_size) {
+            result.need_more = true;
+            break;
+        }
+        segment_index_++;
+        segment_offset_ = 0;
+
+        // 长度小于255的段结束一个包
+        if (segment_size < 255) {
+            if (skip_packet_) {
+                skip_packet_ = false;
+            } else {
+                result.samples = HandlePacket(pcm);
+            }
+            packet_.clear();
+        }
+    }
+    position_ += pos;
+    return result;
+}
+
+void OggOpusMusicDecoder::Reset() {
+    opus_.reset();
+    segment_count_ = 0;
+    segment_index_ = 0;
+    segment_offset_ = 0;
+    skip_packet_ = false;
+    packet_.clear();
+    head_parsed_ = false;
+    tags_skipped_ = false;
+    unsupported_ = false;
+    pre_skip_ = 0;
+    head_pre_skip_ = 0;
+    position_ = 0;
+    audio_start_offset_ = 0;
+    first_granule_ = 0;
+    first_granule_offset_ = 0;
+    last_granule_ = 0;
+    last_granule_offset_ = 0;
+    audio_bytes_ = 0;
+    audio_samples_ = 0;
+}
+
+void OggOpusMusicDecoder::Restart(size_t offset) {
+    // 丢弃当前页，从下一个页头重新同步
+    segment_count_ = 0;
+    segment_index_ = 0;
+    segment_offset_ = 0;
+    packet_.clear();
+    skip_packet_ = true;
+    pre_skip_ = 0;
+    position_ = offset;
+    if (opus_) {
+        opus_->ResetState();
+    }
+}
+
+bool OggOpusMusicDecoder::TimeToOffset(int64_t time_ms, size_t* offset) const {
+    if (time_ms < 0 || last_granule_ - first_granule_ < MIN_SEEK_GRANULE ||
+        last_granule_offset_ <= first_granule_offset_) {
+        return false;
+    }
+    // granule 以48kHz样本计，包含开头的 pre-skip
+    int64_t granule = time_ms * 48 + head_pre_skip_;
+    if (granule <= first_granule_) {
+        *offset = audio_start_offset_;
+        return true;
+    }
+    uint64_t bytes = last_granule_offset_ - first_granule_offset_;
+    *offset = first_granule_offset_ + (size_t)(bytes * (granule - first_granule_) / (last_granule_ - first_granule_));
+    return true;
+}
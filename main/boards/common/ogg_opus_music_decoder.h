@@ -0,0 +1,76 @@
+#ifndef OGG_OPUS_MUSIC_DECODER_H
+#define OGG_OPUS_MUSIC_DECODER_H
+
+#include "music_decoder.h"
+
+#include <memory>
+#include <opus_decoder.h>
+
+/*
+ * Ogg Opus 解码器：增量解析 Ogg 页和包，用固件中已有的 OpusDecoderWrapper 解码。
+ *
+ * - 只支持单个逻辑流、声道映射族0（单声道/立体声）
+ * - 解码器以单声道创建，立体声由 libopus 在解码时直接混合，省去再做一次下混
+ * - 输出采样率取不低于目标采样率的 Opus 原生采样率，避免之后再重采样
+ * - 跳转后从中间开始时，丢弃数据直到下一个页头
+ * - 时间按已解析的页的 granule position 映射为偏移：在第一个音频页和最近一页的结尾之间按字节
+ *   线性插值或外推，Opus 通常是VBR，跳转的位置是估算的
+ */
+class OggOpusMusicDecoder : public MusicDecoder {
+public:
+    explicit OggOpusMusicDecoder(int output_sample_rate);
+
+    MusicFormat format() const override { return MusicFormat::kOggOpus; }
+
+    Result Decode(const uint8_t* data, size_t size, bool end_of_stream, std::vector<int16_t>& pcm) override;
+
+    int sample_rate() const override { return opus_ ? sample_rate_ : 0; }
+    int channels() const override { return opus_ ? 1 : 0; }
+    int bitrate_kbps() const override;
+
+    void Reset() override;
+    void Restart(size_t offset) override;
+    bool TimeToOffset(int64_t time_ms, size_t* offset) const override;
+
+private:
+    static constexpr size_t PAGE_HEADER_SIZE = 27;
+    // 一个 Opus 包最长 120ms
+    static constexpr int MAX_PACKET_DURATION_MS = 120;
+    static constexpr size_t PACKET_RESERVE_SIZE = 1024;
+    // 至少解析到这么多样本（48kHz）后才按 granule 估算跳转位置，太短时码率不可靠
+    static constexpr int64_t MIN_SEEK_GRANULE = 48000;
+
+    int sample_rate_;
+    std::unique_ptr<OpusDecoderWrapper> opus_;
+
+    // 当前页的分段表
+    uint8_t segments_[255];
+    int segment_count_ = 0;
+    int segment_index_ = 0;
+    size_t segment_offset_ = 0;
+    uint32_t serial_ = 0;
+    bool skip_packet_ = false;  // 丢弃同步丢失后残留的半个包
+
+    std::vector<uint8_t> packet_;
+    bool head_parsed_ = false;
+    bool tags_skipped_ = false;
+    bool unsupported_ = false;
+    int pre_skip_ = 0;          // 开头还需要丢弃的样本数（输出采样率下）
+    int head_pre_skip_ = 0;     // OpusHead 中的 pre-skip（48kHz），granule 0 之后的这些样本不计入时间
+
+    // 偏移都相对于本首歌解码器读取的第一个字节
+    size_t position_ = 0;                // 本次 Decode 的 data 开头的偏移
+    size_t audio_start_offset_ = 0;      // 第一个音频页的起始偏移
+    int64_t first_granule_ = 0;          // 第一个音频页的 granule position
+    size_t first_granule_offset_ = 0;    // 第一个音频页结束的偏移
+    int64_t last_granule_ = 0;           // 最近解析到的页的 granule position
+    size_t last_granule_offset_ = 0;     // 该页结束的偏移
+
+    uint64_t audio_bytes_ = 0;
+    uint64_t audio_samples_ = 0;
+
+    int HandlePacket(std::vector<int16_t>& pcm);
+    int PacketSamples(const uint8_t* packet, size_t size) const;
+};
+
+#endif // OGG_OPUS_MUSIC_DECODER_H
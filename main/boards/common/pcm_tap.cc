@@ -0,0 +1,81 @@
+#include "pcm_tap.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <algorithm>
+#include <cstring>
+
+#define TAG "PcmTap"
+
+PcmTap::PcmTap() {
+    history_ = (int16_t*)heap_caps_calloc(HISTORY_SAMPLES, sizeof(int16_t), MALLOC_CAP_SPIRAM);
+    if (history_ == nullptr) {
+        ESP_LOGW(TAG, "Failed to allocate PCM history in PSRAM, falling back to internal RAM");
+        history_ = (int16_t*)heap_caps_calloc(HISTORY_SAMPLES, sizeof(int16_t), MALLOC_CAP_8BIT);
+    }
+    if (history_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate PCM history (%u samples)", (unsigned)HISTORY_SAMPLES);
+    }
+}
+
+PcmTap::~PcmTap() {
+    if (history_ != nullptr) {
+        heap_caps_free(history_);
+    }
+}
+
+void PcmTap::Write(const int16_t* pcm, size_t samples, int sample_rate) {
+    if (history_ == nullptr || samples == 0) {
+        return;
+    }
+    // 只有最后 HISTORY_SAMPLES 个样本会留下来
+    if (samples > HISTORY_SAMPLES) {
+        pcm += samples - HISTORY_SAMPLES;
+        samples = HISTORY_SAMPLES;
+    }
+    sample_rate_.store(sample_rate, std::memory_order_relaxed);
+
+    uint32_t count = write_count_.load(std::memory_order_relaxed);
+    // 先公布将要改写的区间，再改写数据
+    write_target_.store(count + samples, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    size_t start = count & (HISTORY_SAMPLES - 1);
+    size_t first = std::min(samples, HISTORY_SAMPLES - start);
+    memcpy(history_ + start, pcm, first * sizeof(int16_t));
+    if (first < samples) {
+        memcpy(history_, pcm + first, (samples - first) * sizeof(int16_t));
+    }
+
+    write_count_.store(count + samples, std::memory_order_release);
+}
+
+bool PcmTap::Snapshot(int16_t* out, size_t samples, uint32_t* version) const {
+    if (history_ == nullptr || samples == 0 || samples > HISTORY_SAMPLES) {
+        return false;
+    }
+    for (int attempt = 0; attempt < MAX_SNAPSHOT_RETRIES; attempt++) {
+        uint32_t end = write_count_.load(std::memory_order_acquire);
+        if (end < samples) {
+            return false;  // 还没写够（版本号回绕时也会短暂出现，约每27小时一次）
+        }
+        uint32_t begin = end - samples;
+        size_t start = begin & (HISTORY_SAMPLES - 1);
+        size_t first = std::min(samples, HISTORY_SAMPLES - start);
+        memcpy(out, history_ + start, first * sizeof(int16_t));
+        if (first < samples) {
+            memcpy(out + first, history_, (samples - first) * sizeof(int16_t));
+        }
+
+        // 复制期间写者最多改写到 write_target_，没有覆盖 [begin, end) 就说明快照完整
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint32_t target = write_target_.load(std::memory_order_relaxed);
+        if (target - begin <= HISTORY_SAMPLES) {
+            if (version != nullptr) {
+                *version = end;
+            }
+            return true;
+        }
+    }
+    return false;
+}
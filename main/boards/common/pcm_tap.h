@@ -0,0 +1,47 @@
+#ifndef PCM_TAP_H
+#define PCM_TAP_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * 已播放音频的旁路：保存最近 HISTORY_SAMPLES 个单声道样本，供频谱、音量表、灯效、节拍检测等读取。
+ *
+ * - 单个写者（音乐播放线程），任意数量的读者，双方都不加锁，读者不会阻塞写者
+ * - 写者在改写存储区之前先公布将要写到的位置（write_target_），写完后再推进 write_count_；
+ *   读者复制完数据后检查 write_target_，只要复制的区间没有被改写，快照就是完整的，
+ *   否则重试（类似 seqlock，但写者写入的区间与读者读取的区间不重叠时不会让读者重试）
+ * - 版本号为累计写入的样本数（32位，回绕后按差值比较），读者据此判断有没有新数据
+ * - 存储区在构造时一次性分配（优先 PSRAM）
+ */
+class PcmTap {
+public:
+    static constexpr size_t HISTORY_SAMPLES = 4096;  // 必须是2的幂
+
+    PcmTap();
+    ~PcmTap();
+
+    PcmTap(const PcmTap&) = delete;
+    PcmTap& operator=(const PcmTap&) = delete;
+
+    // 写者接口
+    void Write(const int16_t* pcm, size_t samples, int sample_rate);
+
+    // 读者接口
+    // 复制最近的 samples 个样本到 out（按时间顺序），version 返回这段数据末尾的版本号。
+    // 写入的数据还不够，或者多次重试都被写者打断时返回 false
+    bool Snapshot(int16_t* out, size_t samples, uint32_t* version = nullptr) const;
+    uint32_t version() const { return write_count_.load(std::memory_order_acquire); }
+    int sample_rate() const { return sample_rate_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr int MAX_SNAPSHOT_RETRIES = 3;
+
+    int16_t* history_ = nullptr;
+    std::atomic<uint32_t> write_count_{0};   // 已经写完的样本数
+    std::atomic<uint32_t> write_target_{0};  // 正在写入的数据写完后的样本数
+    std::atomic<int> sample_rate_{0};
+};
+
+#endif // PCM_TAP_H
@@ -0,0 +1,333 @@
+#include "song_cache.h"
+
+#include <esp_log.h>
+#include <algorithm>
+#include <cstring>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define TAG "SongCache"
+
+#define INDEX_FILE_NAME "index.txt"
+#define INDEX_TEMP_NAME "index.tmp"
+#define DATA_TEMP_NAME  "pending.tmp"
+
+// 索引文件按行、按制表符分隔字段，字段本身不能含有这两种字符
+static bool IsIndexSafe(const std::string& text) {
+    return text.find_first_of("\t\n") == std::string::npos;
+}
+
+// 读取一整行（不含换行符），带签名的CDN地址可能很长，行长度不设上限
+static bool ReadLine(FILE* file, std::string* line) {
+    char chunk[256];
+    line->clear();
+    while (fgets(chunk, sizeof(chunk), file) != nullptr) {
+        size_t length = strlen(chunk);
+        if (length > 0 && chunk[length - 1] == '\n') {
+            line->append(chunk, length - 1);
+            return true;
+        }
+        line->append(chunk, length);
+    }
+    // 文件末尾没有换行符的最后一行
+    return !line->empty();
+}
+
+SongCache::SongCache(const std::string& base_path, size_t budget_bytes)
+    : base_path_(base_path), budget_bytes_(budget_bytes) {
+}
+
+SongCache::~SongCache() {
+    AbortWrite();
+}
+
+std::string SongCache::DataPath(const Entry& entry) const {
+    return base_path_ + "/" + entry.file_name;
+}
+
+// 分配一个没有被任何条目或文件占用的数据文件名，序号生成的短文件名不超过SPIFFS的长度限制；
+// 文件内容可能是任何一种音频格式，不带扩展名。调用前需持有锁
+std::string SongCache::NewFileName() {
+    while (true) {
+        char name[16];
+        snprintf(name, sizeof(name), "%08lx", (unsigned long)next_file_id_++);
+        bool used = std::any_of(entries_.begin(), entries_.end(),
+            [&name](const Entry& entry) { return entry.file_name == name; });
+        struct stat st;
+        if (!used && stat((base_path_ + "/" + name).c_str(), &st) != 0) {
+            return name;
+        }
+    }
+}
+
+std::string SongCache::TempPath() const {
+    return base_path_ + "/" DATA_TEMP_NAME;
+}
+
+std::string SongCache::IndexPath() const {
+    return base_path_ + "/" INDEX_FILE_NAME;
+}
+
+void SongCache::Load() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    used_bytes_ = 0;
+    use_counter_ = 0;
+    next_file_id_ = 0;
+
+    FILE* file = fopen(IndexPath().c_str(), "r");
+    if (file != nullptr) {
+        std::string line;
+        while (ReadLine(file, &line)) {
+            std::vector<std::string> fields;
+            // 空字段（如没有歌手）也要保留，不能用 strtok
+            size_t start = 0;
+            while (true) {
+                size_t tab = line.find('\t', start);
+                if (tab == std::string::npos) {
+                    fields.emplace_back(line, start);
+                    break;
+                }
+                fields.emplace_back(line, start, tab - start);
+                start = tab + 1;
+            }
+            // 旧格式（按歌名哈希命名文件）的条目不再使用，其数据文件在下面被清理
+            if (fields.size() != 7) {
+                continue;
+            }
+
+            Entry entry;
+            entry.size = strtoul(fields[0].c_str(), nullptr, 10);
+            entry.last_used = strtoul(fields[1].c_str(), nullptr, 10);
+            entry.file_name = fields[2];
+            entry.song_name = fields[3];
+            entry.artist_name = fields[4];
+            entry.audio_url = fields[5];
+            entry.lyric_url = fields[6];
+
+            // 文件名非法、与前面的条目重复、数据文件缺失或长度不符的条目直接丢弃
+            if (entry.file_name.empty() || entry.file_name.find_first_of("/.") != std::string::npos ||
+                std::any_of(entries_.begin(), entries_.end(),
+                    [&entry](const Entry& other) { return other.file_name == entry.file_name; })) {
+                continue;
+            }
+            struct stat st;
+            if (stat(DataPath(entry).c_str(), &st) != 0 || (size_t)st.st_size != entry.size) {
+                continue;
+            }
+            used_bytes_ += entry.size;
+            use_counter_ = std::max(use_counter_, entry.last_used);
+            next_file_id_ = std::max(next_file_id_, (uint32_t)strtoul(entry.file_name.c_str(), nullptr, 16) + 1);
+            entries_.push_back(std::move(entry));
+        }
+        fclose(file);
+    }
+
+    // 删除上次断电时留下的临时文件和不在索引中的数据文件
+    DIR* dir = opendir(base_path_.c_str());
+    if (dir != nullptr) {
+        std::vector<std::string> orphans;
+        struct dirent* item;
+        while ((item = readdir(dir)) != nullptr) {
+            if (item->d_name[0] == '.') {
+                continue;
+            }
+            std::string path = base_path_ + "/" + item->d_name;
+            if (path == IndexPath()) {
+                continue;
+            }
+            bool referenced = std::any_of(entries_.begin(), entries_.end(),
+                [this, &path](const Entry& entry) { return DataPath(entry) == path; });
+            if (!referenced) {
+                orphans.push_back(path);
+            }
+        }
+        closedir(dir);
+        for (auto& path : orphans) {
+            remove(path.c_str());
+        }
+    }
+
+    ESP_LOGI(TAG, "Loaded %u cached songs, %u / %u bytes used",
+             (unsigned)entries_.size(), (unsigned)used_bytes_, (unsigned)budget_bytes_);
+}
+
+std::vector<SongCache::Entry>::iterator SongCache::Find(const std::string& song_name, const std::string& artist_name) {
+    return std::find_if(entries_.begin(), entries_.end(), [&](const Entry& entry) {
+        return entry.song_name == song_name && entry.artist_name == artist_name;
+    });
+}
+
+bool SongCache::Lookup(const std::string& song_name, const std::string& artist_name, Entry* entry) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = Find(song_name, artist_name);
+    if (it == entries_.end()) {
+        return false;
+    }
+    *entry = *it;
+    return true;
+}
+
+void SongCache::Touch(const Entry& entry) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = Find(entry.song_name, entry.artist_name);
+    if (it != entries_.end()) {
+        it->last_used = ++use_counter_;
+        SaveIndex();
+    }
+}
+
+FILE* SongCache::OpenForRead(const Entry& entry) {
+    return fopen(DataPath(entry).c_str(), "rb");
+}
+
+void SongCache::SaveIndex() {
+    std::string temp_path = base_path_ + "/" INDEX_TEMP_NAME;
+    FILE* file = fopen(temp_path.c_str(), "w");
+    if (file == nullptr) {
+        ESP_LOGW(TAG, "Failed to write cache index");
+        return;
+    }
+    for (auto& entry : entries_) {
+        fprintf(file, "%u\t%lu\t%s\t%s\t%s\t%s\t%s\n", (unsigned)entry.size, (unsigned long)entry.last_used,
+                entry.file_name.c_str(), entry.song_name.c_str(), entry.artist_name.c_str(),
+                entry.audio_url.c_str(), entry.lyric_url.c_str());
+    }
+    fclose(file);
+
+    // SPIFFS 的 rename 不会覆盖已存在的文件
+    remove(IndexPath().c_str());
+    rename(temp_path.c_str(), IndexPath().c_str());
+}
+
+// 按LRU淘汰，直到能再放下 bytes 字节；调用前需持有锁
+bool SongCache::EvictFor(size_t bytes) {
+    if (bytes > budget_bytes_) {
+        return false;
+    }
+    bool evicted = false;
+    while (used_bytes_ + bytes > budget_bytes_ && !entries_.empty()) {
+        auto oldest = std::min_element(entries_.begin(), entries_.end(),
+            [](const Entry& a, const Entry& b) { return a.last_used < b.last_used; });
+        ESP_LOGI(TAG, "Evicting cached song: %s (%u bytes)", oldest->song_name.c_str(), (unsigned)oldest->size);
+        remove(DataPath(*oldest).c_str());
+        used_bytes_ -= oldest->size;
+        entries_.erase(oldest);
+        evicted = true;
+    }
+    if (evicted) {
+        SaveIndex();
+    }
+    return used_bytes_ + bytes <= budget_bytes_;
+}
+
+bool SongCache::writing() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return write_file_ != nullptr;
+}
+
+bool SongCache::BeginWrite(const Entry& meta, size_t expected_size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    AbortWriteLocked();
+    if (meta.song_name.empty() || !IsIndexSafe(meta.song_name) || !IsIndexSafe(meta.artist_name) ||
+        !IsIndexSafe(meta.audio_url) || !IsIndexSafe(meta.lyric_url)) {
+        return false;
+    }
+
+    // 重新下载的歌曲替换旧的缓存
+    auto it = Find(meta.song_name, meta.artist_name);
+    if (it != entries_.end()) {
+        remove(DataPath(*it).c_str());
+        used_bytes_ -= it->size;
+        entries_.erase(it);
+        SaveIndex();
+    }
+    if (!EvictFor(expected_size)) {
+        ESP_LOGI(TAG, "Song too large to cache: %u bytes", (unsigned)expected_size);
+        return false;
+    }
+
+    write_file_ = fopen(TempPath().c_str(), "wb");
+    if (write_file_ == nullptr) {
+        ESP_LOGW(TAG, "Failed to create cache file");
+        return false;
+    }
+    write_entry_ = meta;
+    write_entry_.size = 0;
+    write_reserved_ = expected_size;
+    return true;
+}
+
+bool SongCache::Append(const uint8_t* data, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (write_file_ == nullptr) {
+        return false;
+    }
+    size_t total = write_entry_.size + size;
+    if (total > write_reserved_) {
+        // 长度未知或超出预期时，边写边腾出空间
+        if (!EvictFor(total)) {
+            ESP_LOGI(TAG, "Song exceeds cache budget, not caching");
+            AbortWriteLocked();
+            return false;
+        }
+        write_reserved_ = total;
+    }
+    if (fwrite(data, 1, size, write_file_) != size) {
+        ESP_LOGW(TAG, "Cache write failed, partition may be full");
+        AbortWriteLocked();
+        return false;
+    }
+    write_entry_.size = total;
+    return true;
+}
+
+bool SongCache::CommitWrite() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (write_file_ == nullptr) {
+        return false;
+    }
+    bool ok = fclose(write_file_) == 0;
+    write_file_ = nullptr;
+    if (!ok || write_entry_.size == 0) {
+        remove(TempPath().c_str());
+        return false;
+    }
+
+    // BeginWrite 已经移除了同名的旧缓存，这里再检查一次，保证每首歌只有一个条目
+    auto it = Find(write_entry_.song_name, write_entry_.artist_name);
+    if (it != entries_.end()) {
+        remove(DataPath(*it).c_str());
+        used_bytes_ -= it->size;
+        entries_.erase(it);
+    }
+    write_entry_.file_name = NewFileName();
+    std::string path = DataPath(write_entry_);
+    if (rename(TempPath().c_str(), path.c_str()) != 0) {
+        ESP_LOGW(TAG, "Failed to commit cached song");
+        remove(TempPath().c_str());
+        return false;
+    }
+    write_entry_.last_used = ++use_counter_;
+    used_bytes_ += write_entry_.size;
+    entries_.push_back(write_entry_);
+    SaveIndex();
+    ESP_LOGI(TAG, "Cached song: %s (%u bytes, %u / %u bytes used)", write_entry_.song_name.c_str(),
+             (unsigned)write_entry_.size, (unsigned)used_bytes_, (unsigned)budget_bytes_);
+    return true;
+}
+
+void SongCache::AbortWrite() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    AbortWriteLocked();
+}
+
+// 调用前需持有锁
+void SongCache::AbortWriteLocked() {
+    if (write_file_ == nullptr) {
+        return;
+    }
+    fclose(write_file_);
+    write_file_ = nullptr;
+    remove(TempPath().c_str());
+}
@@ -0,0 +1,83 @@
+#ifndef SONG_CACHE_H
+#define SONG_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * 歌曲缓存：把完整下载过的歌曲保存在闪存分区上，再次播放时直接从闪存读取。
+ *
+ * - 以 歌名+歌手 为键，同时记录解析出的音频URL和歌词URL，命中时不需要再请求歌曲详情
+ * - 总大小受字节预算限制，超出时按最近最少使用（LRU）淘汰
+ * - 数据文件名由递增的序号生成并记录在索引中，不同的歌曲不会共用一个文件
+ * - 下载过程中顺带写入临时文件，只有完整下载的歌曲才会被提交进缓存
+ *
+ * 只使用标准文件接口访问 base_path 下的文件，设备上挂载 SPIFFS 分区后使用，
+ * 在主机上也可以直接指向一个普通目录。
+ */
+class SongCache {
+public:
+    struct Entry {
+        std::string song_name;
+        std::string artist_name;
+        std::string audio_url;
+        std::string lyric_url;
+        std::string file_name;   // 数据文件名，提交时由缓存分配
+        size_t size = 0;
+        uint32_t last_used = 0;  // LRU序号，越大表示越近使用过
+    };
+
+    SongCache(const std::string& base_path, size_t budget_bytes);
+    ~SongCache();
+
+    SongCache(const SongCache&) = delete;
+    SongCache& operator=(const SongCache&) = delete;
+
+    // 读取索引，清理索引中不存在的缓存文件和上次未完成的临时文件
+    void Load();
+
+    bool Lookup(const std::string& song_name, const std::string& artist_name, Entry* entry);
+    // 真正从缓存播放时调用，更新LRU
+    void Touch(const Entry& entry);
+    // 打开缓存的音频数据，调用者负责 fclose
+    FILE* OpenForRead(const Entry& entry);
+
+    // 写入接口，同一时间只有一个写入者（下载线程）。expected_size 为 0 表示长度未知
+    bool BeginWrite(const Entry& meta, size_t expected_size);
+    bool Append(const uint8_t* data, size_t size);
+    bool CommitWrite();
+    void AbortWrite();
+    bool writing() const;
+
+    size_t used_bytes() const { return used_bytes_; }
+    size_t budget_bytes() const { return budget_bytes_; }
+
+private:
+    std::string base_path_;
+    size_t budget_bytes_;
+    size_t used_bytes_ = 0;
+    uint32_t use_counter_ = 0;
+    uint32_t next_file_id_ = 0;
+    std::vector<Entry> entries_;
+    mutable std::mutex mutex_;
+
+    // 写入状态也由 mutex_ 保护
+    FILE* write_file_ = nullptr;
+    Entry write_entry_;
+    size_t write_reserved_ = 0;
+
+    std::string DataPath(const Entry& entry) const;
+    std::string TempPath() const;
+    std::string IndexPath() const;
+    std::string NewFileName();
+    void SaveIndex();
+    bool EvictFor(size_t bytes);
+    void AbortWriteLocked();
+    std::vector<Entry>::iterator Find(const std::string& song_name, const std::string& artist_name);
+};
+
+#endif // SONG_CACHE_H
@@ -0,0 +1,214 @@
+#include "stream_ring_buffer.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <algorithm>
+#include <cstring>
+
+#define TAG "StreamRingBuffer"
+
+#define RING_EVENT_DATA_AVAILABLE   (1 << 0)
+#define RING_EVENT_SPACE_AVAILABLE  (1 << 1)
+
+// 容量取 2 的幂，计数器溢出回绕后索引依然正确
+static size_t RoundUpToPowerOfTwo(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+StreamRingBuffer::StreamRingBuffer(size_t capacity, size_t linear_guard) {
+    capacity_ = RoundUpToPowerOfTwo(capacity);
+    linear_guard_ = linear_guard < capacity_ ? linear_guard : capacity_;
+    size_t storage_size = capacity_ + linear_guard_;
+    storage_ = (uint8_t*)heap_caps_malloc(storage_size, MALLOC_CAP_SPIRAM);
+    if (storage_ == nullptr) {
+        ESP_LOGW(TAG, "Failed to allocate %u bytes in PSRAM, falling back to internal RAM", (unsigned)storage_size);
+        storage_ = (uint8_t*)heap_caps_malloc(storage_size, MALLOC_CAP_8BIT);
+    }
+    if (storage_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate ring buffer storage (%u bytes)", (unsigned)storage_size);
+        capacity_ = 0;
+        linear_guard_ = 0;
+    }
+    event_group_ = xEventGroupCreate();
+}
+
+StreamRingBuffer::~StreamRingBuffer() {
+    if (storage_ != nullptr) {
+        heap_caps_free(storage_);
+    }
+    if (event_group_ != nullptr) {
+        vEventGroupDelete(event_group_);
+    }
+}
+
+size_t StreamRingBuffer::size() const {
+    return write_pos_.load() - read_pos_.load();
+}
+
+size_t StreamRingBuffer::Write(const uint8_t* data, size_t size) {
+    size_t written = 0;
+    while (written < size) {
+        uint8_t* dest = nullptr;
+        size_t contiguous = PrepareWrite(&dest);
+        if (contiguous == 0) {
+            break;
+        }
+        size_t n = std::min(contiguous, size - written);
+        memcpy(dest, data + written, n);
+        CommitWrite(n);
+        written += n;
+    }
+    return written;
+}
+
+size_t StreamRingBuffer::PrepareWrite(uint8_t** data) {
+    if (capacity_ == 0) {
+        return 0;
+    }
+    size_t write_pos = write_pos_.load(std::memory_order_relaxed);
+    size_t free_bytes = capacity_ - (write_pos - read_pos_.load());
+    size_t index = write_pos & (capacity_ - 1);
+    *data = storage_ + index;
+    return std::min(free_bytes, capacity_ - index);
+}
+
+void StreamRingBuffer::CommitWrite(size_t size) {
+    if (size == 0) {
+        return;
+    }
+    write_pos_.fetch_add(size);
+    NotifyDataWaiter();
+}
+
+bool StreamRingBuffer::WaitForSpace(size_t bytes, TickType_t timeout) {
+    bytes = std::min(bytes, capacity_);
+    while (true) {
+        if (closed()) {
+            return false;
+        }
+        if (free_space() >= bytes) {
+            return true;
+        }
+
+        xEventGroupClearBits(event_group_, RING_EVENT_SPACE_AVAILABLE);
+        space_waiter_level_.store(bytes);
+        // 设置水位后再检查一次，防止与消费者的通知擦肩而过
+        if (free_space() >= bytes || closed()) {
+            space_waiter_level_.store(0);
+            continue;
+        }
+
+        EventBits_t bits = xEventGroupWaitBits(event_group_, RING_EVENT_SPACE_AVAILABLE, pdTRUE, pdFALSE, timeout);
+        space_waiter_level_.store(0);
+        if (!(bits & RING_EVENT_SPACE_AVAILABLE)) {
+            return free_space() >= bytes && !closed();
+        }
+    }
+}
+
+size_t StreamRingBuffer::Read(uint8_t* dest, size_t size) {
+    size_t total = 0;
+    while (total < size) {
+        const uint8_t* src = nullptr;
+        size_t contiguous = Peek(&src);
+        if (contiguous == 0) {
+            break;
+        }
+        size_t n = std::min(contiguous, size - total);
+        memcpy(dest + total, src, n);
+        Consume(n);
+        total += n;
+    }
+    return total;
+}
+
+size_t StreamRingBuffer::Peek(const uint8_t** data) const {
+    if (capacity_ == 0) {
+        return 0;
+    }
+    size_t read_pos = read_pos_.load(std::memory_order_relaxed);
+    size_t available = write_pos_.load() - read_pos;
+    size_t index = read_pos & (capacity_ - 1);
+    *data = storage_ + index;
+    return std::min(available, capacity_ - index);
+}
+
+size_t StreamRingBuffer::PeekLinear(const uint8_t** data, size_t bytes) {
+    size_t contiguous = Peek(data);
+    size_t available = size();
+    bytes = std::min(bytes, available);
+    if (contiguous >= bytes) {
+        return contiguous;
+    }
+
+    // 数据跨越了回绕点：把开头已提交的数据复制到尾部保留区，拼成连续的一段
+    size_t wrapped = std::min(bytes - contiguous, linear_guard_);
+    memcpy(storage_ + capacity_, storage_, wrapped);
+    return contiguous + wrapped;
+}
+
+void StreamRingBuffer::Consume(size_t size) {
+    if (size == 0) {
+        return;
+    }
+    read_pos_.fetch_add(size);
+    NotifySpaceWaiter();
+}
+
+bool StreamRingBuffer::WaitForData(size_t bytes, TickType_t timeout) {
+    bytes = std::min(bytes, capacity_);
+    while (true) {
+        if (size() >= bytes) {
+            return true;
+        }
+        if (closed()) {
+            return false;
+        }
+
+        xEventGroupClearBits(event_group_, RING_EVENT_DATA_AVAILABLE);
+        data_waiter_level_.store(bytes);
+        // 设置水位后再检查一次，防止与生产者的通知擦肩而过
+        if (size() >= bytes || closed()) {
+            data_waiter_level_.store(0);
+            continue;
+        }
+
+        EventBits_t bits = xEventGroupWaitBits(event_group_, RING_EVENT_DATA_AVAILABLE, pdTRUE, pdFALSE, timeout);
+        data_waiter_level_.store(0);
+        if (!(bits & RING_EVENT_DATA_AVAILABLE)) {
+            return size() >= bytes;
+        }
+    }
+}
+
+void StreamRingBuffer::Close() {
+    closed_.store(true, std::memory_order_release);
+    xEventGroupSetBits(event_group_, RING_EVENT_DATA_AVAILABLE | RING_EVENT_SPACE_AVAILABLE);
+}
+
+void StreamRingBuffer::Reset() {
+    write_pos_.store(0);
+    read_pos_.store(0);
+    data_waiter_level_.store(0);
+    space_waiter_level_.store(0);
+    closed_.store(false, std::memory_order_release);
+    xEventGroupClearBits(event_group_, RING_EVENT_DATA_AVAILABLE | RING_EVENT_SPACE_AVAILABLE);
+}
+
+void StreamRingBuffer::NotifyDataWaiter() {
+    size_t level = data_waiter_level_.load();
+    if (level != 0 && size() >= level) {
+        xEventGroupSetBits(event_group_, RING_EVENT_DATA_AVAILABLE);
+    }
+}
+
+void StreamRingBuffer::NotifySpaceWaiter() {
+    size_t level = space_waiter_level_.load();
+    if (level != 0 && free_space() >= level) {
+        xEventGroupSetBits(event_group_, RING_EVENT_SPACE_AVAILABLE);
+    }
+}
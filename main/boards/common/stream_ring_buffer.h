@@ -0,0 +1,78 @@
+#ifndef STREAM_RING_BUFFER_H
+#define STREAM_RING_BUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+
+/*
+ * 单生产者/单消费者字节环形缓冲区，用于音乐流的 下载 -> 解码 路径。
+ *
+ * - 存储区在构造时一次性分配（优先 PSRAM），之后不再有任何堆操作
+ * - 读写索引为原子变量，读写两端互不加锁
+ * - 只有当对端在等待、且数据量/空闲空间越过对端请求的水位时才唤醒对端，
+ *   而不是每写入一个块就 notify 一次
+ *
+ * 生产者可以用 PrepareWrite/CommitWrite 直接把网络数据读进环形缓冲区，
+ * 消费者可以用 Peek/Consume 直接在缓冲区上解码，从而省去中间拷贝。
+ * 存储区末尾额外保留 linear_guard 字节，PeekLinear 在数据跨越回绕点时
+ * 把开头的一小段复制到这里，使消费者总能拿到一段连续的数据（例如一个完整的MP3帧）。
+ */
+class StreamRingBuffer {
+public:
+    explicit StreamRingBuffer(size_t capacity, size_t linear_guard = 0);
+    ~StreamRingBuffer();
+
+    StreamRingBuffer(const StreamRingBuffer&) = delete;
+    StreamRingBuffer& operator=(const StreamRingBuffer&) = delete;
+
+    bool valid() const { return storage_ != nullptr; }
+    size_t capacity() const { return capacity_; }
+    size_t size() const;
+    size_t free_space() const { return capacity_ - size(); }
+    bool closed() const { return closed_.load(std::memory_order_acquire); }
+    // 累计写入/读出的字节数（Reset 时清零），可用来在数据流中标记位置
+    size_t write_position() const { return write_pos_.load(); }
+    size_t read_position() const { return read_pos_.load(); }
+
+    // 生产者接口
+    size_t Write(const uint8_t* data, size_t size);
+    size_t PrepareWrite(uint8_t** data);
+    void CommitWrite(size_t size);
+    bool WaitForSpace(size_t bytes, TickType_t timeout = portMAX_DELAY);
+
+    // 消费者接口
+    size_t Read(uint8_t* dest, size_t size);
+    size_t Peek(const uint8_t** data) const;
+    size_t PeekLinear(const uint8_t** data, size_t bytes);
+    void Consume(size_t size);
+    bool WaitForData(size_t bytes, TickType_t timeout = portMAX_DELAY);
+
+    // 标记数据流结束（或被中止），唤醒所有等待者
+    void Close();
+    // 只能在读写两端都已停止时调用
+    void Reset();
+
+private:
+    uint8_t* storage_ = nullptr;
+    size_t capacity_ = 0;
+    size_t linear_guard_ = 0;
+    EventGroupHandle_t event_group_ = nullptr;
+
+    // 单调递增的读写计数，差值即为缓冲区中的数据量
+    std::atomic<size_t> write_pos_{0};
+    std::atomic<size_t> read_pos_{0};
+    std::atomic<bool> closed_{false};
+
+    // 对端正在等待的水位，0 表示没有等待者
+    std::atomic<size_t> data_waiter_level_{0};
+    std::atomic<size_t> space_waiter_level_{0};
+
+    void NotifyDataWaiter();
+    void NotifySpaceWaiter();
+};
+
+#endif // STREAM_RING_BUFFER_H
@@ -0,0 +1,211 @@
+#include "wav_music_decoder.h"
+
+#include <esp_log.h>
+#include <algorithm>
+#include <cstring>
+
+#define TAG "WavMusicDecoder"
+
+static uint32_t ReadLittleEndian(const uint8_t* data, int bytes) {
+    uint32_t value = 0;
+    for (int i = bytes - 1; i >= 0; i--) {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+bool WavMusicDecoder::ParseFormat(const uint8_t* chunk, size_t size) {
+    if (size < 16) {
+        return false;
+    }
+    uint32_t format_tag = ReadLittleEndian(chunk, 2);
+    channels_ = ReadLittleEndian(chunk + 2, 2);
+    sample_rate_ = ReadLittleEndian(chunk + 4, 4);
+    byte_rate_ = ReadLittleEndian(chunk + 8, 4);
+    block_align_ = ReadLittleEndian(chunk + 12, 2);
+    bits_per_sample_ = ReadLittleEndian(chunk + 14, 2);
+    // WAVE_FORMAT_EXTENSIBLE 的实际格式在子格式GUID的前两个字节
+    if (format_tag == 0xFFFE && size >= 26) {
+        format_tag = ReadLittleEndian(chunk + 24, 2);
+    }
+
+    if (format_tag != 1) {
+        ESP_LOGE(TAG, "Unsupported WAV format tag: 0x%04lx", (unsigned long)format_tag);
+        return false;
+    }
+    if (channels_ <= 0 || sample_rate_ <= 0 ||
+        (bits_per_sample_ != 8 && bits_per_sample_ != 16 && bits_per_sample_ != 24 && bits_per_sample_ != 32) ||
+        block_align_ != (size_t)channels_ * bits_per_sample_ / 8) {
+        ESP_LOGE(TAG, "Invalid WAV format: %d Hz, %d channels, %d bits, block %u",
+                sample_rate_, channels_, bits_per_sample_, (unsigned)block_align_);
+        return false;
+    }
+    ESP_LOGI(TAG, "WAV PCM: %d Hz, %d channels, %d bits", sample_rate_, channels_, bits_per_sample_);
+    return true;
+}
+
+int WavMusicDecoder::ConvertFrames(const uint8_t* data, size_t frames, std::vector<int16_t>& pcm) const {
+    size_t samples = frames * channels_;
+    pcm.resize(samples);
+    int16_t* out = pcm.data();
+    switch (bits_per_sample_) {
+        case 16:
+            memcpy(out, data, samples * sizeof(int16_t));
+            break;
+        case 8:
+            // 8位PCM是无符号数
+            for (size_t i = 0; i < samples; i++) {
+                out[i] = (int16_t)((data[i] - 128) << 8);
+            }
+            break;
+        case 24:
+            for (size_t i = 0; i < samples; i++) {
+                out[i] = (int16_t)(data[i * 3 + 1] | (data[i * 3 + 2] << 8));
+            }
+            break;
+        case 32:
+            for (size_t i = 0; i < samples; i++) {
+                out[i] = (int16_t)(data[i * 4 + 2] | (data[i * 4 + 3] << 8));
+            }
+            break;
+    }
+    return (int)samples;
+}
+
+MusicDecoder::Result WavMusicDecoder::Decode(const uint8_t* data, size_t size, bool end_of_stream, std::vector<int16_t>& pcm) {
+    Result result;
+    pcm.clear();
+    while (result.samples == 0 && !result.need_more) {
+        const uint8_t* p = data + result.consumed;
+        size_t available = size - result.consumed;
+        size_t used = 0;
+
+        switch (state_) {
+            case kRiffHeader:
+                if (available < 12) {
+                    result.need_more = true;
+                    break;
+                }
+                if (memcmp(p, "RIFF", 4) != 0 || memcmp(p + 8, "WAVE", 4) != 0) {
+                    ESP_LOGE(TAG, "Not a RIFF/WAVE stream");
+                    state_ = kError;
+                    break;
+                }
+                used = 12;
+                state_ = kChunkHeader;
+                break;
+
+            case kChunkHeader: {
+                if (available < 8) {
+                    result.need_more = true;
+                    break;
+                }
+                uint32_t chunk_size = ReadLittleEndian(p + 4, 4);
+                if (memcmp(p, "fmt ", 4) == 0) {
+                    // fmt 块很小，等整个块到齐再解析
+                    if (chunk_size > 64) {
+                        state_ = kError;
+                        break;
+                    }
+                    if (available < 8 + chunk_size) {
+                        result.need_more = true;
+                        break;
+                    }
+                    if (!ParseFormat(p + 8, chunk_size)) {
+                        state_ = kError;
+                        break;
+                    }
+                    used = 8 + chunk_size;
+                    skip_remaining_ = chunk_size & 1;  // 奇数长度的块后面有一个填充字节
+                    state_ = skip_remaining_ > 0 ? kSkipChunk : kChunkHeader;
+                } else if (memcmp(p, "data", 4) == 0) {
+                    if (block_align_ == 0) {
+                        ESP_LOGE(TAG, "WAV data chunk before fmt chunk");
+                        state_ = kError;
+                        break;
+                    }
+                    used = 8;
+                    data_start_ = position_ + used;
+                    // 流式生成的WAV常把长度写成0或0xFFFFFFFF，此时一直播放到数据流结束
+                    data_size_known_ = chunk_size != 0 && chunk_size != 0xFFFFFFFF;
+                    data_remaining_ = data_size_known_ ? chunk_size : SIZE_MAX;
+                    data_end_ = data_start_ + chunk_size;
+                    state_ = kData;
+                } else {
+                    used = 8;
+                    skip_remaining_ = chunk_size + (chunk_size & 1);
+                    state_ = kSkipChunk;
+                }
+                break;
+            }
+
+            case kSkipChunk:
+                used = std::min(available, skip_remaining_);
+                skip_remaining_ -= used;
+                if (skip_remaining_ == 0) {
+                    state_ = kChunkHeader;
+                } else {
+                    result.need_more = true;
+                }
+                break;
+
+            case kData: {
+                size_t frames = std::min(std::min(available, data_remaining_) / block_align_, MAX_FRAMES_PER_CALL);
+                if (frames == 0) {
+                    if (data_remaining_ >= block_align_) {
+                        result.need_more = true;
+                        break;
+                    }
+                    // data 块结束（可能带有不足一帧的尾巴），后面可能还有其它块
+                    skip_remaining_ = data_remaining_ + ((data_end_ - data_start_) & 1);
+                    data_remaining_ = 0;
+                    state_ = skip_remaining_ > 0 ? kSkipChunk : kChunkHeader;
+                    break;
+                }
+                used = frames * block_align_;
+                if (data_remaining_ != SIZE_MAX) {
+                    data_remaining_ -= used;
+                }
+                result.samples = ConvertFrames(p, frames, pcm);
+                break;
+            }
+
+            case kError:
+                // 无法解码的数据全部丢弃
+                used = available;
+                result.need_more = true;
+                break;
+        }
+
+        result.consumed += used;
+        position_ += used;
+    }
+    return result;
+}
+
+void WavMusicDecoder::Reset() {
+    *this = WavMusicDecoder();
+}
+
+void WavMusicDecoder::Restart(size_t offset) {
+    position_ = offset;
+    if (block_align_ == 0 || offset < data_start_) {
+        state_ = kError;
+        return;
+    }
+    // 跳转的目标总是 data 块中按帧对齐的位置
+    state_ = kData;
+    data_remaining_ = !data_size_known_ ? SIZE_MAX : (offset < data_end_ ? data_end_ - offset : 0);
+}
+
+bool WavMusicDecoder::TimeToOffset(int64_t time_ms, size_t* offset) const {
+    if (block_align_ == 0 || data_start_ == 0 || time_ms < 0) {
+        return false;
+    }
+    size_t target = data_start_ + (size_t)(time_ms * sample_rate_ / 1000) * block_align_;
+    if (data_size_known_ && target >= data_end_) {
+        return false;
+    }
+    *offset = target;
+    return true;
+}
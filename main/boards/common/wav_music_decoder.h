@@ -0,0 +1,56 @@
+#ifndef WAV_MUSIC_DECODER_H
+#define WAV_MUSIC_DECODER_H
+
+#include "music_decoder.h"
+
+/*
+ * WAV（RIFF）PCM 解码器：解析 fmt/data 块后直接输出样本，
+ * 16位小端PCM只做一次拷贝，8/24/32位整数PCM转换为16位。
+ * 未知的块（LIST等）增量跳过，块可以比输入窗口大。
+ */
+class WavMusicDecoder : public MusicDecoder {
+public:
+    // 每次最多输出的帧数，与一帧MP3相当
+    static constexpr size_t MAX_FRAMES_PER_CALL = 1152;
+
+    MusicFormat format() const override { return MusicFormat::kWav; }
+
+    Result Decode(const uint8_t* data, size_t size, bool end_of_stream, std::vector<int16_t>& pcm) override;
+
+    int sample_rate() const override { return sample_rate_; }
+    int channels() const override { return channels_; }
+    int bitrate_kbps() const override { return byte_rate_ * 8 / 1000; }
+
+    void Reset() override;
+    void Restart(size_t offset) override;
+    bool TimeToOffset(int64_t time_ms, size_t* offset) const override;
+
+private:
+    enum State {
+        kRiffHeader,
+        kChunkHeader,
+        kSkipChunk,
+        kData,
+        kError,
+    };
+
+    State state_ = kRiffHeader;
+    size_t position_ = 0;         // 已经消耗的输入字节数
+    size_t skip_remaining_ = 0;   // 正在跳过的块中剩余的字节数
+
+    int sample_rate_ = 0;
+    int channels_ = 0;
+    int bits_per_sample_ = 0;
+    int byte_rate_ = 0;
+    size_t block_align_ = 0;
+
+    size_t data_start_ = 0;       // data 块内容的起始偏移
+    size_t data_remaining_ = 0;   // data 块中剩余的字节数，长度未知时为 SIZE_MAX
+    bool data_size_known_ = false;
+    size_t data_end_ = 0;
+
+    bool ParseFormat(const uint8_t* chunk, size_t size);
+    int ConvertFrames(const uint8_t* data, size_t frames, std::vector<int16_t>& pcm) const;
+};
+
+#endif // WAV_MUSIC_DECODER_H
@@ -2,6 +2,7 @@
 #define _BOX_AUDIO_CODEC_H
 
 #include "audio_codec.h"
+#include "codecs/pcm_format.h"
 
 #include <esp_codec_dev.h>
 #include <esp_codec_dev_defaults.h>
@@ -18,6 +19,10 @@ private:
     esp_codec_dev_handle_t output_dev_ = nullptr;
     esp_codec_dev_handle_t input_dev_ = nullptr;
 
+    // 双声道输出，一个 DMA 缓冲区的样本
+    alignas(16) int32_t write_buffer_[AUDIO_CODEC_DMA_FRAME_NUM * 2];
+    PcmGainCache output_gain_;
+
     void CreateDuplexChannels(gpio_num_t mclk, gpio_num_t bclk, gpio_num_t ws, gpio_num_t dout, gpio_num_t din);
 
     virtual int Read(int16_t* dest, int samples) override;
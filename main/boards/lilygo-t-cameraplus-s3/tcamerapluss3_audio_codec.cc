@@ -1,6 +1,7 @@
 #include "tcamerapluss3_audio_codec.h"
 
 #include <esp_log.h>
+#include <algorithm>
 #include <driver/i2c_master.h>
 #include <driver/i2s_tdm.h>
 #include <driver/i2s_pdm.h>
@@ -128,7 +129,7 @@ void Tcamerapluss3AudioCodec::CreateVoiceHardware(gpio_num_t mic_bclk, gpio_num_
 }
 
 void Tcamerapluss3AudioCodec::SetOutputVolume(int volume) {
-    volume_ = volume;
+    output_gain_ = PcmVolumeToLinearGain(volume);
     AudioCodec::SetOutputVolume(volume);
 }
 
@@ -157,13 +158,12 @@ int Tcamerapluss3AudioCodec::Read(int16_t *dest, int samples) {
 
 int Tcamerapluss3AudioCodec::Write(const int16_t *data, int samples){
     if (output_enabled_){
-        size_t bytes_read;
-        auto output_data = (int16_t *)malloc(samples * sizeof(int16_t));
-        for (size_t i = 0; i < samples; i++){
-            output_data[i] = (float)data[i] * (float)(volume_ / 100.0);
+        for (int offset = 0; offset < samples; offset += AUDIO_CODEC_DMA_FRAME_NUM){
+            int count = std::min(samples - offset, AUDIO_CODEC_DMA_FRAME_NUM);
+            PcmScale16(data + offset, write_buffer_, count, output_gain_);
+            size_t bytes_written;
+            i2s_channel_write(tx_handle_, write_buffer_, count * sizeof(int16_t), &bytes_written, portMAX_DELAY);
         }
-        i2s_channel_write(tx_handle_, output_data, samples * sizeof(int16_t), &bytes_read, portMAX_DELAY);
-        free(output_data);
     }
     return samples;
 }
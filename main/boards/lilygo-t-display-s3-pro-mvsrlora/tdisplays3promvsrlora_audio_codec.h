@@ -2,6 +2,7 @@
 #define _TDISPLAYS3PROMVSRLORA_AUDIO_CODEC_H
 
 #include "audio_codec.h"
+#include "codecs/pcm_format.h"
 
 #include <esp_codec_dev.h>
 #include <esp_codec_dev_defaults.h>
@@ -15,7 +16,8 @@ private:
     const audio_codec_if_t *in_codec_if_ = nullptr;
     const audio_codec_gpio_if_t *gpio_if_ = nullptr;
 
-    uint32_t volume_ = 70;
+    int32_t output_gain_ = PcmVolumeToLinearGain(70);
+    alignas(16) int16_t write_buffer_[AUDIO_CODEC_DMA_FRAME_NUM];
 
     void CreateVoiceHardware(gpio_num_t mic_bclk, gpio_num_t mic_ws, gpio_num_t mic_data,gpio_num_t spkr_bclk, gpio_num_t spkr_lrclk, gpio_num_t spkr_data);
 
@@ -1286,7 +1286,7 @@ void LcdDisplay::periodicUpdateTask() {
         
         
         if (currentTime - lastAudioTime >= audioProcessInterval) {
-            if(music->GetAudioData() != nullptr) {
+            if(music->GetPcmTap().version() != 0) {
                 readAudioData();  // 快速处理，不阻塞
             } else {
                 vTaskDelay(pdMS_TO_TICKS(100));
@@ -1333,11 +1333,14 @@ void LcdDisplay::readAudioData(){
    
     auto music = Board::GetInstance().GetMusic();
     
-    if(music->GetAudioData()!=nullptr){
+    if(music->GetPcmTap().version()!=0){
         
     
         if(audio_display_last_update<=2){
-            memcpy(audio_data,music->GetAudioData(),sizeof(int16_t)*1152);
+            // 取最近1152个样本的完整快照，播放线程正在改写这一段时跳过本次
+            if(!music->GetPcmTap().Snapshot(audio_data,1152)){
+                return;
+            }
             for(int i=0;i<1152;i++){
                 frame_audio_data[i]+=audio_data[i];
             }
@@ -1383,7 +1386,7 @@ void LcdDisplay::readAudioData(){
 
         }
     }else{
-            ESP_LOGI(TAG, "audio_data is nullptr");
+            ESP_LOGI(TAG, "No music audio data yet");
             vTaskDelay(pdMS_TO_TICKS(500));
         }   
 }
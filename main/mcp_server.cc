@@ -510,6 +510,83 @@ AddTool("self.smart_car.check_ready",
                  return "{\"success\": true, \"message\": \"音乐开始播放\"}";
              });
  
+         AddTool("self.music.seek",
+             "跳转到当前播放歌曲的指定位置。当用户要求快进、快退或从某个时间开始播放时使用此工具。\n"
+             "参数:\n"
+             "  `position_seconds`: 目标位置，从歌曲开头算起的秒数。\n"
+             "返回:\n"
+             "  跳转结果。",
+             PropertyList({
+                 Property("position_seconds", kPropertyTypeInteger, 0, 3600)
+             }),
+             [music](const PropertyList& properties) -> ReturnValue {
+                 int position_seconds = properties["position_seconds"].value<int>();
+                 if (!music->Seek(position_seconds * 1000)) {
+                     return "{\"success\": false, \"message\": \"当前没有可跳转的歌曲\"}";
+                 }
+                 return "{\"success\": true, \"message\": \"已跳转到 " + std::to_string(position_seconds) + " 秒\"}";
+             });
+ 
+         AddTool("self.music.pause",
+             "暂停当前播放的歌曲。当用户说“暂停”、“先停一下”时使用此工具，之后可以用 self.music.resume 从暂停处继续。",
+             PropertyList(),
+             [music](const PropertyList& properties) -> ReturnValue {
+                 if (!music->Pause()) {
+                     return "{\"success\": false, \"message\": \"当前没有正在播放的歌曲\"}";
+                 }
+                 return "{\"success\": true, \"message\": \"已暂停\"}";
+             });
+ 
+         AddTool("self.music.resume",
+             "从暂停处继续播放歌曲。当用户说“继续播放”、“接着放”时使用此工具。",
+             PropertyList(),
+             [music](const PropertyList& properties) -> ReturnValue {
+                 if (!music->Resume()) {
+                     return "{\"success\": false, \"message\": \"当前没有暂停的歌曲\"}";
+                 }
+                 return "{\"success\": true, \"message\": \"继续播放\"}";
+             });
+ 
+         AddTool("self.music.enqueue_song",
+             "把歌曲加入播放列表。当用户要求“下一首播放”、“接着放”或一次点多首歌时使用此工具；当前没有播放时会立即开始播放。\n"
+             "参数:\n"
+             "  `song_name`: 歌曲名称（必需）。\n"
+             "  `artist_name`: 歌曲艺术家名称（可选，默认为空字符串）。\n"
+             "返回:\n"
+             "  加入结果和播放列表中的歌曲数量。",
+             PropertyList({
+                 Property("song_name", kPropertyTypeString),
+                 Property("artist_name", kPropertyTypeString, "")
+             }),
+             [music](const PropertyList& properties) -> ReturnValue {
+                 auto song_name = properties["song_name"].value<std::string>();
+                 auto artist_name = properties["artist_name"].value<std::string>();
+ 
+                 if (!music->EnqueueSong(song_name, artist_name)) {
+                     return "{\"success\": false, \"message\": \"获取音乐资源失败\"}";
+                 }
+                 return "{\"success\": true, \"message\": \"已加入播放列表\", \"queue_length\": " +
+                     std::to_string(music->GetQueueLength()) + "}";
+             });
+ 
+         AddTool("self.music.next_song",
+             "切换到播放列表中的下一首歌曲。当用户说“下一首”、“切歌”时使用此工具。",
+             PropertyList(),
+             [music](const PropertyList& properties) -> ReturnValue {
+                 if (!music->PlayNext()) {
+                     return "{\"success\": false, \"message\": \"播放列表为空\"}";
+                 }
+                 return "{\"success\": true, \"message\": \"已切换到下一首\"}";
+             });
+ 
+         AddTool("self.music.clear_playlist",
+             "清空播放列表，不影响当前正在播放的歌曲。",
+             PropertyList(),
+             [music](const PropertyList& properties) -> ReturnValue {
+                 music->ClearQueue();
+                 return "{\"success\": true, \"message\": \"播放列表已清空\"}";
+             });
+ 
          AddTool("self.music.set_display_mode",
              "设置音乐播放时的显示模式。可以选择显示频谱或歌词，比如用户说‘打开频谱’或者‘显示频谱’，‘打开歌词’或者‘显示歌词’就设置对应的显示模式。\n"
              "参数:\n"
@@ -0,0 +1,196 @@
+/*
+ * Music prebuffering on simulated links: the old fixed 32 KB start threshold against AdaptiveBufferPolicy.
+ *
+ * Time runs in 10 ms steps on the esp_timer stub. The downloader receives what the link delivers in
+ * a step. Like Esp32Music::WaitForDownloadSpace it blocks once less than a chunk fits in the buffer,
+ * and resumes when the player has freed WRITE_WATERMARK bytes. The player drains a 128 kbps stream
+ * once it has started, and an empty buffer mid-song is an underrun that sends it back to prebuffering.
+ * Each link plays 30 songs of 4 minutes back to back; the adaptive policy keeps the throughput it
+ * learned across songs, as Esp32Music does.
+ *
+ * The program fails if the adaptive policy starts later, rebuffers more often or stalls longer than
+ * the fixed threshold on any link.
+ */
+#include "adaptive_buffer_policy.h"
+
+#include <esp_timer.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+static const size_t MAX_BUFFER_SIZE = 256 * 1024;           // Esp32Music::MAX_BUFFER_SIZE
+static const size_t MAX_PREBUFFER_SIZE = 32 * 1024;         // Esp32Music::MAX_PREBUFFER_SIZE
+static const size_t DOWNLOAD_CHUNK_SIZE = 4096;             // Esp32Music::DOWNLOAD_CHUNK_SIZE
+static const size_t WRITE_WATERMARK = 16 * 1024;            // Esp32Music::WRITE_WATERMARK
+static const int STEP_MS = 10;
+static const int BITRATE_KBPS = 128;
+static const int SONG_SECONDS = 240;
+static const int SONGS = 30;
+
+struct Link {
+    const char* name;
+    double mean_bps;        // Throughput while the link is up
+    double spread;          // Sigma of the log-normal throughput of each 100 ms slice
+    double stall_rate;      // Stalls per second
+    double stall_seconds;   // Mean stall length
+};
+
+/* Delivers bytes per step: log-normal throughput per 100 ms slice, plus exponential stalls */
+class LinkModel {
+public:
+    LinkModel(const Link& link, uint32_t seed) : link_(link), rng_(seed) {}
+
+    size_t Step() {
+        if (stall_steps_ > 0) {
+            stall_steps_--;
+            return 0;
+        }
+        if (std::uniform_real_distribution<double>(0, 1)(rng_) < link_.stall_rate * STEP_MS / 1000.0) {
+            stall_steps_ = (int)(std::exponential_distribution<double>(1.0 / link_.stall_seconds)(rng_) * 1000 / STEP_MS);
+            return 0;
+        }
+        if (slice_steps_ == 0) {
+            double factor = std::exp(std::normal_distribution<double>(-link_.spread * link_.spread / 2, link_.spread)(rng_));
+            slice_bytes_ = link_.mean_bps * factor * STEP_MS / 1000.0;
+            slice_steps_ = 100 / STEP_MS;
+        }
+        slice_steps_--;
+        carry_ += slice_bytes_;
+        size_t bytes = (size_t)carry_;
+        carry_ -= bytes;
+        return bytes;
+    }
+
+private:
+    Link link_;
+    std::mt19937 rng_;
+    int stall_steps_ = 0;
+    int slice_steps_ = 0;
+    double slice_bytes_ = 0;
+    double carry_ = 0;
+};
+
+struct Result {
+    double first_audio_ms = 0;   // Average per song
+    double rebuffers = 0;        // Per song
+    double rebuffer_seconds = 0; // Per hour of music
+    double throughput_kbps = 0;  // The policy's estimate after the last song
+    double waiting_seconds = 0;  // Per song, before the first audio plus stalled mid-song
+};
+
+static Result Run(const Link& link, bool adaptive) {
+    LinkModel model(link, 1234);
+    AdaptiveBufferPolicy policy(MAX_PREBUFFER_SIZE);
+    const double stream_bytes_per_step = BITRATE_KBPS * 1000 / 8.0 * STEP_MS / 1000.0;
+    const size_t song_bytes = (size_t)(BITRATE_KBPS * 1000 / 8.0 * SONG_SECONDS);
+    int64_t now_us = 1000000;
+    Result result;
+    int64_t stalled_steps = 0;
+
+    for (int song = 0; song < SONGS; song++) {
+        policy.BeginStream();
+        size_t downloaded = 0, buffered = 0;
+        double played = 0;
+        bool playing = false, started = false, blocked = false;
+        int64_t request_us = now_us;
+        while (played < song_bytes) {
+            now_us += STEP_MS * 1000;
+            HostSetTime(now_us);
+
+            size_t received = model.Step();
+            if (!blocked && buffered + DOWNLOAD_CHUNK_SIZE > MAX_BUFFER_SIZE) {
+                blocked = true;
+                if (adaptive) {
+                    policy.PauseMeasurement();
+                }
+            } else if (blocked && buffered + WRITE_WATERMARK <= MAX_BUFFER_SIZE) {
+                blocked = false;
+                if (adaptive) {
+                    policy.ResumeMeasurement();
+                }
+            }
+            if (downloaded < song_bytes && !blocked) {
+                received = std::min({received, song_bytes - downloaded, MAX_BUFFER_SIZE - buffered});
+                downloaded += received;
+                buffered += received;
+                if (adaptive) {
+                    policy.OnDataReceived(received);
+                }
+            }
+
+            if (!playing) {
+                bool complete = downloaded == song_bytes;
+                bool ready = adaptive ? policy.ReadyToPlay(buffered) : buffered >= MAX_PREBUFFER_SIZE;
+                if (!ready && !complete) {
+                    stalled_steps += started ? 1 : 0;
+                    continue;
+                }
+                playing = true;
+                if (!started) {
+                    started = true;
+                    result.first_audio_ms += (now_us - request_us) / 1000.0;
+                }
+            }
+            if (adaptive) {
+                policy.OnStreamBitrate(BITRATE_KBPS);
+            }
+            double drain = std::min(stream_bytes_per_step, song_bytes - played);
+            if (buffered + 1e-9 < drain) {
+                /* The ring ran dry mid-song */
+                playing = false;
+                result.rebuffers++;
+                stalled_steps++;
+                if (adaptive) {
+                    policy.OnUnderrun();
+                }
+                continue;
+            }
+            played += drain;
+            buffered -= (size_t)std::min<double>(buffered, std::ceil(drain));
+        }
+    }
+    result.waiting_seconds = (result.first_audio_ms / 1000.0 + stalled_steps * STEP_MS / 1000.0) / SONGS;
+    result.first_audio_ms /= SONGS;
+    result.rebuffers /= SONGS;
+    result.rebuffer_seconds = stalled_steps * STEP_MS / 1000.0 / (SONGS * SONG_SECONDS / 3600.0);
+    result.throughput_kbps = policy.throughput_bps() / 1000.0;
+    return result;
+}
+
+int main() {
+    const Link links[] = {
+        {"good Wi-Fi 200 KB/s",           200e3, 0.3, 0.0,   0.0},
+        {"busy Wi-Fi 60 KB/s, stalls",     60e3, 0.6, 0.05,  1.5},
+        {"marginal 24 KB/s",               24e3, 0.5, 0.01,  1.0},
+        {"weak 4G 20 KB/s, long stalls",   20e3, 0.8, 0.02,  4.0},
+    };
+    printf("128 kbps stream, %d songs of %d s per link\n", SONGS, SONG_SECONDS);
+    printf("%-30s %-9s %14s %14s %18s %14s %14s\n", "link", "policy", "first audio ms", "rebuffers/song",
+        "stalled s/hour", "waiting s/song", "estimate KB/s");
+    bool ok = true;
+    for (auto& link : links) {
+        Result fixed;
+        for (bool adaptive : {false, true}) {
+            Result result = Run(link, adaptive);
+            if (!adaptive) {
+                fixed = result;
+            } else {
+                ok = ok && result.first_audio_ms <= fixed.first_audio_ms && result.rebuffers <= fixed.rebuffers &&
+                    result.rebuffer_seconds <= fixed.rebuffer_seconds;
+            }
+            printf("%-30s %-9s %14.0f %14.2f %18.1f %14.2f", link.name, adaptive ? "adaptive" : "fixed 32K",
+                result.first_audio_ms, result.rebuffers, result.rebuffer_seconds, result.waiting_seconds);
+            if (adaptive) {
+                printf(" %14.1f", result.throughput_kbps);
+            }
+            printf("\n");
+        }
+    }
+    if (!ok) {
+        fprintf(stderr, "the adaptive policy does worse than the fixed threshold on some link\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,159 @@
+/*
+ * AudioRing correctness with a producer and a consumer thread that sleep only on task notifications:
+ *
+ * - every item arrives exactly once, either popped or recycled, and in push order
+ * - Discard from a third task while both sides run
+ * - SetLimit moving the bound up and down from a third task while both sides run
+ * - head_, tail_ and the discard mark wrapping past 2^32, and a mark left far behind tail_
+ *
+ * A lost wakeup leaves a thread asleep for good, ctest's timeout catches that.
+ */
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+
+/* The wrap test sets the indexes directly */
+#define private public
+#include "audio_ring.h"
+#undef private
+
+static const uint32_t ITEMS = 1000000;
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    } \
+} while (0)
+
+/* Streams ITEMS numbered items through `ring` while `meddle` runs on a third thread until the producer is done */
+template <typename Meddle>
+static void Stream(const char* name, size_t capacity, Meddle meddle) {
+    AudioRing<std::unique_ptr<uint32_t>> ring(capacity);
+    HostTask producer, consumer;
+    std::atomic<bool> done{false};
+    uint64_t received = 0, recycled = 0;
+    bool in_order = true;
+
+    std::thread producer_thread([&]() {
+        HostTaskBind(&producer);
+        ring.SetProducer(&producer);
+        for (uint32_t i = 0; i < ITEMS; i++) {
+            auto item = std::make_unique<uint32_t>(i);
+            while (!ring.Push(std::move(item))) {
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            }
+        }
+        done = true;
+        ring.WakeConsumer();
+    });
+
+    std::thread consumer_thread([&]() {
+        HostTaskBind(&consumer);
+        ring.SetConsumer(&consumer);
+        int64_t last = -1;
+        auto check = [&](uint32_t value) {
+            in_order = in_order && (int64_t)value > last;
+            last = value;
+        };
+        auto recycle = [&](std::unique_ptr<uint32_t>&& item) {
+            check(*item);
+            recycled++;
+        };
+        std::unique_ptr<uint32_t> item;
+        while (true) {
+            if (ring.Pop(item, recycle)) {
+                check(*item);
+                received++;
+                continue;
+            }
+            if (done) {
+                /* The producer has stopped: whatever is left is stale or gets popped above */
+                ring.Recycle(recycle);
+                if (!ring.Pop(item, recycle)) {
+                    break;
+                }
+                check(*item);
+                received++;
+                continue;
+            }
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+    });
+
+    std::thread meddler([&]() {
+        while (!done) {
+            meddle(ring);
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+        }
+    });
+
+    producer_thread.join();
+    consumer_thread.join();
+    meddler.join();
+    printf("%-12s received %llu + recycled %llu of %u, producer slept %llu, consumer slept %llu\n", name,
+        (unsigned long long)received, (unsigned long long)recycled, ITEMS,
+        (unsigned long long)producer.sleeps.load(), (unsigned long long)consumer.sleeps.load());
+    CHECK(in_order);
+    CHECK(received + recycled == ITEMS);
+}
+
+static void TestWrap() {
+    AudioRing<uint32_t> ring(3);
+    ring.head_ = ring.tail_ = ring.discard_ = 0xFFFFFFF0u;
+    uint32_t next = 0, expected = 0, value;
+    for (int round = 0; round < 100; round++) {
+        while (ring.Push(uint32_t(next))) {
+            next++;
+        }
+        if (round == 50) {
+            ring.Discard();
+            expected = next;
+            CHECK(ring.Size() == 0);
+        }
+        while (ring.Pop(value)) {
+            CHECK(value == expected);
+            expected++;
+        }
+    }
+    CHECK(ring.head_.load() < 0xFFFFFFF0u);
+
+    /* A mark far behind tail_ must not turn live entries stale */
+    ring.discard_ = ring.tail_.load() - 0x7FFFFFF0u;
+    CHECK(ring.Push(1234u));
+    CHECK(ring.Pop(value) && value == 1234);
+    CHECK(ring.Push(1235u));
+    CHECK(ring.Pop(value) && value == 1235);
+}
+
+int main() {
+    Stream("discard", 5, [](AudioRing<std::unique_ptr<uint32_t>>& ring) {
+        ring.Discard();
+        ring.WakeConsumer();
+    });
+    size_t limit = 1;
+    Stream("set limit", 8, [&limit](AudioRing<std::unique_ptr<uint32_t>>& ring) {
+        ring.SetLimit(limit);
+        limit = limit % 8 + 1;
+        if (limit == 3) {
+            ring.Discard();
+            ring.WakeConsumer();
+        }
+    });
+    TestWrap();
+
+    if (failures > 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("audio ring: all checks passed\n");
+    return 0;
+}
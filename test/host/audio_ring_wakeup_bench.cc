@@ -0,0 +1,495 @@
+/*
+ * AudioService queue wakeups: the old design (every queue behind one mutex, one condition variable,
+ * notify_all on every push and pop) against per-edge AudioRings with task notifications, on a
+ * thread-per-task model of the pipeline with 2 ms frames.
+ *
+ * - "music while listening": music decoder -> music queue -> output, and at the same time
+ *   input -> encode queue -> codec task -> send queue -> main loop. The two chains share nothing but
+ *   the old mutex, so every wakeup one chain causes in the other is spurious.
+ * - "full duplex": TTS playing while the microphone is encoded, network -> decode queue -> codec task
+ *   -> playback queue -> output next to the uplink chain above. These wakeups are real work.
+ *
+ * The main loop is woken by an event in both designs, as the send-queue callback does on the device.
+ * Context switches come from getrusage. Pin the process to two cores to get the commit's setup:
+ *   taskset -c 0,1 ./audio_ring_wakeup_bench [seconds per run, default 5]
+ */
+#include "audio_ring.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <sys/resource.h>
+
+using namespace std::chrono;
+
+static const auto FRAME = microseconds(2000);
+static const int DECODE_US = 150;
+static const int ENCODE_US = 200;
+static const int MUSIC_DECODE_US = 100;
+static const size_t MAX_ENCODE_TASKS = 2;
+static const size_t MAX_DECODE_PACKETS = 40;
+static const size_t MAX_SEND_PACKETS = 40;
+static const size_t MAX_PLAYBACK_TASKS = 2;
+static const size_t MAX_MUSIC_FRAMES = 8;
+
+struct Frame {
+    int value = 0;
+};
+
+struct Counters {
+    std::atomic<uint64_t> codec_wakeups{0};
+    std::atomic<uint64_t> codec_spurious{0};
+    std::atomic<uint64_t> music_wakeups{0};
+    std::atomic<uint64_t> music_spurious{0};
+    std::atomic<uint64_t> input_wakeups{0};
+    std::atomic<uint64_t> output_wakeups{0};
+    std::atomic<uint64_t> frames_out{0};
+};
+
+static void Spin(int us) {
+    auto until = steady_clock::now() + microseconds(us);
+    while (steady_clock::now() < until) {
+    }
+}
+
+/* The main loop's event group bit */
+class Event {
+public:
+    void Set() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        set_ = true;
+        cv_.notify_one();
+    }
+
+    void Wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait_for(lock, milliseconds(50), [this]() { return set_; });
+        set_ = false;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool set_ = false;
+};
+
+/* Waits on the shared condition variable, counting wakeups and those that found nothing to do */
+template <typename Predicate>
+static void WaitShared(std::condition_variable& cv, std::unique_lock<std::mutex>& lock,
+                       std::atomic<uint64_t>& wakeups, std::atomic<uint64_t>* spurious, Predicate predicate) {
+    while (!predicate()) {
+        cv.wait(lock);
+        wakeups++;
+        if (spurious != nullptr && !predicate()) {
+            (*spurious)++;
+        }
+    }
+}
+
+/* Pushes from a task that registers as the ring's producer only while it waits for room */
+static void PushWaiting(AudioRing<std::unique_ptr<Frame>>& ring, std::unique_ptr<Frame>&& frame, std::atomic<bool>& stop,
+                        std::atomic<uint64_t>& wakeups, std::atomic<uint64_t>* spurious) {
+    if (ring.Push(std::move(frame))) {
+        return;
+    }
+    ring.SetProducer(xTaskGetCurrentTaskHandle());
+    while (!ring.Push(std::move(frame)) && !stop) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        wakeups++;
+        if (spurious != nullptr && ring.Full() && !stop) {
+            (*spurious)++;
+        }
+    }
+    ring.SetProducer(nullptr);
+}
+
+static void MusicWhileListeningShared(double seconds, Counters& counters) {
+    std::mutex mutex;
+    std::condition_variable cv;
+    Event main_event;
+    std::atomic<bool> stop{false};
+    std::deque<std::unique_ptr<Frame>> encode_queue, send_queue, music_queue;
+
+    std::thread input([&]() {
+        while (!stop) {
+            std::this_thread::sleep_for(FRAME);
+            std::unique_lock<std::mutex> lock(mutex);
+            WaitShared(cv, lock, counters.input_wakeups, nullptr,
+                [&]() { return encode_queue.size() < MAX_ENCODE_TASKS || stop; });
+            encode_queue.push_back(std::make_unique<Frame>());
+            cv.notify_all();
+        }
+    });
+    std::thread music_decoder([&]() {
+        while (!stop) {
+            Spin(MUSIC_DECODE_US);
+            std::unique_lock<std::mutex> lock(mutex);
+            WaitShared(cv, lock, counters.music_wakeups, &counters.music_spurious,
+                [&]() { return music_queue.size() < MAX_MUSIC_FRAMES || stop; });
+            music_queue.push_back(std::make_unique<Frame>());
+            cv.notify_all();
+        }
+    });
+    std::thread codec([&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            WaitShared(cv, lock, counters.codec_wakeups, &counters.codec_spurious,
+                [&]() { return stop || (!encode_queue.empty() && send_queue.size() < MAX_SEND_PACKETS); });
+            if (stop) {
+                break;
+            }
+            auto task = std::move(encode_queue.front());
+            encode_queue.pop_front();
+            cv.notify_all();
+            lock.unlock();
+            Spin(ENCODE_US);
+            lock.lock();
+            send_queue.push_back(std::move(task));
+            lock.unlock();
+            main_event.Set();
+            lock.lock();
+        }
+    });
+    std::thread output([&]() {
+        while (true) {
+            std::unique_lock<std::mutex> lock(mutex);
+            WaitShared(cv, lock, counters.output_wakeups, nullptr, [&]() { return stop || !music_queue.empty(); });
+            if (stop) {
+                break;
+            }
+            music_queue.pop_front();
+            cv.notify_all();
+            lock.unlock();
+            std::this_thread::sleep_for(FRAME);
+            counters.frames_out++;
+        }
+    });
+    std::thread main_loop([&]() {
+        while (!stop) {
+            main_event.Wait();
+            std::lock_guard<std::mutex> lock(mutex);
+            while (!send_queue.empty()) {
+                send_queue.pop_front();
+                cv.notify_all();
+            }
+        }
+    });
+
+    std::this_thread::sleep_for(duration<double>(seconds));
+    stop = true;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        cv.notify_all();
+    }
+    main_event.Set();
+    for (auto thread : {&input, &music_decoder, &codec, &output, &main_loop}) {
+        thread->join();
+    }
+}
+
+static void MusicWhileListeningRings(double seconds, Counters& counters) {
+    AudioRing<std::unique_ptr<Frame>> encode_queue(MAX_ENCODE_TASKS), send_queue(MAX_SEND_PACKETS),
+        music_queue(MAX_MUSIC_FRAMES);
+    HostTask input_task, codec_task, output_task, music_task;
+    Event main_event;
+    std::atomic<bool> stop{false};
+
+    std::thread codec([&]() {
+        HostTaskBind(&codec_task);
+        encode_queue.SetConsumer(&codec_task);
+        send_queue.SetProducer(&codec_task);
+        while (!stop) {
+            std::unique_ptr<Frame> task;
+            if (!send_queue.Full() && encode_queue.Pop(task)) {
+                Spin(ENCODE_US);
+                send_queue.Push(std::move(task));
+                main_event.Set();
+                continue;
+            }
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            counters.codec_wakeups++;
+            if (encode_queue.Empty() && !stop) {
+                counters.codec_spurious++;
+            }
+        }
+    });
+    std::thread output([&]() {
+        HostTaskBind(&output_task);
+        music_queue.SetConsumer(&output_task);
+        while (!stop) {
+            std::unique_ptr<Frame> frame;
+            if (!music_queue.Pop(frame)) {
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+                counters.output_wakeups++;
+                continue;
+            }
+            std::this_thread::sleep_for(FRAME);
+            counters.frames_out++;
+        }
+    });
+    std::this_thread::sleep_for(milliseconds(10));
+    std::thread input([&]() {
+        HostTaskBind(&input_task);
+        while (!stop) {
+            std::this_thread::sleep_for(FRAME);
+            PushWaiting(encode_queue, std::make_unique<Frame>(), stop, counters.input_wakeups, nullptr);
+        }
+    });
+    std::thread music_decoder([&]() {
+        HostTaskBind(&music_task);
+        while (!stop) {
+            Spin(MUSIC_DECODE_US);
+            PushWaiting(music_queue, std::make_unique<Frame>(), stop, counters.music_wakeups, &counters.music_spurious);
+        }
+    });
+    std::thread main_loop([&]() {
+        while (!stop) {
+            main_event.Wait();
+            std::unique_ptr<Frame> packet;
+            while (send_queue.Pop(packet)) {
+            }
+        }
+    });
+
+    std::this_thread::sleep_for(duration<double>(seconds));
+    stop = true;
+    for (auto task : {&codec_task, &output_task, &input_task, &music_task}) {
+        xTaskNotifyGive(task);
+    }
+    main_event.Set();
+    for (auto thread : {&input, &music_decoder, &codec, &output, &main_loop}) {
+        thread->join();
+    }
+}
+
+static void FullDuplexShared(double seconds, Counters& counters) {
+    std::mutex mutex;
+    std::condition_variable cv;
+    Event main_event;
+    std::atomic<bool> stop{false};
+    std::deque<std::unique_ptr<Frame>> encode_queue, decode_queue, send_queue, playback_queue;
+
+    std::thread input([&]() {
+        while (!stop) {
+            std::this_thread::sleep_for(FRAME);
+            std::unique_lock<std::mutex> lock(mutex);
+            WaitShared(cv, lock, counters.input_wakeups, nullptr,
+                [&]() { return encode_queue.size() < MAX_ENCODE_TASKS || stop; });
+            encode_queue.push_back(std::make_unique<Frame>());
+            cv.notify_all();
+        }
+    });
+    std::thread network([&]() {
+        while (!stop) {
+            std::this_thread::sleep_for(FRAME);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (decode_queue.size() < MAX_DECODE_PACKETS) {
+                decode_queue.push_back(std::make_unique<Frame>());
+                cv.notify_all();
+            }
+        }
+    });
+    std::thread codec([&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto can_decode = [&]() { return !decode_queue.empty() && playback_queue.size() < MAX_PLAYBACK_TASKS; };
+        auto can_encode = [&]() { return !encode_queue.empty() && send_queue.size() < MAX_SEND_PACKETS; };
+        while (true) {
+            WaitShared(cv, lock, counters.codec_wakeups, nullptr, [&]() { return stop || can_decode() || can_encode(); });
+            if (stop) {
+                break;
+            }
+            if (can_decode()) {
+                auto packet = std::move(decode_queue.front());
+                decode_queue.pop_front();
+                cv.notify_all();
+                lock.unlock();
+                Spin(DECODE_US);
+                lock.lock();
+                playback_queue.push_back(std::move(packet));
+                cv.notify_all();
+            }
+            if (can_encode()) {
+                auto task = std::move(encode_queue.front());
+                encode_queue.pop_front();
+                cv.notify_all();
+                lock.unlock();
+                Spin(ENCODE_US);
+                lock.lock();
+                send_queue.push_back(std::move(task));
+                lock.unlock();
+                main_event.Set();
+                lock.lock();
+            }
+        }
+    });
+    std::thread output([&]() {
+        while (true) {
+            std::unique_lock<std::mutex> lock(mutex);
+            WaitShared(cv, lock, counters.output_wakeups, nullptr, [&]() { return stop || !playback_queue.empty(); });
+            if (stop) {
+                break;
+            }
+            playback_queue.pop_front();
+            cv.notify_all();
+            lock.unlock();
+            std::this_thread::sleep_for(FRAME);
+            counters.frames_out++;
+        }
+    });
+    std::thread main_loop([&]() {
+        while (!stop) {
+            main_event.Wait();
+            std::lock_guard<std::mutex> lock(mutex);
+            while (!send_queue.empty()) {
+                send_queue.pop_front();
+                cv.notify_all();
+            }
+        }
+    });
+
+    std::this_thread::sleep_for(duration<double>(seconds));
+    stop = true;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        cv.notify_all();
+    }
+    main_event.Set();
+    for (auto thread : {&input, &network, &codec, &output, &main_loop}) {
+        thread->join();
+    }
+}
+
+static void FullDuplexRings(double seconds, Counters& counters) {
+    AudioRing<std::unique_ptr<Frame>> encode_queue(MAX_ENCODE_TASKS), decode_queue(MAX_DECODE_PACKETS),
+        send_queue(MAX_SEND_PACKETS), playback_queue(MAX_PLAYBACK_TASKS);
+    HostTask input_task, codec_task, output_task;
+    Event main_event;
+    std::atomic<bool> stop{false};
+
+    std::thread codec([&]() {
+        HostTaskBind(&codec_task);
+        encode_queue.SetConsumer(&codec_task);
+        decode_queue.SetConsumer(&codec_task);
+        send_queue.SetProducer(&codec_task);
+        playback_queue.SetProducer(&codec_task);
+        while (!stop) {
+            bool busy = false;
+            std::unique_ptr<Frame> packet, task;
+            if (!playback_queue.Full() && decode_queue.Pop(packet)) {
+                busy = true;
+                Spin(DECODE_US);
+                playback_queue.Push(std::move(packet));
+            }
+            if (!send_queue.Full() && encode_queue.Pop(task)) {
+                busy = true;
+                Spin(ENCODE_US);
+                send_queue.Push(std::move(task));
+                main_event.Set();
+            }
+            if (!busy) {
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+                counters.codec_wakeups++;
+            }
+        }
+    });
+    std::thread output([&]() {
+        HostTaskBind(&output_task);
+        playback_queue.SetConsumer(&output_task);
+        while (!stop) {
+            std::unique_ptr<Frame> task;
+            if (!playback_queue.Pop(task)) {
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+                counters.output_wakeups++;
+                continue;
+            }
+            std::this_thread::sleep_for(FRAME);
+            counters.frames_out++;
+        }
+    });
+    std::this_thread::sleep_for(milliseconds(10));
+    std::thread input([&]() {
+        HostTaskBind(&input_task);
+        while (!stop) {
+            std::this_thread::sleep_for(FRAME);
+            PushWaiting(encode_queue, std::make_unique<Frame>(), stop, counters.input_wakeups, nullptr);
+        }
+    });
+    /* The network receive callback drops packets when the decode queue is full */
+    std::thread network([&]() {
+        while (!stop) {
+            std::this_thread::sleep_for(FRAME);
+            decode_queue.Push(std::make_unique<Frame>());
+        }
+    });
+    std::thread main_loop([&]() {
+        while (!stop) {
+            main_event.Wait();
+            std::unique_ptr<Frame> packet;
+            while (send_queue.Pop(packet)) {
+            }
+        }
+    });
+
+    std::this_thread::sleep_for(duration<double>(seconds));
+    stop = true;
+    for (auto task : {&codec_task, &output_task, &input_task}) {
+        xTaskNotifyGive(task);
+    }
+    main_event.Set();
+    for (auto thread : {&input, &network, &codec, &output, &main_loop}) {
+        thread->join();
+    }
+}
+
+/* Runs one design and returns context switches per second */
+static double Run(void (*pipeline)(double, Counters&), double seconds, Counters& counters) {
+    rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    pipeline(seconds, counters);
+    getrusage(RUSAGE_SELF, &after);
+    long switches = (after.ru_nvcsw - before.ru_nvcsw) + (after.ru_nivcsw - before.ru_nivcsw);
+    return switches / seconds;
+}
+
+int main(int argc, char** argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 5;
+    if (seconds <= 0) {
+        fprintf(stderr, "usage: %s [seconds per run]\n", argv[0]);
+        return 1;
+    }
+
+    printf("music while listening, %.0f s per run\n", seconds);
+    printf("  %-18s %10s %22s %22s %14s\n", "", "frames/s", "codec wakeups/s", "music wakeups/s", "ctx switches/s");
+    printf("  %-18s %10s %22s %22s %14s\n", "", "", "(spurious)", "(spurious)", "");
+    const struct { const char* name; void (*pipeline)(double, Counters&); } music_runs[] = {
+        {"mutex+notify_all", MusicWhileListeningShared},
+        {"rings+notify", MusicWhileListeningRings},
+    };
+    for (auto& run : music_runs) {
+        Counters counters;
+        double switches = Run(run.pipeline, seconds, counters);
+        printf("  %-18s %10.0f %12.0f (%7.0f) %12.0f (%7.0f) %14.0f\n", run.name, counters.frames_out / seconds,
+            counters.codec_wakeups / seconds, counters.codec_spurious / seconds,
+            counters.music_wakeups / seconds, counters.music_spurious / seconds, switches);
+    }
+
+    printf("full duplex, %.0f s per run\n", seconds);
+    printf("  %-18s %10s %22s %22s %14s\n", "", "frames/s", "codec wakeups/frame", "output wakeups/frame",
+        "ctx switches/s");
+    const struct { const char* name; void (*pipeline)(double, Counters&); } duplex_runs[] = {
+        {"mutex+notify_all", FullDuplexShared},
+        {"rings+notify", FullDuplexRings},
+    };
+    for (auto& run : duplex_runs) {
+        Counters counters;
+        double switches = Run(run.pipeline, seconds, counters);
+        double frames = counters.frames_out > 0 ? (double)counters.frames_out : 1;
+        printf("  %-18s %10.0f %22.2f %22.2f %14.0f\n", run.name, counters.frames_out / seconds,
+            counters.codec_wakeups / frames, counters.output_wakeups / frames, switches);
+    }
+    return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/* Time stamp counter ticks on x86 (reported as "cyc"), nanoseconds elsewhere */
+static inline uint64_t BenchTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static inline const char* BenchTickUnit() {
+#if defined(__x86_64__) || defined(__i386__)
+    return "cyc";
+#else
+    return "ns";
+#endif
+}
+
+/* Keeps the optimizer from dropping work whose result is otherwise unused */
+static volatile int bench_sink;
+
+#endif // BENCH_UTIL_H
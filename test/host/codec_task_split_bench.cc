@@ -0,0 +1,194 @@
+/*
+ * Uplink latency (encode queue -> send queue) with one codec task doing both directions, against
+ * separate encode and decode tasks, for growing Opus decode costs.
+ *
+ * A microphone frame is queued every 20 ms and takes 3 ms to encode. TTS arrives in a burst, so the
+ * decode queue is always full and the output plays one frame per period. With one task, a frame
+ * queued while a decode is running waits for it; with two, it only competes for a core.
+ * The commit measured with two cores, as on the ESP32-S3:
+ *   taskset -c 0,1 ./codec_task_split_bench [seconds per run, default 4]
+ */
+#include "audio_ring.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+static const auto PERIOD = milliseconds(20);
+static const int ENCODE_US = 3000;
+static const size_t MAX_ENCODE_TASKS = 2;
+static const size_t MAX_DECODE_PACKETS = 40;
+static const size_t MAX_SEND_PACKETS = 40;
+static const size_t MAX_PLAYBACK_TASKS = 2;
+
+struct Frame {
+    int64_t queued_us = 0;
+};
+
+static void Spin(int us) {
+    auto until = steady_clock::now() + microseconds(us);
+    while (steady_clock::now() < until) {
+    }
+}
+
+static int64_t NowUs() {
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void Run(bool split, int decode_us, double seconds) {
+    std::atomic<bool> stop{false};
+    AudioRing<std::unique_ptr<Frame>> encode_queue(MAX_ENCODE_TASKS), send_queue(MAX_SEND_PACKETS),
+        decode_queue(MAX_DECODE_PACKETS), playback_queue(MAX_PLAYBACK_TASKS);
+    HostTask encode_task, decode_task, output_task;
+    std::mutex latency_mutex;
+    std::vector<int64_t> latencies;
+
+    auto encode = [&](std::unique_ptr<Frame>& task) {
+        Spin(ENCODE_US);
+        {
+            std::lock_guard<std::mutex> lock(latency_mutex);
+            latencies.push_back(NowUs() - task->queued_us);
+        }
+        send_queue.Push(std::move(task));
+    };
+    auto decode = [&](std::unique_ptr<Frame>& packet) {
+        Spin(decode_us);
+        playback_queue.Push(std::move(packet));
+    };
+
+    std::vector<std::thread> threads;
+    if (split) {
+        threads.emplace_back([&]() {
+            HostTaskBind(&encode_task);
+            encode_queue.SetConsumer(&encode_task);
+            send_queue.SetProducer(&encode_task);
+            while (!stop) {
+                std::unique_ptr<Frame> task;
+                if (!send_queue.Full() && encode_queue.Pop(task)) {
+                    encode(task);
+                } else {
+                    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+                }
+            }
+        });
+        threads.emplace_back([&]() {
+            HostTaskBind(&decode_task);
+            decode_queue.SetConsumer(&decode_task);
+            playback_queue.SetProducer(&decode_task);
+            while (!stop) {
+                std::unique_ptr<Frame> packet;
+                if (!playback_queue.Full() && decode_queue.Pop(packet)) {
+                    decode(packet);
+                } else {
+                    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+                }
+            }
+        });
+    } else {
+        threads.emplace_back([&]() {
+            HostTaskBind(&encode_task);
+            encode_queue.SetConsumer(&encode_task);
+            send_queue.SetProducer(&encode_task);
+            decode_queue.SetConsumer(&encode_task);
+            playback_queue.SetProducer(&encode_task);
+            while (!stop) {
+                bool busy = false;
+                std::unique_ptr<Frame> packet, task;
+                if (!playback_queue.Full() && decode_queue.Pop(packet)) {
+                    busy = true;
+                    decode(packet);
+                }
+                if (!send_queue.Full() && encode_queue.Pop(task)) {
+                    busy = true;
+                    encode(task);
+                }
+                if (!busy) {
+                    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+                }
+            }
+        });
+    }
+    std::this_thread::sleep_for(milliseconds(5));
+    /* Output: one frame per period */
+    threads.emplace_back([&]() {
+        HostTaskBind(&output_task);
+        playback_queue.SetConsumer(&output_task);
+        while (!stop) {
+            std::unique_ptr<Frame> task;
+            if (!playback_queue.Pop(task)) {
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+                continue;
+            }
+            std::this_thread::sleep_for(PERIOD);
+        }
+    });
+    /* Network: a TTS burst that keeps the decode queue full */
+    threads.emplace_back([&]() {
+        while (!stop) {
+            while (decode_queue.Push(std::make_unique<Frame>())) {
+            }
+            std::this_thread::sleep_for(milliseconds(5));
+        }
+    });
+    /* Microphone: one frame per period */
+    threads.emplace_back([&]() {
+        auto next = steady_clock::now();
+        while (!stop) {
+            next += PERIOD;
+            std::this_thread::sleep_until(next);
+            auto frame = std::make_unique<Frame>();
+            frame->queued_us = NowUs();
+            encode_queue.Push(std::move(frame));
+        }
+    });
+    /* Main loop: sends whatever is encoded */
+    threads.emplace_back([&]() {
+        while (!stop) {
+            std::unique_ptr<Frame> packet;
+            while (send_queue.Pop(packet)) {
+            }
+            std::this_thread::sleep_for(milliseconds(2));
+        }
+    });
+
+    std::this_thread::sleep_for(duration<double>(seconds));
+    stop = true;
+    for (auto task : {&encode_task, &decode_task, &output_task}) {
+        xTaskNotifyGive(task);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    if (latencies.empty()) {
+        printf("%-9s decode %2d ms/frame: no frames encoded\n", split ? "split" : "combined", decode_us / 1000);
+        return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    double sum = 0;
+    for (auto latency : latencies) {
+        sum += latency;
+    }
+    printf("%-9s decode %2d ms/frame: uplink latency avg %5.1f ms  p95 %5.1f ms  max %5.1f ms  (%zu frames)\n",
+        split ? "split" : "combined", decode_us / 1000, sum / latencies.size() / 1000.0,
+        latencies[latencies.size() * 95 / 100] / 1000.0, latencies.back() / 1000.0, latencies.size());
+}
+
+int main(int argc, char** argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 4;
+    if (seconds <= 0) {
+        fprintf(stderr, "usage: %s [seconds per run]\n", argv[0]);
+        return 1;
+    }
+    for (int decode_ms : {0, 5, 10, 15}) {
+        Run(false, decode_ms * 1000, seconds);
+        Run(true, decode_ms * 1000, seconds);
+    }
+    return 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * TTS playout with and without the jitter buffer, simulated in 1 ms steps.
+ *
+ * JitterBuffer is AudioService::TrackArrival and ReadyToPlayout with the members renamed; keep it in
+ * sync with audio_service.cc. The server paces 60 ms frames in real time, each frame's network delay
+ * is 30 ms plus an exponential jitter (mean 5 ms) plus, on the stalling links, occasional Wi-Fi stalls.
+ * Delivery is in order, as over TCP. The decode task moves frames into a playback queue of two, and
+ * the output task plays one every 60 ms; an empty playback queue at a tick is a stutter.
+ * Each link plays 20 streams of 1000 frames with 5 s pauses in between.
+ */
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <random>
+#include <vector>
+
+/* Keep in sync with audio_service.h */
+static const int JITTER_MIN_DELAY_MS = 40;
+static const int JITTER_MAX_DELAY_MS = 600;
+static const int JITTER_DELAY_MARGIN_MS = 20;
+static const int JITTER_PEAK_DECAY_MS = 5000;
+static const int JITTER_STREAM_GAP_MS = 1000;
+
+static const int FRAME_MS = 60;
+static const int FRAMES_PER_STREAM = 1000;
+static const int STREAMS = 20;
+static const int MAX_PLAYBACK_TASKS = 2;
+
+class JitterBuffer {
+public:
+    void TrackArrival(int64_t now, int frame_duration, uint32_t lost_before) {
+        int64_t frame_us = frame_duration * 1000LL;
+        if (last_arrival_us_ == 0 || now - last_arrival_us_ > JITTER_STREAM_GAP_MS * 1000LL) {
+            media_us_ = 0;
+            base_transit_us_ = now;
+        } else {
+            media_us_ += frame_us * (lost_before + 1);
+        }
+        last_arrival_us_ = now;
+
+        int64_t transit_us = now - media_us_;
+        if (transit_us < base_transit_us_) {
+            base_transit_us_ = transit_us;
+        }
+        int64_t delay_us = transit_us - base_transit_us_;
+        if (delay_us > target_ms_ * 1000LL) {
+            late_frames_++;
+        }
+
+        peak_us_ -= peak_us_ * frame_us / (JITTER_PEAK_DECAY_MS * 1000LL);
+        if (delay_us > peak_us_) {
+            peak_us_ = delay_us;
+        }
+        int64_t target_ms = peak_us_ / 1000 + JITTER_DELAY_MARGIN_MS;
+        target_ms_ = (uint32_t)std::min<int64_t>(std::max<int64_t>(target_ms, JITTER_MIN_DELAY_MS), JITTER_MAX_DELAY_MS);
+    }
+
+    bool ReadyToPlayout(int64_t now, size_t depth, int frame_duration) {
+        if (!buffering_) {
+            if (!ran_dry_) {
+                return depth > 0;
+            }
+            ran_dry_ = false;
+            buffering_ = true;
+            buffering_since_ = 0;
+        }
+        if (depth == 0) {
+            return false;
+        }
+        if (buffering_since_ == 0) {
+            buffering_since_ = now;
+        }
+        int64_t target_us = target_ms_ * 1000LL;
+        int64_t waited_us = now - buffering_since_;
+        if ((int64_t)(depth - 1) * frame_duration * 1000 < target_us && waited_us < target_us) {
+            return false;
+        }
+        buffering_ = false;
+        return true;
+    }
+
+    /* The output task found the playback queue empty */
+    void OnRanDry() { ran_dry_ = true; }
+
+    uint32_t target_ms() const { return target_ms_; }
+    uint32_t late_frames() const { return late_frames_; }
+
+private:
+    int64_t last_arrival_us_ = 0;
+    int64_t media_us_ = 0;
+    int64_t base_transit_us_ = 0;
+    int64_t peak_us_ = 0;
+    uint32_t target_ms_ = JITTER_MIN_DELAY_MS;
+    uint32_t late_frames_ = 0;
+    bool buffering_ = true;
+    bool ran_dry_ = false;
+    int64_t buffering_since_ = 0;
+};
+
+struct Link {
+    const char* name;
+    double stall_probability;   // Per frame
+    double stall_min_ms;
+    double stall_spread_ms;
+};
+
+struct Result {
+    double start_ms = 0;        // Average per stream, from the first arrival
+    double stutter_ms = 0;      // Per minute of audio
+    double stutters = 0;        // Per minute of audio
+    uint32_t late_frames = 0;
+    uint32_t final_target_ms = 0;
+};
+
+static Result Run(const Link& link, bool jitter_buffer, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::exponential_distribution<double> jitter(1.0 / 5);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    JitterBuffer buffer;
+    Result result;
+    double minutes = 0;
+    int64_t stream_start = 1000000;
+
+    for (int stream = 0; stream < STREAMS; stream++) {
+        std::vector<int64_t> arrivals(FRAMES_PER_STREAM);
+        int64_t previous = 0;
+        for (int k = 0; k < FRAMES_PER_STREAM; k++) {
+            double delay = 30 + jitter(rng);
+            if (link.stall_probability > 0 && uniform(rng) < link.stall_probability) {
+                delay += link.stall_min_ms + link.stall_spread_ms * uniform(rng);
+            }
+            int64_t arrival = stream_start + (int64_t)(k * FRAME_MS + delay);
+            arrivals[k] = std::max(arrival, previous);
+            previous = arrivals[k];
+        }
+
+        std::deque<int> decode_queue;
+        int playback_queue = 0, next_arrival = 0, played = 0;
+        int64_t first = arrivals[0], next_tick = -1, last_stutter = -10;
+        bool started = false;
+        for (int64_t now = first; played < FRAMES_PER_STREAM; now++) {
+            while (next_arrival < FRAMES_PER_STREAM && arrivals[next_arrival] <= now) {
+                buffer.TrackArrival(now * 1000, FRAME_MS, 0);
+                decode_queue.push_back(next_arrival++);
+            }
+            while (playback_queue < MAX_PLAYBACK_TASKS && !decode_queue.empty() &&
+                   (!jitter_buffer || buffer.ReadyToPlayout(now * 1000, decode_queue.size(), FRAME_MS))) {
+                decode_queue.pop_front();
+                playback_queue++;
+            }
+            if (!started) {
+                if (playback_queue == 0) {
+                    continue;
+                }
+                started = true;
+                result.start_ms += now - first;
+                next_tick = now;
+            }
+            if (now != next_tick) {
+                continue;
+            }
+            if (playback_queue > 0) {
+                playback_queue--;
+                played++;
+                next_tick = now + FRAME_MS;
+            } else {
+                result.stutter_ms += 1;
+                next_tick = now + 1;
+                if (now - 1 != last_stutter) {
+                    result.stutters++;
+                    buffer.OnRanDry();
+                }
+                last_stutter = now;
+            }
+        }
+        /* The output task finds the queue empty after the last frame */
+        buffer.OnRanDry();
+        stream_start = previous + 5000;
+        minutes += FRAMES_PER_STREAM * FRAME_MS / 60000.0;
+    }
+    result.start_ms /= STREAMS;
+    result.stutter_ms /= minutes;
+    result.stutters /= minutes;
+    result.late_frames = buffer.late_frames();
+    result.final_target_ms = buffer.target_ms();
+    return result;
+}
+
+int main() {
+    const Link links[] = {
+        {"clean", 0, 0, 0},
+        {"3% stalls", 0.03, 100, 200},
+        {"8% stalls", 0.08, 150, 250},
+    };
+    printf("%-10s  %-8s  %8s  %14s  %12s  %5s  %12s\n", "link", "mode", "start ms", "stutter ms/min", "stutters/min",
+        "late", "final target");
+    for (auto& link : links) {
+        for (bool jitter_buffer : {false, true}) {
+            Result result = Run(link, jitter_buffer, 7);
+            printf("%-10s  %-8s  %8.1f  %14.0f  %12.1f  %5u  %9u ms\n", link.name, jitter_buffer ? "adaptive" : "direct",
+                result.start_ms, result.stutter_ms, result.stutters, result.late_frames,
+                jitter_buffer ? result.final_target_ms : 0);
+        }
+    }
+    return 0;
+}
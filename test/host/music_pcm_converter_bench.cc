@@ -0,0 +1,164 @@
+/*
+ * Music output conversion per decoded frame:
+ *
+ * - "old path": downmix into a fresh vector, copy into an AudioStreamPacket payload, copy for the
+ *   spectrum buffer, copy again in Application::AddAudioData, then its per-packet linear upsampler
+ *   (integer output count, no state across packets, and it only ever upsampled)
+ * - "linear": the fused single-pass converter with Q16 linear interpolation (reference/)
+ * - "polyphase": the current MusicPcmConverter
+ *
+ * Each converter also runs 1000 frames back to back, and the output length must match the rate ratio
+ * within MAX_LENGTH_ERROR_PPM for the stateful converters, or the program fails.
+ */
+#include "music_pcm_converter.h"
+#include "reference/linear_pcm_converter.h"
+#include "bench_util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const int ITERATIONS = 5000;
+static const int LENGTH_FRAMES = 1000;
+static const double MAX_LENGTH_ERROR_PPM = 20;
+static const size_t SPECTRUM_SAMPLES = 1152;    // Esp32Music::FFT_SIZE
+
+struct AudioStreamPacket {
+    int sample_rate;
+    int frame_duration;
+    std::vector<uint8_t> payload;
+};
+
+static int16_t spectrum[SPECTRUM_SAMPLES];
+
+/* Returns the number of samples handed to the codec */
+static size_t OldPath(const std::vector<int16_t>& pcm, int channels, int rate, int codec_rate) {
+    const int16_t* final_pcm = pcm.data();
+    size_t count = pcm.size();
+    std::vector<int16_t> mono;
+    if (channels == 2) {
+        count = pcm.size() / 2;
+        mono.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            mono[i] = (int16_t)((pcm[i * 2] + pcm[i * 2 + 1]) / 2);
+        }
+        final_pcm = mono.data();
+    }
+    AudioStreamPacket packet;
+    packet.sample_rate = rate;
+    packet.frame_duration = 60;
+    packet.payload.resize(count * sizeof(int16_t));
+    memcpy(packet.payload.data(), final_pcm, count * sizeof(int16_t));
+    memcpy(spectrum, final_pcm, std::min(count, SPECTRUM_SAMPLES) * sizeof(int16_t));
+
+    std::vector<int16_t> data(packet.payload.size() / sizeof(int16_t));
+    memcpy(data.data(), packet.payload.data(), packet.payload.size());
+    if (packet.sample_rate < codec_rate) {
+        float ratio = (float)packet.sample_rate / codec_rate;
+        size_t resampled_size = (size_t)(data.size() / ratio);
+        std::vector<int16_t> resampled(resampled_size);
+        for (size_t i = 0; i < resampled_size; i++) {
+            float position = i * ratio;
+            size_t index = (size_t)position;
+            float fraction = position - index;
+            if (index + 1 < data.size()) {
+                resampled[i] = (int16_t)(data[index] * (1 - fraction) + data[index + 1] * fraction);
+            } else {
+                resampled[i] = data[index];
+            }
+        }
+        data = std::move(resampled);
+    }
+    bench_sink += data[0];
+    return data.size();
+}
+
+/* The fused converters write into a reused output frame, the spectrum copy comes from that frame */
+template <typename Converter>
+static size_t Convert(Converter& converter, const std::vector<int16_t>& pcm, std::vector<int16_t>& output) {
+    size_t count = converter.Process(pcm.data(), pcm.size(), output);
+    memcpy(spectrum, output.data(), std::min(count, SPECTRUM_SAMPLES) * sizeof(int16_t));
+    bench_sink += count > 0 ? output[0] : 0;
+    return count;
+}
+
+/* Ticks per frame after a warm-up */
+template <typename Frame>
+static double Measure(Frame frame) {
+    for (int i = 0; i < 1000; i++) {
+        frame();
+    }
+    uint64_t start = BenchTicks();
+    for (int i = 0; i < ITERATIONS; i++) {
+        frame();
+    }
+    return (double)(BenchTicks() - start) / ITERATIONS;
+}
+
+template <typename Frame>
+static double LengthErrorPpm(Frame frame, double expected_per_frame) {
+    size_t total = 0;
+    for (int i = 0; i < LENGTH_FRAMES; i++) {
+        total += frame();
+    }
+    double expected = expected_per_frame * LENGTH_FRAMES;
+    return (total - expected) / expected * 1e6;
+}
+
+int main() {
+    struct Case { int rate; int channels; int codec_rate; int frames; };
+    const Case cases[] = {
+        {44100, 2, 24000, 1152},    // MP3 at 44.1 kHz
+        {22050, 2, 24000, 576},     // MPEG-2 layer III
+        {16000, 1, 24000, 1152},
+        {24000, 2, 24000, 1152},    // Same rate, downmix only
+        {48000, 1, 24000, 960},
+    };
+    bool lengths_ok = true;
+    printf("%-16s %14s %14s %14s %12s %12s %12s\n", "input -> codec",
+        (std::string("old ") + BenchTickUnit() + "/frame").c_str(),
+        (std::string("linear ") + BenchTickUnit() + "/frame").c_str(),
+        (std::string("poly ") + BenchTickUnit() + "/frame").c_str(),
+        "old ppm", "linear ppm", "poly ppm");
+    for (auto& c : cases) {
+        std::vector<int16_t> pcm(c.frames * c.channels);
+        for (size_t i = 0; i < pcm.size(); i++) {
+            pcm[i] = (int16_t)(8000 * sin(i * 0.05));
+        }
+        double expected_per_frame = (double)c.frames * c.codec_rate / c.rate;
+
+        LinearPcmConverter linear;
+        MusicPcmConverter polyphase;
+        std::vector<int16_t> output;
+        auto old_frame = [&]() { return OldPath(pcm, c.channels, c.rate, c.codec_rate); };
+        auto linear_frame = [&]() { return Convert(linear, pcm, output); };
+        auto polyphase_frame = [&]() { return Convert(polyphase, pcm, output); };
+
+        linear.Configure(c.rate, c.channels, c.codec_rate);
+        polyphase.Configure(c.rate, c.channels, c.codec_rate);
+        double old_ticks = Measure(old_frame);
+        double linear_ticks = Measure(linear_frame);
+        double polyphase_ticks = Measure(polyphase_frame);
+
+        linear.Configure(c.rate, c.channels, c.codec_rate);
+        polyphase.Configure(c.rate, c.channels, c.codec_rate);
+        double old_ppm = LengthErrorPpm(old_frame, expected_per_frame);
+        double linear_ppm = LengthErrorPpm(linear_frame, expected_per_frame);
+        double polyphase_ppm = LengthErrorPpm(polyphase_frame, expected_per_frame);
+        lengths_ok = lengths_ok && fabs(linear_ppm) <= MAX_LENGTH_ERROR_PPM && fabs(polyphase_ppm) <= MAX_LENGTH_ERROR_PPM;
+
+        char name[32];
+        snprintf(name, sizeof(name), "%d x%d -> %d", c.rate, c.channels, c.codec_rate);
+        printf("%-16s %14.0f %14.0f %14.0f %12.0f %12.1f %12.1f\n", name, old_ticks, linear_ticks,
+            polyphase_ticks, old_ppm, linear_ppm, polyphase_ppm);
+    }
+    if (!lengths_ok) {
+        fprintf(stderr, "output length drifts from the rate ratio by more than %.0f ppm\n", MAX_LENGTH_ERROR_PPM);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,151 @@
+/*
+ * The raw I2S codec kernels in pcm_format against the per-call code they replaced:
+ *
+ * - NoAudioCodec::Write / K10AudioCodec::Write: a fresh int32 vector per call, pow() for the gain and
+ *   an int64 multiply with clamping per sample
+ * - NoAudioCodec::Read: a fresh int32 vector per call and a branchy >> 12 saturation
+ * - the LilyGO codecs: a malloc'd int16 frame scaled through float by volume / 100
+ *
+ * The new kernels must match the old Write and Read bit for bit for every volume, and the 16-bit path
+ * must stay within 1 LSB of the float math, or the program fails. Then each path is timed on
+ * 1440-sample frames (60 ms at 24 kHz), best of 7 runs.
+ */
+#include "pcm_format.h"
+#include "bench_util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static const int FRAME_SAMPLES = 1440;
+static const int ITERATIONS = 20000;
+static const int DMA_FRAME_SAMPLES = 240;   // AUDIO_CODEC_DMA_FRAME_NUM
+
+__attribute__((noinline)) static void OldWrite(const int16_t* data, int samples, int volume, std::vector<int32_t>* kept) {
+    std::vector<int32_t> buffer(samples);
+    int32_t volume_factor = pow(double(volume) / 100.0, 2) * 65536;
+    for (int i = 0; i < samples; i++) {
+        int64_t temp = int64_t(data[i]) * volume_factor;
+        if (temp > INT32_MAX) {
+            buffer[i] = INT32_MAX;
+        } else if (temp < INT32_MIN) {
+            buffer[i] = INT32_MIN;
+        } else {
+            buffer[i] = static_cast<int32_t>(temp);
+        }
+    }
+    kept->swap(buffer);
+}
+
+__attribute__((noinline)) static void OldRead(int16_t* dest, int samples, const int32_t* i2s_data) {
+    std::vector<int32_t> bit32_buffer(samples);
+    memcpy(bit32_buffer.data(), i2s_data, samples * sizeof(int32_t));
+    for (int i = 0; i < samples; i++) {
+        int32_t value = bit32_buffer[i] >> 12;
+        dest[i] = (value > INT16_MAX) ? INT16_MAX : (value < -INT16_MAX) ? -INT16_MAX : (int16_t)value;
+    }
+}
+
+static void OldWrite16(const int16_t* data, int samples, int volume, int16_t* dest) {
+    for (int i = 0; i < samples; i++) {
+        dest[i] = (float)data[i] * (float)(volume / 100.0);
+    }
+}
+
+static bool CheckExact(const std::vector<int16_t>& input, const std::vector<int32_t>& i2s_data) {
+    for (int volume = 0; volume <= 100; volume++) {
+        std::vector<int32_t> old_output, output(FRAME_SAMPLES), stereo(FRAME_SAMPLES * 2);
+        OldWrite(input.data(), FRAME_SAMPLES, volume, &old_output);
+        PcmScale16To32(input.data(), output.data(), FRAME_SAMPLES, PcmVolumeToGain(volume));
+        PcmScale16To32Stereo(input.data(), stereo.data(), FRAME_SAMPLES, PcmVolumeToGain(volume));
+        for (int i = 0; i < FRAME_SAMPLES; i++) {
+            if (old_output[i] != output[i] || old_output[i] != stereo[i * 2] || old_output[i] != stereo[i * 2 + 1]) {
+                fprintf(stderr, "write differs at volume %d sample %d: %d, new %d\n", volume, i, old_output[i], output[i]);
+                return false;
+            }
+        }
+    }
+    std::vector<int16_t> old_output(FRAME_SAMPLES), output(FRAME_SAMPLES);
+    OldRead(old_output.data(), FRAME_SAMPLES, i2s_data.data());
+    PcmConvert32To16(i2s_data.data(), output.data(), FRAME_SAMPLES, 12);
+    if (old_output != output) {
+        fprintf(stderr, "read conversion differs\n");
+        return false;
+    }
+    return true;
+}
+
+static int MaxError16(const std::vector<int16_t>& input) {
+    int max_error = 0;
+    std::vector<int16_t> old_output(FRAME_SAMPLES), output(FRAME_SAMPLES);
+    for (int volume = 0; volume <= 100; volume++) {
+        OldWrite16(input.data(), FRAME_SAMPLES, volume, old_output.data());
+        PcmScale16(input.data(), output.data(), FRAME_SAMPLES, PcmVolumeToLinearGain(volume));
+        for (int i = 0; i < FRAME_SAMPLES; i++) {
+            max_error = std::max(max_error, abs(old_output[i] - output[i]));
+        }
+    }
+    return max_error;
+}
+
+template <typename Frame>
+static void Bench(const char* name, Frame frame) {
+    double best = 1e18;
+    for (int run = 0; run < 7; run++) {
+        uint64_t start = BenchTicks();
+        for (int i = 0; i < ITERATIONS; i++) {
+            frame();
+        }
+        best = std::min(best, (double)(BenchTicks() - start) / ITERATIONS / FRAME_SAMPLES);
+    }
+    printf("%-34s %6.2f %s/sample\n", name, best, BenchTickUnit());
+}
+
+int main() {
+    srand(1);
+    std::vector<int16_t> input(FRAME_SAMPLES);
+    std::vector<int32_t> i2s_data(FRAME_SAMPLES);
+    for (int i = 0; i < FRAME_SAMPLES; i++) {
+        input[i] = (int16_t)(rand() & 0xFFFF);
+        i2s_data[i] = (int32_t)((uint32_t)rand() * 2u);
+    }
+    input[0] = INT16_MIN;
+    input[1] = INT16_MAX;
+
+    if (!CheckExact(input, i2s_data)) {
+        return 1;
+    }
+    int max_error = MaxError16(input);
+    printf("bit-exact with the old Write for volumes 0..100 and with the old Read conversion\n");
+    printf("16-bit path: at most %d LSB from the old float math\n", max_error);
+    if (max_error > 1) {
+        return 1;
+    }
+
+    std::vector<int32_t> kept, output32(DMA_FRAME_SAMPLES);
+    std::vector<int16_t> output16(FRAME_SAMPLES);
+    PcmGainCache gain_cache;
+    Bench("old write (alloc, pow, int64)", [&]() {
+        OldWrite(input.data(), FRAME_SAMPLES, 70, &kept);
+    });
+    /* The codecs write through one DMA buffer of scratch at a time */
+    Bench("new write (240-sample chunks)", [&]() {
+        int32_t gain = gain_cache.Get(70);
+        for (int offset = 0; offset < FRAME_SAMPLES; offset += DMA_FRAME_SAMPLES) {
+            PcmScale16To32(input.data() + offset, output32.data(), DMA_FRAME_SAMPLES, gain);
+            asm volatile("" : : "r"(output32.data()) : "memory");
+        }
+    });
+    Bench("old read (alloc, branches)", [&]() {
+        OldRead(output16.data(), FRAME_SAMPLES, i2s_data.data());
+        asm volatile("" : : "r"(output16.data()) : "memory");
+    });
+    Bench("new read", [&]() {
+        PcmConvert32To16(i2s_data.data(), output16.data(), FRAME_SAMPLES, 12);
+        asm volatile("" : : "r"(output16.data()) : "memory");
+    });
+    return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * Downlink packet loss against Opus concealment: sequence numbers go through the same gap logic as
+ * MqttProtocol's UDP receive and the same per-gap cap as the decode task, and the model counts the
+ * audio that is neither decoded nor concealed, i.e. a cut in the speech.
+ *
+ * Loss follows a Gilbert model (mean loss rate and mean burst length), 100 minutes per row. The
+ * "cut without PLC" column is every lost frame, as before concealment existed.
+ *
+ * A second pass duplicates and reorders 1% of the delivered packets each. Duplicates and late packets
+ * must be dropped without concealing anything: a late packet can only turn into one more lost frame,
+ * so the frames counted as lost may not exceed the frames really lost plus the packets dropped, or
+ * the program fails (a duplicate that wrapped the gap to 2^32 - 1 would count four billion).
+ */
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+static const int MAX_CONCEALMENT_DURATION_MS = 120;    // Keep in sync with audio_service.h
+static const int MINUTES = 100;
+
+/* MqttProtocol's check: -1 drops the packet, otherwise the number of packets lost before it */
+static int64_t LostBefore(uint32_t sequence, uint32_t& remote_sequence) {
+    if (sequence < remote_sequence) {
+        return -1;
+    }
+    if (sequence == remote_sequence && remote_sequence != 0) {
+        return -1;
+    }
+    uint32_t lost_before = 0;
+    if (sequence != remote_sequence + 1 && remote_sequence != 0 && sequence > remote_sequence + 1) {
+        lost_before = sequence - remote_sequence - 1;
+    }
+    remote_sequence = sequence;
+    return lost_before;
+}
+
+struct Result {
+    double lost_ms = 0;             // Per minute
+    double cut_after_ms = 0;        // Per minute, what concealment does not cover
+    uint32_t longest_cut_ms = 0;
+    uint32_t dropped = 0;           // Duplicates and late packets
+    uint64_t lost_frames = 0;       // What the gap logic counted
+    uint64_t really_lost = 0;       // What the channel dropped
+};
+
+/* `shuffle` is the probability of duplicating, and separately of swapping, each delivered packet */
+static Result Run(double loss, double burst, int frame_ms, double shuffle, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    /* Gilbert model: leave the bad state with 1 / burst, enter it so the mean loss is `loss` */
+    double recover = 1.0 / burst;
+    double fail = loss * recover / (1 - loss);
+    const uint32_t frames = MINUTES * 60000 / frame_ms;
+
+    Result result;
+    std::vector<uint32_t> arrivals;
+    bool bad = false;
+    for (uint32_t sequence = 1; sequence <= frames; sequence++) {
+        bad = bad ? uniform(rng) >= recover : uniform(rng) < fail;
+        if (bad) {
+            result.really_lost++;
+            continue;
+        }
+        arrivals.push_back(sequence);
+        if (shuffle <= 0) {
+            continue;
+        }
+        if (uniform(rng) < shuffle) {
+            arrivals.push_back(sequence);
+        }
+        if (arrivals.size() >= 2 && uniform(rng) < shuffle) {
+            std::swap(arrivals[arrivals.size() - 1], arrivals[arrivals.size() - 2]);
+        }
+    }
+
+    uint32_t remote_sequence = 0;
+    const uint32_t max_frames = MAX_CONCEALMENT_DURATION_MS / frame_ms;
+    for (uint32_t sequence : arrivals) {
+        int64_t lost_before = LostBefore(sequence, remote_sequence);
+        if (lost_before < 0) {
+            result.dropped++;
+            continue;
+        }
+        uint32_t concealed = std::min<uint32_t>(lost_before, max_frames);
+        uint32_t cut_ms = (lost_before - concealed) * frame_ms;
+        result.lost_frames += lost_before;
+        result.lost_ms += lost_before * frame_ms;
+        result.cut_after_ms += cut_ms;
+        result.longest_cut_ms = std::max(result.longest_cut_ms, cut_ms);
+    }
+    result.lost_ms /= MINUTES;
+    result.cut_after_ms /= MINUTES;
+    return result;
+}
+
+int main() {
+    bool ok = true;
+    printf("frame  loss  burst  lost ms/min  cut without PLC  cut with PLC  longest cut | with 1%% dup+reorder: cut with PLC, dropped\n");
+    for (int frame_ms : {60, 20}) {
+        for (double burst : {1.0, 2.5}) {
+            for (double loss : {0.01, 0.03, 0.05, 0.10}) {
+                Result clean = Run(loss, burst, frame_ms, 0, 42);
+                Result shuffled = Run(loss, burst, frame_ms, 0.01, 42);
+                bool shuffled_ok = clean.lost_frames <= clean.really_lost &&
+                    shuffled.lost_frames <= shuffled.really_lost + shuffled.dropped;
+                ok = ok && shuffled_ok;
+                printf("%3dms  %3.0f%%  %4.1f  %11.0f  %15.0f  %12.1f  %8u ms | %12.1f  %7u%s\n", frame_ms, loss * 100,
+                    burst, clean.lost_ms, clean.lost_ms, clean.cut_after_ms, clean.longest_cut_ms,
+                    shuffled.cut_after_ms, shuffled.dropped, shuffled_ok ? "" : "  WRAPPED GAP");
+            }
+        }
+    }
+    return ok ? 0 : 1;
+}
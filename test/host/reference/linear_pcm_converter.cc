@@ -0,0 +1,94 @@
+#include "linear_pcm_converter.h"
+
+#include <cstring>
+
+void LinearPcmConverter::Configure(int input_rate, int input_channels, int output_rate) {
+    input_rate_ = input_rate;
+    input_channels_ = input_channels > 0 ? input_channels : 1;
+    output_rate_ = output_rate;
+    step_ = (output_rate > 0) ? (uint32_t)(((uint64_t)input_rate << 16) / output_rate) : (1 << 16);
+    Reset();
+}
+
+void LinearPcmConverter::Reset() {
+    phase_ = 0;
+    last_sample_ = 0;
+}
+
+// 线性插值，mono(i) 返回第 i 个单声道样本，i = -1 对应 last
+template <typename MonoFn>
+static inline uint32_t Interpolate(MonoFn mono, int32_t last, uint32_t phase, uint32_t step,
+                                   int16_t* out, size_t count) {
+    uint32_t pos = phase;
+    for (size_t k = 0; k < count; ++k) {
+        uint32_t index = pos >> 16;
+        // 用Q15的小数部分，差值乘积不会溢出32位
+        int32_t frac = (pos & 0xFFFF) >> 1;
+        int32_t a = index > 0 ? mono(index - 1) : last;
+        int32_t b = mono(index);
+        out[k] = (int16_t)(a + (((b - a) * frac) >> 15));
+        pos += step;
+    }
+    return pos;
+}
+
+size_t LinearPcmConverter::Process(const int16_t* input, size_t input_samples, std::vector<int16_t>& output) {
+    const int channels = input_channels_;
+    size_t frames = input_samples / channels;
+    // 位置用32位Q16表示，留出余量后一帧最多32767个样本
+    if (frames == 0 || frames > 0x7FFF || output_rate_ <= 0) {
+        output.clear();
+        return 0;
+    }
+
+    auto mono_stereo = [input](uint32_t i) -> int32_t {
+        return (input[i * 2] + input[i * 2 + 1]) >> 1;
+    };
+    auto mono_any = [input, channels](uint32_t i) -> int32_t {
+        int32_t sum = 0;
+        for (int c = 0; c < channels; ++c) {
+            sum += input[i * channels + c];
+        }
+        return sum / channels;
+    };
+
+    if (input_rate_ == output_rate_) {
+        // 采样率相同：只做声道混合
+        output.resize(frames);
+        int16_t* out = output.data();
+        if (channels == 1) {
+            memcpy(out, input, frames * sizeof(int16_t));
+        } else if (channels == 2) {
+            for (size_t i = 0; i < frames; ++i) {
+                out[i] = (int16_t)mono_stereo(i);
+            }
+        } else {
+            for (size_t i = 0; i < frames; ++i) {
+                out[i] = (int16_t)mono_any(i);
+            }
+        }
+        last_sample_ = out[frames - 1];
+        return frames;
+    }
+
+    // 本帧能产生的输出个数：位置 phase_ + k * step_ 落在 [0, frames) 之内的 k 的个数
+    uint32_t end = (uint32_t)frames << 16;
+    size_t count = phase_ < end ? (end - phase_ + step_ - 1) / step_ : 0;
+    output.resize(count);
+    int16_t* out = output.data();
+
+    uint32_t pos;
+    if (channels == 1) {
+        pos = Interpolate([input](uint32_t i) -> int32_t { return input[i]; },
+                          last_sample_, phase_, step_, out, count);
+        last_sample_ = input[frames - 1];
+    } else if (channels == 2) {
+        pos = Interpolate(mono_stereo, last_sample_, phase_, step_, out, count);
+        last_sample_ = (int16_t)mono_stereo(frames - 1);
+    } else {
+        pos = Interpolate(mono_any, last_sample_, phase_, step_, out, count);
+        last_sample_ = (int16_t)mono_any(frames - 1);
+    }
+    phase_ = pos - end;
+    return count;
+}
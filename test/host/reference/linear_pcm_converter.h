@@ -0,0 +1,44 @@
+/*
+ * The linear-interpolation MusicPcmConverter as it was before the polyphase filter replaced it,
+ * kept so the benchmarks can put the two side by side.
+ */
+#ifndef LINEAR_PCM_CONVERTER_H
+#define LINEAR_PCM_CONVERTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * 音乐输出转换：一次遍历完成 多声道->单声道混合 + 采样率转换，直接写入调用者复用的输出帧。
+ *
+ * - 重采样为Q16定点线性插值，支持任意比例（例如 16kHz -> 24kHz），
+ *   插值位置和上一帧最后一个样本跨帧保留，帧与帧之间没有接缝
+ * - 采样率相同时退化为单纯的混合（单声道时为一次拷贝）
+ * - 输出帧只在容量不足时增长，稳定播放后不再有堆操作
+ */
+class LinearPcmConverter {
+public:
+    // 输入格式或输出采样率变化时调用，会清除跨帧状态
+    void Configure(int input_rate, int input_channels, int output_rate);
+    // 跳转或换歌后调用，丢弃上一段音频的插值状态
+    void Reset();
+
+    int input_rate() const { return input_rate_; }
+    int input_channels() const { return input_channels_; }
+    int output_rate() const { return output_rate_; }
+
+    // input 为交错的多声道样本（合计 input_samples 个），返回写入 output 的单声道样本数
+    size_t Process(const int16_t* input, size_t input_samples, std::vector<int16_t>& output);
+
+private:
+    int input_rate_ = 0;
+    int input_channels_ = 0;
+    int output_rate_ = 0;
+
+    uint32_t step_ = 1 << 16;  // 每个输出样本在输入中前进的距离（Q16）
+    uint32_t phase_ = 0;       // 下一个输出样本的位置（Q16），0 对应上一帧的最后一个样本
+    int16_t last_sample_ = 0;
+};
+
+#endif // LINEAR_PCM_CONVERTER_H
@@ -0,0 +1,139 @@
+/*
+ * Resampling quality of the polyphase MusicPcmConverter against the linear converter it replaced
+ * (reference/), on pure tones fed in 1152-sample frames for two seconds of input:
+ *
+ * - THD+N: least-squares fit of a sine at the tone frequency to the output (edges skipped), and the
+ *   power of what is left over relative to the fitted sine
+ * - cost in ticks per output sample (cycles on x86)
+ * - output length against the rate ratio, and for upsampling what the old AddAudioData upsampler
+ *   produced for one second of input (it repeated floor(ratio) - 1 interpolated samples per input)
+ *
+ * Fails if the polyphase converter is worse than MAX_THD_N_DB on any tone or is off by more than
+ * one sample in length.
+ */
+#include "music_pcm_converter.h"
+#include "reference/linear_pcm_converter.h"
+#include "bench_util.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static const int FRAME_SAMPLES = 1152;
+static const double MAX_THD_N_DB = -75;
+static const size_t EDGE_SAMPLES = 200;
+
+static double ThdN(const std::vector<int16_t>& y, double frequency, int rate) {
+    double s11 = 0, s12 = 0, s22 = 0, r1 = 0, r2 = 0;
+    for (size_t i = EDGE_SAMPLES; i + EDGE_SAMPLES < y.size(); i++) {
+        double w = 2 * M_PI * frequency * i / rate;
+        double a = sin(w), b = cos(w);
+        s11 += a * a;
+        s12 += a * b;
+        s22 += b * b;
+        r1 += a * y[i];
+        r2 += b * y[i];
+    }
+    double det = s11 * s22 - s12 * s12;
+    double amplitude_sin = (r1 * s22 - r2 * s12) / det;
+    double amplitude_cos = (r2 * s11 - r1 * s12) / det;
+    double signal = 0, residual = 0;
+    for (size_t i = EDGE_SAMPLES; i + EDGE_SAMPLES < y.size(); i++) {
+        double w = 2 * M_PI * frequency * i / rate;
+        double fit = amplitude_sin * sin(w) + amplitude_cos * cos(w);
+        signal += fit * fit;
+        residual += (y[i] - fit) * (y[i] - fit);
+    }
+    return 10 * log10(residual / signal);
+}
+
+/* Application::AddAudioData before the music converter existed */
+static size_t OldUpsampledLength(const std::vector<int16_t>& data, int input_rate, int output_rate) {
+    float ratio = output_rate / (float)input_rate;
+    std::vector<int16_t> resampled;
+    resampled.reserve(data.size() * ratio + 1);
+    int interpolated = (int)ratio - 1;
+    for (size_t i = 0; i < data.size(); ++i) {
+        resampled.push_back(data[i]);
+        for (int j = 1; j <= interpolated; j++) {
+            if (i + 1 < data.size()) {
+                float t = (float)j / (interpolated + 1);
+                resampled.push_back((int16_t)(data[i] + (data[i + 1] - data[i]) * t));
+            } else {
+                resampled.push_back(data[i]);
+            }
+        }
+    }
+    return resampled.size();
+}
+
+static int16_t Tone(double frequency, int rate, size_t index) {
+    return (int16_t)lround(16000 * sin(2 * M_PI * frequency * index / rate));
+}
+
+struct Result {
+    double thd_n_db = 0;
+    double ticks_per_sample = 0;
+    size_t output_samples = 0;
+};
+
+template <typename Converter>
+static Result Run(Converter& converter, int input_rate, int output_rate, double frequency) {
+    converter.Configure(input_rate, 1, output_rate);
+    std::vector<int16_t> frame(FRAME_SAMPLES), output, all;
+    uint64_t ticks = 0;
+    for (int position = 0; position < input_rate * 2; position += FRAME_SAMPLES) {
+        for (int i = 0; i < FRAME_SAMPLES; i++) {
+            frame[i] = Tone(frequency, input_rate, position + i);
+        }
+        uint64_t start = BenchTicks();
+        size_t count = converter.Process(frame.data(), frame.size(), output);
+        ticks += BenchTicks() - start;
+        all.insert(all.end(), output.begin(), output.begin() + count);
+    }
+    Result result;
+    result.thd_n_db = ThdN(all, frequency, output_rate);
+    result.ticks_per_sample = (double)ticks / all.size();
+    result.output_samples = all.size();
+    return result;
+}
+
+int main() {
+    struct Case { int input_rate; int output_rate; double frequency; };
+    const Case cases[] = {
+        {44100, 48000, 1000}, {44100, 48000, 8000},
+        {22050, 24000, 1000}, {22050, 24000, 6000},
+        {16000, 24000, 1000}, {16000, 24000, 5000},
+        {44100, 24000, 1000}, {44100, 24000, 8000},
+        {48000, 24000, 9000}, {44100, 16000, 6000},
+    };
+    bool ok = true;
+    printf("%-14s %6s | %-24s | %-24s | %s\n", "ratio", "tone", "polyphase THD+N, cost", "linear THD+N, cost",
+        "old AddAudioData, 1 s of input");
+    for (auto& c : cases) {
+        MusicPcmConverter polyphase;
+        LinearPcmConverter linear;
+        Result p = Run(polyphase, c.input_rate, c.output_rate, c.frequency);
+        Result l = Run(linear, c.input_rate, c.output_rate, c.frequency);
+
+        size_t input_samples = (c.input_rate * 2 + FRAME_SAMPLES - 1) / FRAME_SAMPLES * FRAME_SAMPLES;
+        double expected = (double)input_samples * c.output_rate / c.input_rate;
+        bool length_ok = fabs(p.output_samples - expected) <= 1;
+        ok = ok && length_ok && p.thd_n_db <= MAX_THD_N_DB;
+
+        char old[64] = "n/a (downsampling)";
+        if (c.output_rate > c.input_rate) {
+            std::vector<int16_t> second(c.input_rate);
+            for (int i = 0; i < c.input_rate; i++) {
+                second[i] = Tone(c.frequency, c.input_rate, i);
+            }
+            snprintf(old, sizeof(old), "%zu samples, %d expected",
+                OldUpsampledLength(second, c.input_rate, c.output_rate), c.output_rate);
+        }
+        printf("%5d -> %-5d %6.0f | %7.1f dB %6.1f %s/smp | %7.1f dB %6.1f %s/smp | %s%s\n",
+            c.input_rate, c.output_rate, c.frequency, p.thd_n_db, p.ticks_per_sample, BenchTickUnit(),
+            l.thd_n_db, l.ticks_per_sample, BenchTickUnit(), old, length_ok ? "" : "  POLYPHASE LENGTH OFF");
+    }
+    return ok ? 0 : 1;
+}
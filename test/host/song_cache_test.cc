@@ -0,0 +1,263 @@
+/*
+ * SongCache against a temporary directory: commit and reload, LRU eviction, long entries, data file
+ * naming, and the clean-up Load does after a power cut (stale temp files, orphaned data files,
+ * truncated data files).
+ */
+#include "song_cache.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <string>
+#include <unistd.h>
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    } \
+} while (0)
+
+static std::string directory;
+
+static SongCache::Entry MakeEntry(const std::string& song_name, const std::string& audio_url = "http://host/a.mp3") {
+    SongCache::Entry entry;
+    entry.song_name = song_name;
+    entry.artist_name = "artist";
+    entry.audio_url = audio_url;
+    entry.lyric_url = "http://host/a.lrc";
+    return entry;
+}
+
+static bool Store(SongCache& cache, const SongCache::Entry& entry, size_t size, size_t expected_size) {
+    std::string data(size, (char)entry.song_name.size());
+    if (!cache.BeginWrite(entry, expected_size)) {
+        return false;
+    }
+    /* The downloader appends in chunks */
+    for (size_t offset = 0; offset < size; offset += 1000) {
+        size_t chunk = std::min<size_t>(1000, size - offset);
+        if (!cache.Append((const uint8_t*)data.data() + offset, chunk)) {
+            return false;
+        }
+    }
+    return cache.CommitWrite();
+}
+
+static size_t CountFiles() {
+    std::string command = "ls -1 " + directory + " | wc -l";
+    FILE* pipe = popen(command.c_str(), "r");
+    size_t count = 0;
+    if (pipe != nullptr) {
+        if (fscanf(pipe, "%zu", &count) != 1) {
+            count = 0;
+        }
+        pclose(pipe);
+    }
+    return count;
+}
+
+static void TestCommitAndReload() {
+    {
+        SongCache cache(directory, 100000);
+        cache.Load();
+        CHECK(Store(cache, MakeEntry("one"), 3000, 3000));
+        CHECK(Store(cache, MakeEntry("two"), 5000, 0));
+        CHECK(cache.used_bytes() == 8000);
+    }
+    SongCache cache(directory, 100000);
+    cache.Load();
+    CHECK(cache.used_bytes() == 8000);
+    SongCache::Entry entry;
+    CHECK(cache.Lookup("two", "artist", &entry));
+    CHECK(entry.size == 5000);
+    CHECK(entry.audio_url == "http://host/a.mp3");
+    CHECK(entry.lyric_url == "http://host/a.lrc");
+    FILE* file = cache.OpenForRead(entry);
+    CHECK(file != nullptr);
+    if (file != nullptr) {
+        fseek(file, 0, SEEK_END);
+        CHECK(ftell(file) == 5000);
+        fclose(file);
+    }
+    CHECK(!cache.Lookup("two", "someone else", &entry));
+}
+
+static void TestLruEviction() {
+    SongCache cache(directory, 10000);
+    cache.Load();
+    CHECK(Store(cache, MakeEntry("a"), 3000, 3000));
+    CHECK(Store(cache, MakeEntry("b"), 3000, 3000));
+    CHECK(Store(cache, MakeEntry("c"), 3000, 3000));
+    SongCache::Entry entry;
+    CHECK(cache.Lookup("a", "artist", &entry));
+    cache.Touch(entry);
+
+    /* "b" is now the least recently used, an unknown-length download evicts it while appending */
+    CHECK(Store(cache, MakeEntry("d"), 3000, 0));
+    CHECK(cache.Lookup("a", "artist", &entry));
+    CHECK(!cache.Lookup("b", "artist", &entry));
+    CHECK(cache.Lookup("c", "artist", &entry));
+    CHECK(cache.Lookup("d", "artist", &entry));
+    CHECK(cache.used_bytes() <= cache.budget_bytes());
+
+    /* Larger than the whole budget: refused up front, or abandoned once it outgrows the budget */
+    CHECK(!Store(cache, MakeEntry("huge"), 20000, 20000));
+    CHECK(!Store(cache, MakeEntry("huge"), 20000, 0));
+    CHECK(!cache.writing());
+}
+
+/* Signed CDN URLs run past a kilobyte, the entry must load back and keep its data file */
+static void TestLongEntries() {
+    std::string url = "http://cdn.example.com/song.mp3?token=" + std::string(3000, 'x');
+    {
+        SongCache cache(directory, 100000);
+        cache.Load();
+        CHECK(Store(cache, MakeEntry("long", url), 2000, 2000));
+    }
+    SongCache cache(directory, 100000);
+    cache.Load();
+    SongCache::Entry entry;
+    CHECK(cache.Lookup("long", "artist", &entry));
+    CHECK(entry.audio_url == url);
+    FILE* file = cache.OpenForRead(entry);
+    CHECK(file != nullptr);
+    if (file != nullptr) {
+        fclose(file);
+    }
+
+    /* Fields may not contain the index separators */
+    CHECK(!cache.BeginWrite(MakeEntry("tab\tname"), 100));
+    CHECK(!cache.BeginWrite(MakeEntry("name", "http://host/a\nb"), 100));
+}
+
+/* Every song gets its own data file, and names handed out after a reload do not reuse a kept one */
+static void TestFileNames() {
+    {
+        SongCache cache(directory, 100000);
+        cache.Load();
+        CHECK(Store(cache, MakeEntry("one"), 1000, 1000));
+        CHECK(Store(cache, MakeEntry("three"), 3000, 3000));
+    }
+    SongCache cache(directory, 100000);
+    cache.Load();
+    CHECK(Store(cache, MakeEntry("fifth"), 5000, 5000));
+    /* Downloading a cached song again replaces its entry */
+    CHECK(Store(cache, MakeEntry("one"), 2000, 2000));
+    CHECK(cache.used_bytes() == 10000);
+
+    const char* names[] = {"one", "three", "fifth"};
+    size_t sizes[] = {2000, 3000, 5000};
+    std::string file_names[3];
+    for (int i = 0; i < 3; i++) {
+        SongCache::Entry entry;
+        CHECK(cache.Lookup(names[i], "artist", &entry));
+        file_names[i] = entry.file_name;
+        /* Data files carry no extension, the stream may be any format */
+        CHECK(!entry.file_name.empty() && entry.file_name.find('.') == std::string::npos);
+        FILE* file = cache.OpenForRead(entry);
+        CHECK(file != nullptr);
+        if (file != nullptr) {
+            fseek(file, 0, SEEK_END);
+            CHECK((size_t)ftell(file) == sizes[i]);
+            CHECK(fseek(file, 0, SEEK_SET) == 0 && fgetc(file) == (int)strlen(names[i]));
+            fclose(file);
+        }
+    }
+    CHECK(file_names[0] != file_names[1] && file_names[0] != file_names[2] && file_names[1] != file_names[2]);
+    /* The index and one file per song */
+    CHECK(CountFiles() == 4);
+}
+
+/* Cuts the data file whose bytes are all `fill` (see Store) short behind the index's back */
+static void TruncateDataFile(char fill) {
+    DIR* dir = opendir(directory.c_str());
+    if (dir == nullptr) {
+        return;
+    }
+    struct dirent* item;
+    while ((item = readdir(dir)) != nullptr) {
+        std::string path = directory + "/" + item->d_name;
+        FILE* file = fopen(path.c_str(), "rb");
+        if (file == nullptr) {
+            continue;
+        }
+        int first = fgetc(file);
+        fclose(file);
+        /* Data files are the ones without an extension */
+        if (strchr(item->d_name, '.') == nullptr && first == fill) {
+            CHECK(truncate(path.c_str(), 10) == 0);
+        }
+    }
+    closedir(dir);
+}
+
+static void TestCleanupAfterPowerCut() {
+    {
+        SongCache cache(directory, 100000);
+        cache.Load();
+        CHECK(Store(cache, MakeEntry("kept"), 1000, 1000));
+        CHECK(Store(cache, MakeEntry("truncated"), 1000, 1000));
+        /* A download in progress when the power went */
+        CHECK(cache.BeginWrite(MakeEntry("pending"), 0));
+        uint8_t data[100] = {};
+        CHECK(cache.Append(data, sizeof(data)));
+        /* Keep the temp file out of reach of the destructor's AbortWrite, as a power cut would */
+        CHECK(rename((directory + "/pending.tmp").c_str(), (directory + "/pending.keep").c_str()) == 0);
+    }
+    CHECK(rename((directory + "/pending.keep").c_str(), (directory + "/pending.tmp").c_str()) == 0);
+    TruncateDataFile((char)strlen("truncated"));
+    std::string orphan = directory + "/deadbeef";
+    FILE* file = fopen(orphan.c_str(), "wb");
+    CHECK(file != nullptr);
+    if (file != nullptr) {
+        fclose(file);
+    }
+    CHECK(CountFiles() == 5);
+
+    SongCache cache(directory, 100000);
+    cache.Load();
+    SongCache::Entry entry;
+    CHECK(cache.Lookup("kept", "artist", &entry));
+    CHECK(!cache.Lookup("truncated", "artist", &entry));
+    CHECK(!cache.Lookup("pending", "artist", &entry));
+    CHECK(cache.used_bytes() == 1000);
+    /* Only the index and the kept song remain */
+    CHECK(CountFiles() == 2);
+}
+
+/* Each test starts from an empty directory */
+static void Run(void (*test)()) {
+    std::string command = "rm -rf " + directory + " && mkdir -p " + directory;
+    CHECK(system(command.c_str()) == 0);
+    test();
+}
+
+int main() {
+    char pattern[] = "/tmp/song_cache_test.XXXXXX";
+    if (mkdtemp(pattern) == nullptr) {
+        perror("mkdtemp");
+        return 1;
+    }
+    directory = pattern;
+
+    Run(TestCommitAndReload);
+    Run(TestLruEviction);
+    Run(TestLongEntries);
+    Run(TestFileNames);
+    Run(TestCleanupAfterPowerCut);
+
+    std::string command = "rm -rf " + directory;
+    if (system(command.c_str()) != 0) {
+        fprintf(stderr, "failed to remove %s\n", directory.c_str());
+    }
+    if (failures > 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("song cache: all checks passed\n");
+    return 0;
+}
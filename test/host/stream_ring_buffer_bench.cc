@@ -0,0 +1,209 @@
+/*
+ * Music stream buffer: the old per-chunk queue (malloc + mutex + condition variable per 4 KB HTTP read)
+ * against StreamRingBuffer, moving the same byte stream from a downloader thread to a player thread.
+ *
+ * - "buffer full": the network is faster than playback, so the downloader keeps the buffer at its
+ *   ceiling and waits for the player to make room
+ * - "network bound": the downloader is the slow side and the player waits for data
+ *
+ * The player checks every byte, the program fails if the stream arrives corrupted.
+ */
+#include "stream_ring_buffer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+static const size_t STREAM_BYTES = 64 * 1024 * 1024;
+static const size_t MAX_BUFFER_SIZE = 256 * 1024;      // Esp32Music::MAX_BUFFER_SIZE
+static const size_t DOWNLOAD_CHUNK_SIZE = 4096;         // Esp32Music::DOWNLOAD_CHUNK_SIZE
+static const size_t WRITE_WATERMARK = 16 * 1024;        // Esp32Music::WRITE_WATERMARK
+static const size_t FRAME_SIZE = 418;                   // A 128 kbps, 44.1 kHz MP3 frame
+static const size_t SCAN_WINDOW = 2881;                 // Mp3FrameScanner::SCAN_WINDOW
+
+struct Result {
+    double seconds = 0;
+    uint64_t producer_wakeups = 0;
+    uint64_t consumer_wakeups = 0;
+    uint64_t allocations = 0;
+    bool intact = true;
+};
+
+static void Spin(int ns) {
+    auto until = std::chrono::steady_clock::now() + std::chrono::nanoseconds(ns);
+    while (std::chrono::steady_clock::now() < until) {
+    }
+}
+
+static inline uint8_t StreamByte(size_t position) {
+    return (uint8_t)(position * 131 + (position >> 11));
+}
+
+static void FillChunk(uint8_t* data, size_t size, size_t position) {
+    for (size_t i = 0; i < size; i++) {
+        data[i] = StreamByte(position + i);
+    }
+}
+
+static bool CheckFrame(const uint8_t* data, size_t size, size_t position) {
+    for (size_t i = 0; i < size; i++) {
+        if (data[i] != StreamByte(position + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* The pre-ring design: every HTTP read is copied into its own heap block and queued under a mutex */
+static Result RunChunkQueue(int download_ns, int decode_ns) {
+    struct Chunk { uint8_t* data; size_t size; };
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::queue<Chunk> chunks;
+    size_t buffer_size = 0;
+    bool downloading = true;
+    Result result;
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread downloader([&]() {
+        uint8_t buffer[DOWNLOAD_CHUNK_SIZE];
+        for (size_t position = 0; position < STREAM_BYTES; position += DOWNLOAD_CHUNK_SIZE) {
+            Spin(download_ns);
+            FillChunk(buffer, DOWNLOAD_CHUNK_SIZE, position);
+            uint8_t* data = (uint8_t*)malloc(DOWNLOAD_CHUNK_SIZE);
+            memcpy(data, buffer, DOWNLOAD_CHUNK_SIZE);
+            result.allocations++;
+            std::unique_lock<std::mutex> lock(mutex);
+            while (buffer_size >= MAX_BUFFER_SIZE) {
+                cv.wait(lock);
+                result.producer_wakeups++;
+            }
+            chunks.push({data, DOWNLOAD_CHUNK_SIZE});
+            buffer_size += DOWNLOAD_CHUNK_SIZE;
+            cv.notify_one();
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        downloading = false;
+        cv.notify_all();
+    });
+
+    /* The player keeps at least 4 KB in an 8 KB decoder input buffer, as PlayAudioStream did */
+    uint8_t input[8192];
+    size_t bytes_left = 0;
+    size_t played = 0;
+    while (true) {
+        if (bytes_left < 4096) {
+            Chunk chunk = {nullptr, 0};
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (chunks.empty() && downloading) {
+                    cv.wait(lock);
+                    result.consumer_wakeups++;
+                }
+                if (!chunks.empty()) {
+                    chunk = chunks.front();
+                    chunks.pop();
+                    buffer_size -= chunk.size;
+                    cv.notify_one();
+                }
+            }
+            if (chunk.data != nullptr) {
+                memcpy(input + bytes_left, chunk.data, chunk.size);
+                bytes_left += chunk.size;
+                free(chunk.data);
+            } else if (bytes_left == 0) {
+                break;
+            }
+        }
+        size_t frame = std::min(FRAME_SIZE, bytes_left);
+        result.intact = result.intact && CheckFrame(input, frame, played);
+        Spin(decode_ns);
+        memmove(input, input + frame, bytes_left - frame);
+        bytes_left -= frame;
+        played += frame;
+    }
+    downloader.join();
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.intact = result.intact && played == STREAM_BYTES;
+    return result;
+}
+
+/* The ring: HTTP reads land in the ring, the decoder works on the ring in place */
+static Result RunStreamRing(int download_ns, int decode_ns) {
+    StreamRingBuffer ring(MAX_BUFFER_SIZE, SCAN_WINDOW);
+    Result result;
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread downloader([&]() {
+        size_t position = 0;
+        while (position < STREAM_BYTES) {
+            /* Esp32Music::WaitForDownloadSpace with the ceiling at the ring capacity */
+            if (ring.size() + DOWNLOAD_CHUNK_SIZE > ring.capacity() &&
+                !ring.WaitForSpace(WRITE_WATERMARK)) {
+                break;
+            }
+            uint8_t* data = nullptr;
+            size_t size = std::min({ring.PrepareWrite(&data), DOWNLOAD_CHUNK_SIZE, STREAM_BYTES - position});
+            Spin(download_ns * size / DOWNLOAD_CHUNK_SIZE);
+            FillChunk(data, size, position);
+            ring.CommitWrite(size);
+            position += size;
+        }
+        result.producer_wakeups = HostEventGroupSleeps();
+        ring.Close();
+    });
+
+    size_t played = 0;
+    while (true) {
+        const uint8_t* data = nullptr;
+        size_t size = ring.PeekLinear(&data, FRAME_SIZE);
+        if (size < FRAME_SIZE && !ring.closed()) {
+            ring.WaitForData(FRAME_SIZE);
+            continue;
+        }
+        if (size == 0) {
+            break;
+        }
+        size_t frame = std::min(FRAME_SIZE, size);
+        result.intact = result.intact && CheckFrame(data, frame, played);
+        Spin(decode_ns);
+        ring.Consume(frame);
+        played += frame;
+    }
+    result.consumer_wakeups = HostEventGroupSleeps();
+    downloader.join();
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.intact = result.intact && played == STREAM_BYTES;
+    return result;
+}
+
+static void Print(const char* name, const Result& result) {
+    double megabytes = STREAM_BYTES / (1024.0 * 1024.0);
+    printf("  %-12s %7.1f MB/s  downloader wakeups/MB %7.1f  player wakeups/MB %7.1f  allocations/MB %6.1f%s\n",
+        name, megabytes / result.seconds, result.producer_wakeups / megabytes, result.consumer_wakeups / megabytes,
+        result.allocations / megabytes, result.intact ? "" : "  CORRUPTED");
+}
+
+int main() {
+    struct Scenario { const char* name; int download_ns; int decode_ns; };
+    const Scenario scenarios[] = {
+        {"buffer full (network faster than playback)", 0, 200},
+        {"network bound (playback faster than network)", 4000, 0},
+    };
+    bool intact = true;
+    for (auto& scenario : scenarios) {
+        printf("%s, %u MB stream\n", scenario.name, (unsigned)(STREAM_BYTES >> 20));
+        Result queue = RunChunkQueue(scenario.download_ns, scenario.decode_ns);
+        Result ring = RunStreamRing(scenario.download_ns, scenario.decode_ns);
+        Print("chunk queue", queue);
+        Print("ring", ring);
+        intact = intact && queue.intact && ring.intact;
+    }
+    return intact ? 0 : 1;
+}
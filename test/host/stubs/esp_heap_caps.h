@@ -0,0 +1,15 @@
+#ifndef HOST_ESP_HEAP_CAPS_H
+#define HOST_ESP_HEAP_CAPS_H
+
+#include <cstddef>
+#include <cstdlib>
+
+#define MALLOC_CAP_SPIRAM   (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_8BIT     (1 << 2)
+
+inline void* heap_caps_malloc(size_t size, int) { return malloc(size); }
+inline void* heap_caps_calloc(size_t count, size_t size, int) { return calloc(count, size); }
+inline void heap_caps_free(void* ptr) { free(ptr); }
+
+#endif // HOST_ESP_HEAP_CAPS_H
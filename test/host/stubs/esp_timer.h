@@ -0,0 +1,10 @@
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+
+#include <cstdint>
+
+/* Monotonic microseconds, or the simulated time once HostSetTime has been called */
+int64_t esp_timer_get_time();
+void HostSetTime(int64_t time_us);
+
+#endif // HOST_ESP_TIMER_H
@@ -0,0 +1,30 @@
+#ifndef HOST_TASK_H
+#define HOST_TASK_H
+
+#include "FreeRTOS.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+/*
+ * A FreeRTOS task stand-in for host harnesses: a thread calls HostTaskBind once, after that its
+ * xTaskGetCurrentTaskHandle is the HostTask and ulTaskNotifyTake sleeps on the HostTask's counter.
+ */
+struct HostTask {
+    std::mutex mutex;
+    std::condition_variable cv;
+    uint32_t notifications = 0;
+    std::atomic<uint64_t> sleeps{0};   // ulTaskNotifyTake calls that had to block
+};
+typedef HostTask* TaskHandle_t;
+
+void HostTaskBind(HostTask* task);
+
+TaskHandle_t xTaskGetCurrentTaskHandle();
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+
+#endif // HOST_TASK_H
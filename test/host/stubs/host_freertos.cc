@@ -0,0 +1,125 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+#include <chrono>
+#include <thread>
+
+struct HostEventGroup {
+    std::mutex mutex;
+    std::condition_variable cv;
+    EventBits_t bits = 0;
+};
+
+static thread_local uint64_t event_group_sleeps = 0;
+
+EventGroupHandle_t xEventGroupCreate() {
+    return new HostEventGroup();
+}
+
+void vEventGroupDelete(EventGroupHandle_t group) {
+    delete group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    group->bits |= bits;
+    group->cv.notify_all();
+    return group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    EventBits_t previous = group->bits;
+    group->bits &= ~bits;
+    return previous;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(group->mutex);
+    auto ready = [&]() {
+        return wait_for_all ? (group->bits & bits) == bits : (group->bits & bits) != 0;
+    };
+    if (!ready()) {
+        event_group_sleeps++;
+        if (ticks == portMAX_DELAY) {
+            group->cv.wait(lock, ready);
+        } else {
+            group->cv.wait_for(lock, std::chrono::milliseconds(ticks * portTICK_PERIOD_MS), ready);
+        }
+    }
+    EventBits_t result = group->bits;
+    if (ready() && clear_on_exit) {
+        group->bits &= ~bits;
+    }
+    return result;
+}
+
+uint64_t HostEventGroupSleeps() {
+    return event_group_sleeps;
+}
+
+static thread_local HostTask* current_task = nullptr;
+
+void HostTaskBind(HostTask* task) {
+    current_task = task;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return current_task;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    std::lock_guard<std::mutex> lock(task->mutex);
+    task->notifications++;
+    task->cv.notify_one();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks) {
+    HostTask* task = current_task;
+    std::unique_lock<std::mutex> lock(task->mutex);
+    if (task->notifications == 0) {
+        task->sleeps++;
+        auto notified = [task]() { return task->notifications > 0; };
+        if (ticks == portMAX_DELAY) {
+            task->cv.wait(lock, notified);
+        } else {
+            task->cv.wait_for(lock, std::chrono::milliseconds(ticks * portTICK_PERIOD_MS), notified);
+        }
+    }
+    uint32_t count = task->notifications;
+    if (count > 0) {
+        task->notifications = clear_on_exit ? 0 : count - 1;
+    }
+    return count;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+}
+
+static int64_t simulated_time_us = -1;
+
+TickType_t xTaskGetTickCount() {
+    return (TickType_t)(esp_timer_get_time() / 1000 / portTICK_PERIOD_MS);
+}
+
+int64_t esp_timer_get_time() {
+    if (simulated_time_us >= 0) {
+        return simulated_time_us;
+    }
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+}
+
+void HostSetTime(int64_t time_us) {
+    simulated_time_us = time_us;
+}